@@ -91,9 +91,6 @@ Atmosphere::Atmosphere(void *priv, void *context, LWError *err) :
 	VSET( col, 1.0 );
 
 
-	// Originally : iteminfo     = global( LWITEMINFO_GLOBAL, GFUSE_TRANSIENT );
-	iteminfo = (LWItemInfo *) lwpp::SuperGlobal( LWITEMINFO_GLOBAL, GFUSE_TRANSIENT );
-   
 	// Originally : txedf = global( LWTXTREDFUNCS_GLOBAL, GFUSE_TRANSIENT );
 	txedf =  (LWTxtrEdFuncs *) lwpp::SuperGlobal( LWTXTREDFUNCS_GLOBAL, GFUSE_TRANSIENT );
 
@@ -114,37 +111,68 @@ Atmosphere::~Atmosphere()
 
 /*
 ======================================================================
-GADD()
+FogMedium
 
-Calculate density and illumination at a point.  Called by the ray
-marcher.
+Density of the fog layer, used by the volume integrator.  The density
+falls off exponentially from the bottom to the top of the layer and
+may be modulated by the fog texture.
 ====================================================================== */
 
-double Atmosphere::GADD( lwpp::VolumetricAccess &va, double pp[ 3 ], double y, double falloff,
-   int use_lighting, int atmos_type, double li[ 3 ] )
+FogMedium::FogMedium(Atmosphere &a, const double colour[ 3 ]) : atmos(a)
 {
-   LWItemID light = iteminfo->first( LWI_LIGHT, NULL );
-   double ilu[ 3 ], ldir[ 3 ];
+   density = 100.0 / atmos.den;
+   falloff = ( atmos.type == 1 ) ? 10.0 * atmos.fa : 0.0;
+   height = atmos.hi - atmos.lo;
+   VCPY( fogclr, colour );
 
-   /* accumulate contributions from each light */
+   /* if using a texture, initialize the micropolygon */
 
-   if ( use_lighting && ( va.getFlags() & LWVEF_COLOR )) {
-      VSET( li, 0.0 );
-      while ( light ) {
-         va.illuminate( light, pp, ldir, ilu );
-         VADD( li, ilu );
-         light = iteminfo->next( light );
-      }
+   if ( atmos.useTxtr ) {
+      memset( &mp, 0, sizeof( LWMicropol ));
+      mp.gNorm[ 1 ] = mp.wNorm[ 1 ] = 1.0;
+      mp.oAxis = mp.wAxis = 1;
+      mp.oScl[ 0 ] = mp.oScl[ 1 ] = mp.oScl[ 2 ] = 1.0;
    }
-   else
-      VSET( li, 1.0 );
+}
+
+bool FogMedium::Interval(const lwpp::Point3d &origin, const lwpp::Vector3d &dir, double &t0, double &t1) const
+{
+   if ( height <= 0 ) return false;
+
+   if ( dir.y == 0 )
+      return ( origin.y >= atmos.lo ) && ( origin.y <= atmos.hi );
 
-   /* return GADD (geometric atmospheric density distribution) */
+   double ta = ( atmos.lo - origin.y ) / dir.y;
+   double tb = ( atmos.hi - origin.y ) / dir.y;
+   if ( ta > tb ) lwpp::Swap( ta, tb );
+   t0 = lwpp::Max( t0, ta );
+   t1 = lwpp::Min( t1, tb );
+   return t0 < t1;
+}
+
+double FogMedium::Majorant(const lwpp::Point3d &origin, const lwpp::Vector3d &dir, double t0, double t1) const
+{
+   /* the density is highest at the lowest point of the interval */
 
-   if ( atmos_type == 1 )
-      return exp( -falloff * y );
+   const double y = lwpp::Min( origin.y + dir.y * t0, origin.y + dir.y * t1 );
+   return density * exp( -falloff * lwpp::Max(( y - atmos.lo ) / height, 0.0 ));
+}
+
+double FogMedium::Extinction(const lwpp::Point3d &p, double footprint, lwpp::VolumeShading &shade)
+{
+   const double y = ( p.y - atmos.lo ) / height;
+   double dtau = density * exp( -falloff * y );
+
+   if ( atmos.useTxtr ) {
+      double col[ 4 ], pos[ 3 ] = { p.x, p.y, p.z };
+      const double trans = atmos.evalTexture( &mp, pos, footprint, col );
+      VSCL3( shade.colour, col, atmos.lum );
+      dtau *= 1.0 - trans;
+   }
    else
-      return 1.0;
+      VSCL3( shade.colour, fogclr, atmos.lum );
+
+   return dtau;
 }
 
 
@@ -156,13 +184,17 @@ Evaluate the texture, which the ray marcher uses to modulate the
 transparency.
 ====================================================================== */
 
-double Atmosphere::evalTexture( LWMicropol *mp, double pos[ 3 ], double stride,
-   double col[ 4 ], LWTextureID txtr )
+double Atmosphere::evalTexture( LWMicropol *mp, const double pos[ 3 ], double stride,
+   double col[ 4 ] )
 {
    VCPY( mp->oPos, pos );
    VCPY( mp->wPos, pos );
    mp->spotSize = 0.3333 * stride;
-   return txtrf->evaluate( txtr, mp, col );
+   if ( !FogTexture.getID() ) {
+      VSET( col, 1.0 );
+      return 0.0;
+   }
+   return FogTexture.evaluate( mp, col );
 }
 
 
@@ -170,45 +202,14 @@ double Atmosphere::evalTexture( LWMicropol *mp, double pos[ 3 ], double stride,
 ======================================================================
 raymarchEval()
 
-Find the ray's intersection with the fog layer and accumulate samples
-along the ray.  Each sample has a color, an opacity, a size (called a
-stride) and is identified by its position (dist) along the ray.  The
-accumulation stops when the end of the intersection, or a max opacity,
-or a max number of samples has been reached.
+Integrate the fog layer along the ray.  The volume integrator clips
+the ray to the layer, adapts the step size to the fog density, stops
+once the ray is opaque and adds the samples to the ray.
 ====================================================================== */
 
 void Atmosphere::raymarchEval(lwpp::VolumetricAccess va)
 {
-   double density = 100.0, falloff = 10.0;
-   double integstart = 0.0, integend = 100.0;
-   double minstepsize = 0.01, maxstepsize = 100.0;
-   double k = 200.0;
    double fogclr[ 3 ];
-   int use_lighting = 1, atmos_type = type;
-
-   double dtau, last_dtau, total_tau, rstep, tau, x, y, h, col[ 4 ], trans;
-   int nsteps = 0;                  /* record number of integration steps */
-   double li[ 3 ], last_li[ 3 ];
-   LWVolumeSample sample;           /* differential color & opacity */
-   // ORIGINALLY  LWDVector PP;
-   lwpp::Point3D PP;
-   LWMicropol mp;
-
-   k *= res;
-   falloff *= fa;
-   density /= den;
-
-   h = hi - lo;
-   if ( h == 0 ) return;
-
-   /* if using a texture, initialize the micropolygon */
-
-   if ( useTxtr ) {
-      memset( &mp, 0, sizeof( LWMicropol ));
-      mp.gNorm[ 1 ] = mp.wNorm[ 1 ] = 1.0;
-      mp.oAxis = mp.wAxis = 1;
-      mp.oScl[ 0 ] = mp.oScl[ 1 ] = mp.oScl[ 2 ] = 1.0;
-   }
 
    /* get the fog color */
 
@@ -221,104 +222,8 @@ void Atmosphere::raymarchEval(lwpp::VolumetricAccess va)
       VCPY( fogclr, this->col );
    }
 
-   /* assume initially that the ray origin is in the fog */
-
-   sample.dist = va.getNearClip();
-
-   /* below the fog bottom, looking up */
-
-   if ( va.getDirection().y > 0 && va.getOrigin().y < lo ) {
-      y = ( lo - va.getOrigin().y );
-      x = y / va.getDirection().y;
-      sample.dist = sqrt( x * x + y * y );
-   }
-
-   /* above the fog top, looking down */
-
-   if ( va.getDirection().y < 0 && va.getOrigin().y > hi ) {
-      y = ( hi - va.getOrigin().y );
-      x = y / va.getDirection().y;
-      sample.dist = sqrt( x * x + y * y );
-   }
-
-   /* test if intersection within clipping range */
-
-   if ( sample.dist > va.getFarClip() ) return;
-
-   // ORIGINALLY
-   // VADDS3( PP, va.getOrigin(), va.getDirection(), sample.dist );
-   PP = ((lwpp::Point3D(va.getOrigin()) + lwpp::Vector3D(va.getDirection())) *  sample.dist);
-
-   y = ( PP.y - lo ) / h;
-
-   /* test if outside fog */
-
-   if (( y > 1 && va.getDirection().y > 0 ) || ( y < 0 && va.getDirection().y < 0 ))
-      return;
-
-   dtau = density * GADD( va, PP.asLWDVector(), y, falloff, use_lighting, atmos_type, li );
-   rstep = 1.0 / ( k * dtau + 0.001 );
-   sample.stride = sample.dist * MAX( MIN( CLAMP( rstep, minstepsize, maxstepsize ),
-      va.getFarClip() - sample.dist ), 0.0005 );
-
-   ++nsteps;
-   total_tau = 0;
-
-   while (( sample.dist <= va.getFarClip() )
-      && ( total_tau * opa < 300 ) && ( nsteps < 200 )) {
-
-      last_dtau = dtau;
-      VCPY( last_li, li );
-      // ORIGINALLY 
-	  // VADDS3( PP, va.getOrigin(), va.getDirection(), sample.dist );
-
-      y = ( upcomp( PP.asLWDVector() ) - lo ) / h;
-
-      /* test if outside fog */
-
-      if (( y > 1 && va.getDirection().y > 0 ) || ( y < 0 && va.getDirection().y < 0 ))
-         return;
-
-      dtau = density * GADD( va, PP.asLWDVector(), y, falloff, use_lighting, atmos_type, li );
-      if ( !useTxtr ) {
-         trans = 0;
-         VSCL3( col, fogclr, lum );
-      }
-      else {
-         trans = evalTexture( &mp, PP.asLWDVector(), sample.stride, col, txtr );
-         VSCL( col, lum );
-      }
-
-      if ( trans != 1.0 ) {
-         tau = 0.5 * sample.stride * ( dtau * ( 1.0 - trans ) + last_dtau );
-         total_tau += tau;
-
-         /* color */
-
-         sample.color[ 0 ] = 0.5 * col[ 0 ] * sample.stride
-            * ( li[ 0 ] * dtau + last_li[ 0 ] * last_dtau );
-         sample.color[ 1 ] = 0.5 * col[ 1 ] * sample.stride
-            * ( li[ 1 ] * dtau + last_li[ 1 ] * last_dtau );
-         sample.color[ 2 ] = 0.5 * col[ 2 ] * sample.stride
-            * ( li[ 2 ] * dtau + last_li[ 2 ] * last_dtau );
-
-         /* opacity */
-
-         VSET( sample.opacity, tau * opa );
-
-         /* add volumetric sample to the ray */
-
-         va.addSample( &sample );
-      }
-
-      /* new stride = f(dist) */
-
-      rstep = 1.0 / ( k * dtau + 0.001 );
-      sample.stride = sample.dist * MAX( MIN( CLAMP( rstep, minstepsize, maxstepsize ),
-         va.getFarClip() - sample.dist ), 0.0005 );
-      sample.dist += sample.stride;
-      nsteps += 1;
-   }
+   FogMedium medium( *this, fogclr );
+   integrator.Integrate( va, medium );
 }
 
 
@@ -686,6 +591,25 @@ LWError Atmosphere::NewTime( LWFrame f, LWTime t )
 {
 	UNUSED(f);
 	time = t;
+
+	/* map the Quality popup to the accuracy of the integration */
+
+	static const double tolerance[] = { 0.4, 0.2, 0.1, 0.05, 0.025 };
+	static const double spacing[] = { 0.2, 0.1, 0.05, 0.02, 0.01 };
+	const int q = lwpp::Clamp( res, 0, 4 );
+
+	lwpp::VolumeIntegratorSettings &s = integrator.settings;
+	s.relativeSteps = true;
+	s.minStep = 0.0005;
+	s.maxStep = 1.0;
+	s.stepTolerance = tolerance[ q ];
+	s.errorTolerance = 2.0 * tolerance[ q ];
+	s.lightSpacing = spacing[ q ];
+	s.minTransmittance = 0.001;
+	s.opacityScale = opa;
+	s.maxSteps = 200;
+	s.shadowMode = lwpp::VOLUME_SHADOW_RATIO;
+	integrator.UpdateLights();
 	return NULL;
 }
 
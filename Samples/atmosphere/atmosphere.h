@@ -2,6 +2,7 @@
 #define ATMOSPHERE_H
 
 #include <lwpp/volumetric_handler.h>
+#include <lwpp/volume_integrator.h>
 #include <lwpp/texture.h>
 #include <lwpp/texture_editor.h>
 
@@ -22,6 +23,22 @@
 enum { ID_MARCH = 0x8001, ID_HI, ID_LO, ID_FA, ID_LUM, ID_OPA, ID_DEN, ID_BCK,
 	   ID_COL, ID_RES, ID_TXTR, ID_TXBT, ID_RGRP, ID_GGRP, ID_SGRP };
 
+class Atmosphere;
+
+//! Height fog between Bottom and Top, integrated by lwpp::VolumeIntegrator
+class FogMedium : public lwpp::VolumeMedium
+{
+	Atmosphere &atmos;
+	LWMicropol mp;
+	double density, falloff, height;
+	double fogclr[ 3 ];
+public:
+	FogMedium(Atmosphere &a, const double colour[ 3 ]);
+	bool Interval(const lwpp::Point3d &origin, const lwpp::Vector3d &dir, double &t0, double &t1) const;
+	double Majorant(const lwpp::Point3d &origin, const lwpp::Vector3d &dir, double t0, double t1) const;
+	double Extinction(const lwpp::Point3d &p, double footprint, lwpp::VolumeShading &shade);
+};
+
 class Atmosphere: public lwpp::XPanelVolumetricHandler
 {
 
@@ -34,7 +51,7 @@ private:
 	LWTextureFuncs *txtrf;
 	LWTxtrEdFuncs *txedf;
 	LWBackdropInfo *backdropinfo;
-	LWItemInfo *iteminfo;
+	lwpp::VolumeIntegrator integrator;
 
 public:
 
@@ -82,8 +99,7 @@ public:
 	// Overall fog effect calculations similar to LW's standard fog 
 	void analyticEval(lwpp::VolumetricAccess va);
 
-	double evalTexture( LWMicropol *mp, double pos[ 3 ], double stride, double col[ 4 ], LWTextureID txtr );
-	double GADD( lwpp::VolumetricAccess &va, double pp[ 3 ], double y, double falloff, int use_lighting, int atmos_type, double li[ 3 ] );
+	double evalTexture( LWMicropol *mp, const double pos[ 3 ], double stride, double col[ 4 ] );
 
 };
 
@@ -5,8 +5,18 @@
 #include <lwpp/lw_server.h>
 #include <lwpp/monitor.h>
 #include <lwpp/message.h>
+#include <lwpp/imageio_handler.h>
+#include <lwpp/threads.h>
 #include <lwtypes.h>
 #include <lwanimlod.h>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 
 namespace lwpp
 {
@@ -52,6 +62,280 @@ namespace lwpp
     virtual void			Evaluate      (double, LWAnimFrameAccess *) = 0;
   };
 
+	//! A decoded frame of an animation
+	struct AnimFrame
+	{
+		int width = 0;
+		int height = 0;
+		LWImageType type = LWIMTYP_RGBAFP;
+		size_t stride = 0;	//!< Bytes per scanline
+		std::vector<unsigned char> pixels;
+
+		//! Set the size and type and allocate the pixels
+		void Allocate(int w, int h, LWImageType t)
+		{
+			width = w;
+			height = h;
+			type = t;
+			stride = BytesPerPixel(t) * w;
+			pixels.resize(stride * h);
+		}
+		unsigned char *Line(int y) { return &pixels[y * stride]; }
+		const unsigned char *Line(int y) const { return &pixels[y * stride]; }
+		size_t MemorySize() const { return sizeof(*this) + pixels.capacity(); }
+	};
+
+	//! Animation loader with a cache of decoded frames and read-ahead on background threads
+	/*!
+	 * @ingroup Handler
+	 * Derive from this instead of AnimLoaderHandler and implement DecodeFrame(). Decoded frames are kept in a least
+	 * recently used cache limited by memoryBudget. After each Evaluate() the next readAhead frames in the direction of
+	 * playback are decoded on background threads, so playback and scrubbing mostly send frames from the cache.
+	 *
+	 * DecodeFrame() is called from the background threads and from Evaluate() at the same time, for different frames.
+	 * Call StopReadAhead() in the destructor of the derived class, before anything DecodeFrame() uses is destroyed.
+	 */
+	class CachedAnimLoaderHandler : public AnimLoaderHandler
+	{
+		typedef std::shared_ptr<const AnimFrame> FramePtr;
+		struct CacheEntry
+		{
+			FramePtr frame;
+			std::list<int>::iterator lru;
+		};
+		std::map<int, CacheEntry> cache;
+		std::list<int> lru;								//!< Most recently used first
+		std::set<int> pending;						//!< Frames being decoded
+		std::deque<int> queue;						//!< Frames to read ahead
+		size_t cacheSize = 0;
+		size_t frameSize = 0;							//!< Size of the last decoded frame
+		int lastFrame = -1;
+		int direction = 1;
+		std::mutex lock;
+		std::condition_variable work;
+		std::condition_variable decoded;
+		ThreadGroup *workers = nullptr;
+		unsigned int nextWorker = 0;
+		bool stopping = false;
+
+		//! Insert a decoded frame and evict the least recently used frames over the budget, lock must be held
+		void insert(int frame, const FramePtr &image)
+		{
+			lru.push_front(frame);
+			CacheEntry entry;
+			entry.frame = image;
+			entry.lru = lru.begin();
+			cache[frame] = entry;
+			cacheSize += image->MemorySize();
+			frameSize = image->MemorySize();
+			while ((cacheSize > memoryBudget) && (cache.size() > 1))
+			{
+				const int victim = lru.back();
+				if (victim == lastFrame) break;
+				auto it = cache.find(victim);
+				cacheSize -= it->second.frame->MemorySize();
+				cache.erase(it);
+				lru.pop_back();
+			}
+		}
+		//! Look up a frame and mark it as used, lock must be held
+		FramePtr find(int frame)
+		{
+			auto it = cache.find(frame);
+			if (it == cache.end()) return FramePtr();
+			lru.splice(lru.begin(), lru, it->second.lru);
+			return it->second.frame;
+		}
+		FramePtr decode(int frame, unsigned int worker)
+		{
+			std::shared_ptr<AnimFrame> image(new AnimFrame);
+			try
+			{
+				if (DecodeFrame(frame, *image, worker) && !image->pixels.empty()) return image;
+			}
+			catch (std::exception &)
+			{
+				if (worker == decodeThreads) throw;	// Evaluate() reports through the adaptor
+			}
+			return FramePtr();
+		}
+		void workerRun(unsigned int worker)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				work.wait(guard, [&] { return stopping || !queue.empty(); });
+				if (stopping) return;
+				const int frame = queue.front();
+				queue.pop_front();
+				if (cache.count(frame) || pending.count(frame)) continue;
+				pending.insert(frame);
+				guard.unlock();
+				FramePtr image = decode(frame, worker);
+				guard.lock();
+				pending.erase(frame);
+				if (image) insert(frame, image);
+				decoded.notify_all();
+			}
+		}
+		static int workerFunc(void *arg)
+		{
+			CachedAnimLoaderHandler *loader = static_cast<CachedAnimLoaderHandler *>(arg);
+			unsigned int worker;
+			{
+				std::lock_guard<std::mutex> guard(loader->lock);
+				worker = loader->nextWorker++;
+			}
+			loader->workerRun(worker);
+			return 0;
+		}
+		void startWorkers()
+		{
+			if (workers || (decodeThreads == 0)) return;
+			nextWorker = 0;
+			stopping = false;
+			workers = new ThreadGroup(static_cast<int>(decodeThreads));
+			for (unsigned int i = 0; i < decodeThreads; ++i)
+			{
+				workers->addThread(workerFunc, 0, this);
+			}
+			if ((workers->getThreadCount() != static_cast<int>(decodeThreads)) || !workers->begin())
+			{
+				delete workers;
+				workers = nullptr;
+			}
+		}
+		//! Queue the frames ahead of the current one, replacing older requests
+		void scheduleReadAhead(int frame)
+		{
+			int count = readAhead;
+			if (frameSize > 0)
+			{
+				// keep half of the budget for frames that have already been shown
+				count = std::min(count, static_cast<int>(memoryBudget / (2 * frameSize)));
+			}
+			queue.clear();
+			for (int i = 1; i <= count; ++i)
+			{
+				const int ahead = frame + i * direction;
+				if ((ahead < 0) || (ahead >= GetFrameCount())) break;
+				if (!cache.count(ahead) && !pending.count(ahead)) queue.push_back(ahead);
+			}
+		}
+		bool send(const AnimFrame &image, LWAnimFrameAccess *fa)
+		{
+			LWImageProtocolID id = fa->begin(fa->priv_data, image.type);
+			if (!id) return false;
+			ImageLoaderProtocol protocol(id);
+			protocol.SetSize(image.width, image.height);
+			for (int y = 0; y < image.height; ++y)
+			{
+				protocol.SendLine(y, (const LWPixelID)image.Line(y));
+			}
+			protocol.Done();
+			fa->done(fa->priv_data, id);
+			return true;
+		}
+	protected:
+		//! Limit for the decoded frames in the cache in bytes
+		size_t memoryBudget = 512 * 1024 * 1024;
+		//! Number of frames to decode ahead of the current one
+		int readAhead = 8;
+		//! Number of background threads, 0 to decode on demand only
+		unsigned int decodeThreads = 2;
+
+		//! Decode a frame
+		/*!
+		 * @param worker Index of the calling thread, at most decodeThreads, use it for per thread decoders
+		 * @return false if the frame can not be decoded
+		 */
+		virtual bool DecodeFrame(int frame, AnimFrame &image, unsigned int worker) = 0;
+		//! Frame shown at a time in seconds
+		virtual int FrameAtTime(double time)
+		{
+			const int frame = static_cast<int>(std::floor(time * GetFrameRate() + 0.5));
+			return Clamp(frame, 0, std::max(GetFrameCount() - 1, 0));
+		}
+	public:
+		CachedAnimLoaderHandler(void* g, void* context, LWError* err)
+			: AnimLoaderHandler(g, context, err)
+		{
+			;
+		}
+		virtual ~CachedAnimLoaderHandler()
+		{
+			StopReadAhead();
+		}
+		//! Stop and join the background threads
+		void StopReadAhead()
+		{
+			if (!workers) return;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+				queue.clear();
+			}
+			work.notify_all();
+			workers->sync();
+			delete workers;
+			workers = nullptr;
+		}
+		//! Drop all cached frames, for example when the file changed
+		void FlushCache()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			cache.clear();
+			lru.clear();
+			queue.clear();
+			cacheSize = 0;
+		}
+		size_t CacheMemorySize()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return cacheSize;
+		}
+
+		virtual void Evaluate(double time, LWAnimFrameAccess *fa)
+		{
+			const int frame = FrameAtTime(time);
+			startWorkers();
+			FramePtr image;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				if ((lastFrame >= 0) && (frame != lastFrame)) direction = (frame > lastFrame) ? 1 : -1;
+				lastFrame = frame;
+				for (;;)
+				{
+					image = find(frame);
+					if (image || !pending.count(frame)) break;
+					decoded.wait(guard);
+				}
+				if (!image)
+				{
+					pending.insert(frame);
+					guard.unlock();
+					try
+					{
+						image = decode(frame, decodeThreads);
+					}
+					catch (...)
+					{
+						guard.lock();
+						pending.erase(frame);
+						throw;
+					}
+					guard.lock();
+					pending.erase(frame);
+					if (image) insert(frame, image);
+					decoded.notify_all();
+				}
+				scheduleReadAhead(frame);
+			}
+			work.notify_all();
+			if (image) send(*image, fa);
+		}
+	};
+
   //! @ingroup Adaptor
   template <class T>
   class AnimLoaderAdaptor : public InstanceAdaptor <T>
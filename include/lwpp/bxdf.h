@@ -28,10 +28,16 @@ namespace lwpp
 	  }
     /*
     void resetBSDF (LWBSDF bsdf);
-
-    LWBxDF createBxDF(LWBxDF_F* f, LWBxDF_SampleF* sampleF, size_t memorySize, unsigned int flags, const char* label);
-    void destroyBxDF (LWBxDF);
-
+    */
+    LWBxDF createBxDF(LWBxDF_F* f, LWBxDF_SampleF* sampleF, size_t memorySize, unsigned int flags, const char* label)
+    {
+      return globPtr->createBxDF(f, sampleF, memorySize, flags, label);
+    }
+    void destroyBxDF (LWBxDF bxdf)
+    {
+      globPtr->destroyBxDF(bxdf);
+    }
+    /*
     LWBSSRDF createBSSRDF (const char* label);
     void destroyBSSRDF (LWBSSRDF);
 
@@ -0,0 +1,489 @@
+/*!
+ * @file
+ * @brief Ready made BxDF lobes for use with BSDFFuncs
+ */
+#ifndef LWPP_BXDF_LOBES_H
+#define LWPP_BXDF_LOBES_H
+
+#include <lwpp/bxdf.h>
+#include <lwpp/vector3d.h>
+#include <lwpp/math.h>
+#include <cmath>
+
+namespace lwpp
+{
+	//! Orthonormal shading frame, the normal is the local z axis
+	/*!
+	 * Plain data so it can be copied into the memory of a LWBxDF.
+	 */
+	struct BxDFFrame
+	{
+		double t[3];
+		double b[3];
+		double n[3];
+
+		//! Build a frame around a normal, see Duff et al. "Building an Orthonormal Basis, Revisited"
+		void Set(const Vector3d &normal)
+		{
+			const double sign = (normal.z >= 0.0) ? 1.0 : -1.0;
+			const double a = -1.0 / (sign + normal.z);
+			const double c = normal.x * normal.y * a;
+			t[0] = 1.0 + sign * normal.x * normal.x * a; t[1] = sign * c; t[2] = -sign * normal.x;
+			b[0] = c; b[1] = sign + normal.y * normal.y * a; b[2] = -normal.y;
+			n[0] = normal.x; n[1] = normal.y; n[2] = normal.z;
+		}
+		//! Build a frame around a normal with the x axis aligned to a tangent, for anisotropic lobes
+		void Set(const Vector3d &normal, const Vector3d &tangent)
+		{
+			Vector3d tn = tangent - normal * normal.Dot(tangent);
+			if (tn.Dot(tn) < 1e-12)
+			{
+				Set(normal);
+				return;
+			}
+			tn.Normalize();
+			const Vector3d bn = normal.Cross(tn);
+			t[0] = tn.x; t[1] = tn.y; t[2] = tn.z;
+			b[0] = bn.x; b[1] = bn.y; b[2] = bn.z;
+			n[0] = normal.x; n[1] = normal.y; n[2] = normal.z;
+		}
+		Vector3d ToLocal(const double w[3]) const
+		{
+			return Vector3d(w[0] * t[0] + w[1] * t[1] + w[2] * t[2],
+											w[0] * b[0] + w[1] * b[1] + w[2] * b[2],
+											w[0] * n[0] + w[1] * n[1] + w[2] * n[2]);
+		}
+		void ToWorld(const Vector3d &w, double out[3]) const
+		{
+			for (int i = 0; i < 3; ++i) out[i] = w.x * t[i] + w.y * b[i] + w.z * n[i];
+		}
+	};
+
+	//! @name Sampling and microfacet helpers, all directions in the local shading frame
+	//@{
+	inline Vector3d SampleCosineHemisphere(double u1, double u2)
+	{
+		// concentric disk mapping
+		const double a = 2.0 * u1 - 1.0;
+		const double b = 2.0 * u2 - 1.0;
+		double r, phi;
+		if (a == 0.0 && b == 0.0)
+		{
+			r = 0.0;
+			phi = 0.0;
+		}
+		else if (a * a > b * b)
+		{
+			r = a;
+			phi = (PI / 4.0) * (b / a);
+		}
+		else
+		{
+			r = b;
+			phi = HALFPI - (PI / 4.0) * (a / b);
+		}
+		const double x = r * std::cos(phi);
+		const double y = r * std::sin(phi);
+		return Vector3d(x, y, std::sqrt(Max(0.0, 1.0 - x * x - y * y)));
+	}
+
+	inline bool SameHemisphere(const Vector3d &wo, const Vector3d &wi)
+	{
+		return (wo.z > 0.0) && (wi.z > 0.0);
+	}
+
+	//! Schlick's approximation of the Fresnel reflectance for a colour at normal incidence
+	struct SchlickFresnel
+	{
+		double f0[3];
+
+		void Set(const double reflectance[3])
+		{
+			for (int i = 0; i < 3; ++i) f0[i] = reflectance[i];
+		}
+		void Evaluate(double cosTheta, double F[3]) const
+		{
+			const double m = Clamp(1.0 - cosTheta, 0.0, 1.0);
+			const double m5 = (m * m) * (m * m) * m;
+			for (int i = 0; i < 3; ++i) F[i] = f0[i] + (1.0 - f0[i]) * m5;
+		}
+	};
+
+	//! Reflectance of a thin dielectric film on a dielectric substrate
+	/*!
+	 * Evaluates the Airy summation of the interference at the red, green and blue wavelengths.
+	 */
+	struct ThinFilmFresnel
+	{
+		double thickness;	//!< Film thickness in nanometers
+		double filmIOR;
+		double baseIOR;		//!< IOR of the substrate below the film
+
+		void Set(double filmThickness, double iorFilm, double iorBase)
+		{
+			thickness = Max(filmThickness, 0.0);
+			filmIOR = Max(iorFilm, 1.0);
+			baseIOR = Max(iorBase, 1.0);
+		}
+		void Evaluate(double cosTheta, double F[3]) const
+		{
+			static const double wavelength[3] = { 650.0, 510.0, 475.0 };
+			const double c1 = Clamp(cosTheta, 0.0, 1.0);
+			const double s1Sqr = 1.0 - c1 * c1;
+			const double s2Sqr = s1Sqr / (filmIOR * filmIOR);
+			const double s3Sqr = s1Sqr / (baseIOR * baseIOR);
+			const double c2 = std::sqrt(Max(0.0, 1.0 - s2Sqr));
+			const double c3 = std::sqrt(Max(0.0, 1.0 - s3Sqr));
+			// amplitudes at the air/film and film/substrate interfaces
+			const double r12s = (c1 - filmIOR * c2) / (c1 + filmIOR * c2);
+			const double r12p = (filmIOR * c1 - c2) / (filmIOR * c1 + c2);
+			const double r23s = (filmIOR * c2 - baseIOR * c3) / (filmIOR * c2 + baseIOR * c3);
+			const double r23p = (baseIOR * c2 - filmIOR * c3) / (baseIOR * c2 + filmIOR * c3);
+			const double opd = 2.0 * filmIOR * thickness * c2;
+			for (int i = 0; i < 3; ++i)
+			{
+				const double cosPhase = std::cos(TWOPI * opd / wavelength[i]);
+				const double rs = (r12s * r12s + r23s * r23s + 2.0 * r12s * r23s * cosPhase) /
+					(1.0 + r12s * r12s * r23s * r23s + 2.0 * r12s * r23s * cosPhase);
+				const double rp = (r12p * r12p + r23p * r23p + 2.0 * r12p * r23p * cosPhase) /
+					(1.0 + r12p * r12p * r23p * r23p + 2.0 * r12p * r23p * cosPhase);
+				F[i] = Clamp(0.5 * (rs + rp), 0.0, 1.0);
+			}
+		}
+	};
+	//@}
+
+	//! Lambertian diffuse reflection
+	struct LambertLobe
+	{
+		static const unsigned int Flags = BXDF_DIFFUSE;
+		double colour[3];
+
+		void Set(const double albedo[3])
+		{
+			for (int i = 0; i < 3; ++i) colour[i] = albedo[i];
+		}
+		//! @return the pdf of sampling wi
+		double Evaluate(const Vector3d &wo, const Vector3d &wi, double f[3]) const
+		{
+			const double s = SameHemisphere(wo, wi) ? 1.0 / PI : 0.0;
+			for (int i = 0; i < 3; ++i) f[i] = colour[i] * s;
+			return wi.z * s;
+		}
+		double Sample(const Vector3d &wo, double u1, double u2, Vector3d &wi, double f[3]) const
+		{
+			wi = SampleCosineHemisphere(u1, u2);
+			return Evaluate(wo, wi, f);
+		}
+	};
+
+	//! Oren-Nayar diffuse reflection from rough surfaces
+	struct OrenNayarLobe
+	{
+		static const unsigned int Flags = BXDF_DIFFUSE;
+		double colour[3];
+		double A;
+		double B;
+
+		//! @param sigma Standard deviation of the facet angle in radians
+		void Set(const double albedo[3], double sigma)
+		{
+			for (int i = 0; i < 3; ++i) colour[i] = albedo[i];
+			const double s2 = sigma * sigma;
+			A = 1.0 - s2 / (2.0 * (s2 + 0.33));
+			B = 0.45 * s2 / (s2 + 0.09);
+		}
+		double Evaluate(const Vector3d &wo, const Vector3d &wi, double f[3]) const
+		{
+			if (!SameHemisphere(wo, wi))
+			{
+				f[0] = f[1] = f[2] = 0.0;
+				return 0.0;
+			}
+			const double sinI = std::sqrt(Max(0.0, 1.0 - wi.z * wi.z));
+			const double sinO = std::sqrt(Max(0.0, 1.0 - wo.z * wo.z));
+			// cos(phi_i - phi_o) without trigonometry
+			double maxCos = 0.0;
+			if (sinI > 1e-4 && sinO > 1e-4)
+			{
+				maxCos = Max(0.0, (wi.x * wo.x + wi.y * wo.y) / (sinI * sinO));
+			}
+			double sinAlpha, tanBeta;
+			if (wi.z < wo.z)
+			{
+				sinAlpha = sinI;
+				tanBeta = sinO / wo.z;
+			}
+			else
+			{
+				sinAlpha = sinO;
+				tanBeta = sinI / wi.z;
+			}
+			const double s = (A + B * maxCos * sinAlpha * tanBeta) / PI;
+			for (int i = 0; i < 3; ++i) f[i] = colour[i] * s;
+			return wi.z / PI;
+		}
+		double Sample(const Vector3d &wo, double u1, double u2, Vector3d &wi, double f[3]) const
+		{
+			wi = SampleCosineHemisphere(u1, u2);
+			return Evaluate(wo, wi, f);
+		}
+	};
+
+	//! Anisotropic GGX microfacet reflection with sampling of the visible normals
+	/*!
+	 * See Heitz, "Sampling the GGX Distribution of Visible Normals", JCGT 2018.
+	 * @tparam Fresnel SchlickFresnel or ThinFilmFresnel
+	 */
+	template <class Fresnel>
+	struct MicrofacetLobe
+	{
+		static const unsigned int Flags = BXDF_SPECULAR;
+		double alphaX;
+		double alphaY;
+		Fresnel fresnel;
+
+		//! Set the roughness as perceived by the user, alpha = roughness²
+		void SetRoughness(double roughness, double anisotropy = 0.0)
+		{
+			const double alpha = Max(roughness * roughness, 1e-4);
+			const double aspect = std::sqrt(1.0 - 0.9 * Clamp(anisotropy, 0.0, 1.0));
+			alphaX = Max(alpha / aspect, 1e-4);
+			alphaY = Max(alpha * aspect, 1e-4);
+		}
+		double D(const Vector3d &h) const
+		{
+			const double x = h.x / alphaX;
+			const double y = h.y / alphaY;
+			const double e = x * x + y * y + h.z * h.z;
+			return 1.0 / (PI * alphaX * alphaY * e * e);
+		}
+		double Lambda(const Vector3d &w) const
+		{
+			const double a2 = (Sqr(alphaX * w.x) + Sqr(alphaY * w.y)) / (w.z * w.z);
+			return 0.5 * (std::sqrt(1.0 + a2) - 1.0);
+		}
+		double Evaluate(const Vector3d &wo, const Vector3d &wi, double f[3]) const
+		{
+			if (!SameHemisphere(wo, wi))
+			{
+				f[0] = f[1] = f[2] = 0.0;
+				return 0.0;
+			}
+			Vector3d h = wo + wi;
+			h.Normalize();
+			const double d = D(h);
+			const double lambdaO = Lambda(wo);
+			const double lambdaI = Lambda(wi);
+			double F[3];
+			fresnel.Evaluate(wi.Dot(h), F);
+			const double s = d / ((1.0 + lambdaO + lambdaI) * 4.0 * wo.z * wi.z);
+			for (int i = 0; i < 3; ++i) f[i] = F[i] * s;
+			// pdf of the visible normal times the jacobian of the reflection
+			return d / ((1.0 + lambdaO) * 4.0 * wo.z);
+		}
+		double Sample(const Vector3d &wo, double u1, double u2, Vector3d &wi, double f[3]) const
+		{
+			if (wo.z <= 0.0)
+			{
+				f[0] = f[1] = f[2] = 0.0;
+				return 0.0;
+			}
+			// transform the view direction to the hemisphere configuration
+			Vector3d vh(alphaX * wo.x, alphaY * wo.y, wo.z);
+			vh.Normalize();
+			const double lensq = vh.x * vh.x + vh.y * vh.y;
+			const Vector3d t1 = (lensq > 0.0) ? Vector3d(-vh.y, vh.x, 0.0) * (1.0 / std::sqrt(lensq)) : Vector3d(1.0, 0.0, 0.0);
+			const Vector3d t2 = vh.Cross(t1);
+			// sample the projected area
+			const double r = std::sqrt(u1);
+			const double phi = TWOPI * u2;
+			const double p1 = r * std::cos(phi);
+			const double s = 0.5 * (1.0 + vh.z);
+			const double p2 = (1.0 - s) * std::sqrt(Max(0.0, 1.0 - p1 * p1)) + s * r * std::sin(phi);
+			const Vector3d nh = t1 * p1 + t2 * p2 + vh * std::sqrt(Max(0.0, 1.0 - p1 * p1 - p2 * p2));
+			// back to the ellipsoid configuration
+			Vector3d m(alphaX * nh.x, alphaY * nh.y, Max(1e-6, nh.z));
+			m.Normalize();
+			wi = m * (2.0 * wo.Dot(m)) - wo;
+			return Evaluate(wo, wi, f);
+		}
+	};
+
+	typedef MicrofacetLobe<SchlickFresnel> GGXLobe;
+	typedef MicrofacetLobe<ThinFilmFresnel> ThinFilmLobe;
+
+	//! Sheen for cloth like surfaces
+	/*!
+	 * Uses the "Charlie" distribution by Estevez and Kulla with Neubelt's visibility term.
+	 */
+	struct SheenLobe
+	{
+		static const unsigned int Flags = BXDF_SPECULAR;
+		double colour[3];
+		double invR;
+
+		void Set(const double tint[3], double roughness)
+		{
+			for (int i = 0; i < 3; ++i) colour[i] = tint[i];
+			invR = 1.0 / Clamp(roughness, 0.01, 1.0);
+		}
+		double Evaluate(const Vector3d &wo, const Vector3d &wi, double f[3]) const
+		{
+			if (!SameHemisphere(wo, wi))
+			{
+				f[0] = f[1] = f[2] = 0.0;
+				return 0.0;
+			}
+			Vector3d h = wo + wi;
+			h.Normalize();
+			const double sinH = std::sqrt(Max(0.0, 1.0 - h.z * h.z));
+			const double d = (2.0 + invR) * std::pow(sinH, invR) / TWOPI;
+			const double v = 1.0 / (4.0 * (wi.z + wo.z - wi.z * wo.z));
+			const double s = d * v;
+			for (int i = 0; i < 3; ++i) f[i] = colour[i] * s;
+			return wi.z / PI;
+		}
+		double Sample(const Vector3d &wo, double u1, double u2, Vector3d &wi, double f[3]) const
+		{
+			wi = SampleCosineHemisphere(u1, u2);
+			return Evaluate(wo, wi, f);
+		}
+	};
+
+	//! Arrays of directions and results for the batched lobe functions
+	/*!
+	 * Directions are in the local shading frame, stored as separate x, y and z arrays.
+	 */
+	struct BxDFBatch
+	{
+		size_t count;
+		const double *wo[3];
+		double *wi[3];	//!< Input for EvaluateBatch(), output of SampleBatch()
+		double *f[3];
+		double *pdf;
+	};
+
+	//! Evaluate a lobe for all directions of a batch
+	template <class Lobe>
+	void EvaluateBatch(const Lobe &lobe, BxDFBatch &batch)
+	{
+		for (size_t i = 0; i < batch.count; ++i)
+		{
+			const Vector3d wo(batch.wo[0][i], batch.wo[1][i], batch.wo[2][i]);
+			const Vector3d wi(batch.wi[0][i], batch.wi[1][i], batch.wi[2][i]);
+			double f[3];
+			batch.pdf[i] = lobe.Evaluate(wo, wi, f);
+			batch.f[0][i] = f[0];
+			batch.f[1][i] = f[1];
+			batch.f[2][i] = f[2];
+		}
+	}
+
+	//! Sample a lobe for all directions of a batch
+	/*!
+	 * @param u1, u2 Uniform random numbers in [0, 1), one pair per direction
+	 */
+	template <class Lobe>
+	void SampleBatch(const Lobe &lobe, BxDFBatch &batch, const double *u1, const double *u2)
+	{
+		for (size_t i = 0; i < batch.count; ++i)
+		{
+			const Vector3d wo(batch.wo[0][i], batch.wo[1][i], batch.wo[2][i]);
+			Vector3d wi;
+			double f[3];
+			batch.pdf[i] = lobe.Sample(wo, u1[i], u2[i], wi, f);
+			batch.wi[0][i] = wi.x;
+			batch.wi[1][i] = wi.y;
+			batch.wi[2][i] = wi.z;
+			batch.f[0][i] = f[0];
+			batch.f[1][i] = f[1];
+			batch.f[2][i] = f[2];
+		}
+	}
+
+	//! Data of a lobe added to a BSDF, the directions passed by LightWave are in world space
+	template <class Lobe>
+	struct BxDFLobeData
+	{
+		BxDFFrame frame;
+		Lobe lobe;
+	};
+
+	namespace detail
+	{
+		// The callbacks are declared after the SDK typedefs, so they match whatever the SDK uses for the data argument
+		template <class Lobe, typename Sig> struct BxDFEvaluateCallback;
+		template <class Lobe, typename R, typename D, typename WO, typename WI, typename FV>
+		struct BxDFEvaluateCallback<Lobe, R(D, WO, WI, FV)>
+		{
+			static R Call(D data, WO wo, WI wi, FV f)
+			{
+				const BxDFLobeData<Lobe> *d = (const BxDFLobeData<Lobe> *)(data);
+				return lwpp::Max(d->lobe.Evaluate(d->frame.ToLocal(wo), d->frame.ToLocal(wi), f), 0.0);
+			}
+		};
+
+		template <class Lobe, typename Sig> struct BxDFSampleCallback;
+		template <class Lobe, typename R, typename D, typename SA, typename S, typename SO>
+		struct BxDFSampleCallback<Lobe, R(D, SA, S, SO)>
+		{
+			static R Call(D data, SA sa, S sample, SO so)
+			{
+				const BxDFLobeData<Lobe> *d = (const BxDFLobeData<Lobe> *)(data);
+				lwpp::Vector3d wi;
+				so->pdf = d->lobe.Sample(d->frame.ToLocal(sa->wo), sample[0], sample[1], wi, so->f);
+				d->frame.ToWorld(wi, so->wi);
+			}
+		};
+	}
+
+	//! A LWBxDF evaluating one of the lobes above
+	/*!
+	 * @ingroup Globals
+	 * Create one per plugin instance and add it to the BSDF for each shading point:
+	 * @code
+	 * lwpp::LobeBxDF<lwpp::GGXLobe> specular("Specular");
+	 * ...
+	 * lwpp::BxDFLobeData<lwpp::GGXLobe> data;
+	 * data.frame.Set(normal);
+	 * data.lobe.SetRoughness(0.3);
+	 * data.lobe.fresnel.Set(f0);
+	 * specular.add(bsdf, data, weight, 0.3);
+	 * @endcode
+	 */
+	template <class Lobe>
+	class LobeBxDF : protected BSDFFuncs
+	{
+		LWBxDF m_bxdf;
+		LobeBxDF(const LobeBxDF &);
+		LobeBxDF &operator=(const LobeBxDF &);
+	public:
+		typedef BxDFLobeData<Lobe> Data;
+
+		LobeBxDF(const char *label)
+			: m_bxdf(0)
+		{
+			if (available())
+			{
+				m_bxdf = createBxDF(&detail::BxDFEvaluateCallback<Lobe, LWBxDF_F>::Call,
+														&detail::BxDFSampleCallback<Lobe, LWBxDF_SampleF>::Call,
+														sizeof(Data), Lobe::Flags, label);
+			}
+		}
+		~LobeBxDF()
+		{
+			if (m_bxdf) destroyBxDF(m_bxdf);
+		}
+		bool isValid() const { return m_bxdf != 0; }
+		LWBxDF get() const { return m_bxdf; }
+		//! Add the lobe to a BSDF, the data is copied
+		LWBxDF add(LWBSDF bsdf, const Data &data, const LWDVector weight, double roughness = 0.0)
+		{
+			if (!m_bxdf) return 0;
+			return addBxDF(bsdf, m_bxdf, (LWUserData)&data, weight, roughness);
+		}
+	};
+} // end namespace lwpp
+
+#endif // LWPP_BXDF_LOBES_H
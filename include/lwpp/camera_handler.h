@@ -80,6 +80,7 @@ namespace lwpp
 		}
 		static int Evaluate (LWInstance inst, double fpx, double fpy, double lpx, double lpy, double fractime, LWCameraRay* ray, const LWCameraAccess* camaccess)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Camera::Evaluate");
 			T* plugin = static_cast<T*>(inst);
 			return plugin->Evaluate(fpx,fpy,lpx,lpy,fractime,ray,camaccess);
 		}
@@ -6,6 +6,8 @@
 #include <lwpp/lw_version.h>
 #include <lwpp/math.h>
 #include <lwpp/item.h>
+#include <vector>
+#include <cmath>
 
 namespace lwpp
 {
@@ -265,32 +267,220 @@ namespace lwpp
 
 	};
 
+	//! Rays of a tile of pixels, stored as separate arrays per component
+	/*!
+	 * The arrays are only grown, so a batch reused for tiles of the same size does not allocate.
+	 */
+	struct CameraRayBatch
+	{
+		int x0;				//!< First pixel of the tile
+		int y0;
+		int width;		//!< Size of the tile in pixels
+		int height;
+		int samples;	//!< Rays per pixel
+		std::vector<double> px;	//!< Image position of each ray, including the jitter
+		std::vector<double> py;
+		std::vector<double> origin[3];
+		std::vector<double> dir[3];
+		std::vector<double> filter[3];
+		std::vector<int> status;	//!< Return value of the camera evaluation
+
+		CameraRayBatch() : x0(0), y0(0), width(0), height(0), samples(0) {;}
+		size_t Count() const { return static_cast<size_t>(width) * height * samples; }
+		//! Index of a ray in the arrays
+		size_t Index(int x, int y, int sample) const
+		{
+			return (static_cast<size_t>(y - y0) * width + (x - x0)) * samples + sample;
+		}
+		void Resize(int x, int y, int w, int h, int spp)
+		{
+			x0 = x; y0 = y; width = w; height = h; samples = spp;
+			const size_t n = Count();
+			if (px.size() < n)
+			{
+				px.resize(n); py.resize(n); status.resize(n);
+				for (int i = 0; i < 3; ++i)
+				{
+					origin[i].resize(n); dir[i].resize(n); filter[i].resize(n);
+				}
+			}
+		}
+	};
+
+	//! Sub pixel positions for CameraEvaluator::GenerateTile(), samples the centre of each pixel
+	/*!
+	 * Any functor with the same signature can be used, for example to jitter with a low discrepancy sequence.
+	 */
+	struct PixelCentreSampler
+	{
+		//! @param jx, jy Returned offset within the pixel, in [0, 1)
+		void operator()(int x, int y, int sample, double &jx, double &jy) const
+		{
+			(void)x; (void)y; (void)sample;
+			jx = jy = 0.5;
+		}
+	};
+
 	//added evaluator
 	//Usage, CameraEvaluator myEvaluator(LWItemID cameraID);
 	//then myEvaluator.Evaluate(imagex,imagey,CameraRay*);
+	/*!
+	 * For whole tiles of rays call Prepare() once per frame and then GenerateTile(), which is thread safe.
+	 * Prepare() checks if the camera is a pinhole perspective or an orthographic projection without depth of field
+	 * or motion blur and fits a linear model to a few evaluated rays. The rays of such cameras are then generated
+	 * analytically instead of calling the camera for each ray.
+	 */
 	class CameraEvaluator : protected GlobalBase<LWCameraEvaluationFuncs>
 	{
 	private:
 		LWCameraEvaluatorID cameraEvaluator;
+		CameraInfo camera;
 
 		bool init;
 		bool newframe;
 		bool cleanup;
+
+		//! Linear model of a perspective or orthographic camera
+		struct Projection
+		{
+			enum Type { NONE, PERSPECTIVE, ORTHOGRAPHIC } type;
+			LWCameraEye eye;
+			int width;
+			int height;
+			int status;
+			double base[3];	//!< Origin or direction at the image position 0, 0
+			double dx[3];		//!< Change per pixel
+			double dy[3];
+			double fixed[3];	//!< Common direction or origin
+			double filter[3];
+		} fast;
+
+		void evaluateRay(double x, double y, double fractime, LWCameraEye eye, LWCameraRay &ray, int &status) const
+		{
+			double fpx, fpy;
+			PixelToFilm(x, y, fast.width, fast.height, fpx, fpy);
+			status = globPtr->evaluate(cameraEvaluator, fpx, fpy, 0.0, 0.0, fractime, eye, &ray);
+		}
+		static bool nearlyEqual(const double *a, const double *b, double eps)
+		{
+			return (std::fabs(a[0] - b[0]) <= eps) && (std::fabs(a[1] - b[1]) <= eps) && (std::fabs(a[2] - b[2]) <= eps);
+		}
+		//! Direction of the perspective model, scaled to unit distance along the view axis
+		static void scaleToPlane(const double *d, const double *axis, double *out)
+		{
+			const double s = d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2];
+			for (int i = 0; i < 3; ++i) out[i] = d[i] / s;
+		}
+		void predict(double x, double y, double *origin, double *dir) const
+		{
+			double v[3];
+			for (int i = 0; i < 3; ++i) v[i] = fast.base[i] + x * fast.dx[i] + y * fast.dy[i];
+			if (fast.type == Projection::PERSPECTIVE)
+			{
+				const double len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+				for (int i = 0; i < 3; ++i)
+				{
+					origin[i] = fast.fixed[i];
+					dir[i] = v[i] / len;
+				}
+			}
+			else
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					origin[i] = v[i];
+					dir[i] = fast.fixed[i];
+				}
+			}
+		}
+		//! Fit the linear model to evaluated rays and verify it at other positions
+		void fitProjection(LWCameraEye eye)
+		{
+			fast.type = Projection::NONE;
+			fast.eye = eye;
+			if (fast.width < 2 || fast.height < 2) return;
+			const double w = fast.width, h = fast.height;
+			LWCameraRay c, rx, ry;
+			int sc, sx, sy;
+			evaluateRay(0.0, 0.0, 0.0, eye, c, sc);
+			evaluateRay(w, 0.0, 0.0, eye, rx, sx);
+			evaluateRay(0.0, h, 0.0, eye, ry, sy);
+			if (sc != sx || sc != sy) return;
+			if (!nearlyEqual(c.filter, rx.filter, 1e-9) || !nearlyEqual(c.filter, ry.filter, 1e-9)) return;
+			fast.status = sc;
+			for (int i = 0; i < 3; ++i) fast.filter[i] = c.filter[i];
+
+			const double eps = 1e-6;
+			if (nearlyEqual(c.rayPos, rx.rayPos, eps) && nearlyEqual(c.rayPos, ry.rayPos, eps))
+			{
+				LWCameraRay m;
+				int sm;
+				evaluateRay(w * 0.5, h * 0.5, 0.0, eye, m, sm);
+				double dc[3], dX[3], dY[3];
+				scaleToPlane(c.rayDir, m.rayDir, dc);
+				scaleToPlane(rx.rayDir, m.rayDir, dX);
+				scaleToPlane(ry.rayDir, m.rayDir, dY);
+				for (int i = 0; i < 3; ++i)
+				{
+					fast.fixed[i] = c.rayPos[i];
+					fast.base[i] = dc[i];
+					fast.dx[i] = (dX[i] - dc[i]) / w;
+					fast.dy[i] = (dY[i] - dc[i]) / h;
+				}
+				fast.type = Projection::PERSPECTIVE;
+			}
+			else if (nearlyEqual(c.rayDir, rx.rayDir, eps) && nearlyEqual(c.rayDir, ry.rayDir, eps))
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					fast.fixed[i] = c.rayDir[i];
+					fast.base[i] = c.rayPos[i];
+					fast.dx[i] = (rx.rayPos[i] - c.rayPos[i]) / w;
+					fast.dy[i] = (ry.rayPos[i] - c.rayPos[i]) / h;
+				}
+				fast.type = Projection::ORTHOGRAPHIC;
+			}
+			else
+			{
+				return;
+			}
+
+			// reject lens distortions and other non-linear projections
+			static const double check[4][2] = { { 0.5, 0.5 }, { 1.0, 1.0 }, { 0.25, 0.75 }, { 0.9, 0.1 } };
+			const double size = std::sqrt(Sqr(fast.dx[0]) + Sqr(fast.dx[1]) + Sqr(fast.dx[2])) * w;
+			for (int k = 0; k < 4; ++k)
+			{
+				LWCameraRay r;
+				int s;
+				const double x = check[k][0] * w, y = check[k][1] * h;
+				evaluateRay(x, y, 0.0, eye, r, s);
+				double o[3], d[3];
+				predict(x, y, o, d);
+				if ((s != fast.status) || !nearlyEqual(o, r.rayPos, 1e-6 * Max(size, 1.0)) || !nearlyEqual(d, r.rayDir, 1e-6))
+				{
+					fast.type = Projection::NONE;
+					return;
+				}
+			}
+		}
 	public:
 		LWCameraRay camRay;
 		//Simple constructor, loads first camera
-		CameraEvaluator() : init(false), newframe(false), cleanup(false), cameraEvaluator(0)
+		CameraEvaluator() : cameraEvaluator(0), init(false), newframe(false), cleanup(false)
 		{
+			fast.type = Projection::NONE;
 			ItemInfo myItem;
 			Create(myItem.first(LWI_CAMERA, NULL));
 		}
 		//Define which camera you want to use
-		CameraEvaluator(LWItemID _camera) : init(false), newframe(false), cleanup(false), cameraEvaluator(0)
+		CameraEvaluator(LWItemID _camera) : cameraEvaluator(0), init(false), newframe(false), cleanup(false)
 		{
+			fast.type = Projection::NONE;
 			Create(_camera);
 		}
-        CameraEvaluator(CameraInfo _caminfo) : init(false), newframe(false), cleanup(false), cameraEvaluator(0)
+        CameraEvaluator(CameraInfo _caminfo) : cameraEvaluator(0), init(false), newframe(false), cleanup(false)
 		{
+			fast.type = Projection::NONE;
 			Create(_caminfo.getID());
 		}
 		~CameraEvaluator()
@@ -303,7 +493,9 @@ namespace lwpp
 		{
 			if(cameraEvaluator) Destroy();
 			cameraEvaluator = globPtr->create(cameraID);
+			camera.setID(cameraID);
 			init=false; newframe=false; cleanup=false;
+			fast.type = Projection::NONE;
 		}
 
 		void Destroy()
@@ -359,6 +551,102 @@ namespace lwpp
       return Evaluate(fpx, fpy, 0.0, 0.0, fractime, LWCAMEYE_CENTER, &camRay);
 		}
 
+		//! Convert an image position in pixels to the film position passed to the camera
+		/*!
+		 * The film spans -0.5 to 0.5 horizontally from left to right and vertically from bottom to top.
+		 */
+		static void PixelToFilm(double x, double y, int width, int height, double &fpx, double &fpy)
+		{
+			fpx = x / width - 0.5;
+			fpy = 0.5 - y / height;
+		}
+
+		//! Initialise the camera for a frame before generating rays
+		/*!
+		 * Not thread safe, call it from NewTime() or before starting any threads.
+		 * @param eye The eye used for the analytic fast path
+		 */
+		LWError Prepare(LWFrame frame, LWTime time, LWCameraEye eye = LWCAMEYE_CENTER)
+		{
+			if (!init)
+			{
+				LWError err = Init(LWINIT_RENDER);
+				if (err) return err;
+			}
+			LWError err = NewTime(frame, time);
+			if (err) return err;
+			err = NewFrame();
+			if (err) return err;
+
+			camera.resolution(&fast.width, &fast.height);
+			fast.type = Projection::NONE;
+			if (!camera.hasDOF() && (camera.motionBlur() == LWCAMMB_OFF))
+			{
+				fitProjection(eye);
+			}
+			return 0;
+		}
+
+		//! Returns true if GenerateTile() uses the analytic model instead of evaluating the camera
+		bool isAnalytic() const { return fast.type != Projection::NONE; }
+
+		//! Generate the rays for a tile of pixels
+		/*!
+		 * Prepare() needs to be called first. The tile spans [x0, x1) and [y0, y1).
+		 * @param sampler Functor returning the sub pixel position of each sample, see PixelCentreSampler
+		 */
+		template <class Sampler>
+		void GenerateTile(int x0, int y0, int x1, int y1, int samples, Sampler &sampler, CameraRayBatch &rays,
+											double fractime = 0.0, LWCameraEye eye = LWCAMEYE_CENTER) const
+		{
+			rays.Resize(x0, y0, Max(x1 - x0, 0), Max(y1 - y0, 0), Max(samples, 1));
+			const bool analytic = (fast.type != Projection::NONE) && (eye == fast.eye);
+			size_t n = 0;
+			for (int y = y0; y < y1; ++y)
+			{
+				for (int x = x0; x < x1; ++x)
+				{
+					for (int s = 0; s < rays.samples; ++s, ++n)
+					{
+						double jx, jy;
+						sampler(x, y, s, jx, jy);
+						const double px = x + jx, py = y + jy;
+						rays.px[n] = px;
+						rays.py[n] = py;
+						if (analytic)
+						{
+							double o[3], d[3];
+							predict(px, py, o, d);
+							for (int i = 0; i < 3; ++i)
+							{
+								rays.origin[i][n] = o[i];
+								rays.dir[i][n] = d[i];
+								rays.filter[i][n] = fast.filter[i];
+							}
+							rays.status[n] = fast.status;
+						}
+						else
+						{
+							LWCameraRay ray;
+							evaluateRay(px, py, fractime, eye, ray, rays.status[n]);
+							for (int i = 0; i < 3; ++i)
+							{
+								rays.origin[i][n] = ray.rayPos[i];
+								rays.dir[i][n] = ray.rayDir[i];
+								rays.filter[i][n] = ray.filter[i];
+							}
+						}
+					}
+				}
+			}
+		}
+		//! Generate the rays of a tile with one ray through the centre of each pixel
+		void GenerateTile(int x0, int y0, int x1, int y1, CameraRayBatch &rays) const
+		{
+			PixelCentreSampler sampler;
+			GenerateTile(x0, y0, x1, y1, 1, sampler, rays);
+		}
+
 
 	};
 
@@ -115,6 +115,7 @@ namespace lwpp
 	private:
 		static void Evaluate (LWInstance inst, const LWChannelAccess* ca)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Channel::Evaluate");
 			T* plugin = static_cast<T*>(inst);
 			ChannelAccess lwca(ca);
 			plugin->Evaluate(lwca);
@@ -0,0 +1,146 @@
+/*!
+ * @file
+ * @brief Retained draw lists for custom objects
+ */
+#ifndef LWPP_CUSTOMOBJECT_DRAWLIST_H
+#define LWPP_CUSTOMOBJECT_DRAWLIST_H
+
+#include <lwpp/customobject_access.h>
+#include <lwpp/point3d.h>
+#include <lwpp/vector3d.h>
+#include <string>
+#include <vector>
+
+namespace lwpp
+{
+	//! Records custom object drawing once and replays it on every viewport refresh
+	/*!
+	 * @ingroup Helper
+	 * The recording functions mirror CustomObjAccess. Vertices are stored in one buffer, consecutive connected
+	 * lines are merged into line strips and indexed polygons share their vertices, so replaying needs far fewer
+	 * calls than drawing primitive by primitive.
+	 *
+	 * Each drawing element keeps its bounds. In perspective views elements behind the viewer, and elements that
+	 * appear smaller than lodThreshold (radius over distance), are skipped.
+	 * @code
+	 * if (!drawList.isCurrent(guideVersion))
+	 * {
+	 *   drawList.Begin(guideVersion);
+	 *   drawList.SetColor(1.0f, 0.5f, 0.0f, 1.0f);
+	 *   for (auto &g : guides) drawList.DrawLine(g.from, g.to, LWCSYS_WORLD);
+	 *   drawList.End();
+	 * }
+	 * drawList.Draw(coa);
+	 * @endcode
+	 */
+	class CustomObjDrawList
+	{
+	public:
+		CustomObjDrawList();
+
+		//! Check if the list was recorded for a version of the drawn data
+		bool isCurrent(unsigned long long version) const { return m_recorded && (version == m_version); }
+		//! Clear the list and start recording for a version
+		void Begin(unsigned long long version);
+		//! Finish recording
+		void End();
+		void Clear();
+
+		/*!
+		 * @name State
+		 */
+		//@{
+		void SetColor(const float rgba[4]);
+		void SetColor(float r, float g, float b, float a);
+		void SetColorCC(const float rgba[4]);
+		void SetPattern(int lpat);
+		void SetThickness(float pointSize, float lineWidth);
+		void SetPart(unsigned int part);
+		void SetDrawMode(unsigned int mode);
+		//@}
+
+		/*!
+		 * @name Primitives
+		 */
+		//@{
+		void DrawPoint(const double pos[3], int csys);
+		//! Lines that continue the previous line are appended to its strip
+		void DrawLine(const double from[3], const double to[3], int csys);
+		void LineStrip(unsigned int numv, const double p[][3], int csys);
+		void LineLoop(unsigned int numv, const double p[][3], int csys);
+		void DrawTriangle(const double v1[3], const double v2[3], const double v3[3], int csys);
+		void DrawQuad(const double v1[3], const double v2[3], const double v3[3], const double v4[3], int csys);
+		void DrawPolygon(unsigned int numv, const double v[][3], int csys);
+		//! Add a vertex for DrawPolygonIndexed(), returns its index
+		unsigned int AddVertex(const double pos[3]);
+		//! Polygon over vertices added with AddVertex()
+		void DrawPolygonIndexed(unsigned int numv, const unsigned int indices[], int csys);
+		void DrawCircle(const double centre[3], double radius, int csys);
+		void DrawDisk(const double centre[3], double radius, int csys);
+		void DrawText(const double pos[3], const std::string &text, int just, int csys);
+		//@}
+
+		//! Replay the list, culling world space elements against the view of the access
+		void Draw(CustomObjAccess &access);
+		//! Replay the list, culling world and object space elements against a view given in their coordinates
+		void Draw(CustomObjAccess &access, const Point3d &viewPos, const Vector3d &viewDir);
+
+		//! Elements with a bounding radius smaller than this fraction of their distance are skipped, 0 to draw all
+		double lodThreshold;
+		//! Maximum number of vertices of a merged line strip, smaller strips cull more precisely
+		unsigned int maxStripLength;
+
+		size_t ElementCount() const { return m_commands.size(); }
+		//! Number of elements drawn by the last Draw()
+		size_t DrawnCount() const { return m_drawn; }
+		size_t MemorySize() const;
+
+	private:
+		enum CommandType
+		{
+			CMD_COLOR,
+			CMD_COLOR_CC,
+			CMD_PATTERN,
+			CMD_THICKNESS,
+			CMD_PART,
+			CMD_DRAWMODE,
+			CMD_POINT,
+			CMD_LINES,		//!< Strip of merged lines
+			CMD_STRIP,
+			CMD_LOOP,
+			CMD_TRIANGLE,
+			CMD_QUAD,
+			CMD_POLYGON,	//!< Indexed polygon
+			CMD_CIRCLE,
+			CMD_DISK,
+			CMD_TEXT
+		};
+		struct Command
+		{
+			unsigned char type;
+			int csys;
+			unsigned int first;	//!< First vertex, index or float, depending on the type
+			unsigned int count;
+			int value;					//!< Pattern, part, draw mode, text justification or string
+			float min[3];
+			float max[3];
+		};
+
+		Command &add(CommandType type, int csys, unsigned int first, unsigned int count, int value = 0);
+		unsigned int addVertices(unsigned int numv, const double p[][3]);
+		void grow(Command &cmd, const double p[3], double radius = 0.0);
+		void draw(CustomObjAccess &access, const Point3d *viewPos, const Vector3d *viewDir, bool cullObject);
+
+		std::vector<Command> m_commands;
+		std::vector<double> m_vertices;				//!< Recorded vertices, 3 per vertex
+		std::vector<double> m_indexedVertices;	//!< Vertices added with AddVertex()
+		std::vector<unsigned int> m_indices;
+		std::vector<float> m_floats;
+		std::vector<std::string> m_text;
+		unsigned long long m_version;
+		size_t m_drawn;
+		bool m_recorded;
+	};
+} // end namespace lwpp
+
+#endif // LWPP_CUSTOMOBJECT_DRAWLIST_H
@@ -5,6 +5,7 @@
 #include <lwpp/platform.h>
 #include <cassert>
 #include <fstream>
+#include <lwpp/logger.h>
 
 #if (_WIN32 && _DEBUG)
 #define S1(x) #x
@@ -20,7 +21,20 @@
 namespace lwpp
 {
 #ifdef _DEBUG
-	#ifdef _DEBUGTOFILE
+	#ifndef LWPP_SYNC_DEBUG_LOG
+		//! Debug output stream, complete lines are passed on to the asynchronous Logger
+		/*!
+		 * Define LWPP_SYNC_DEBUG_LOG to get the old synchronous streams back.
+		 */
+		class dostream : public LogStream
+		{
+			public:
+				dostream() : LogStream(LOG_DEBUG, "dout")
+				{
+					;
+				}
+		};
+	#elif defined(_DEBUGTOFILE)
 		class dostream : public std::ofstream
 		{
 			public:
@@ -109,7 +123,7 @@ namespace lwpp
 		typedef basic_dostream<char> dostream;
 
 		#endif // _MSWIN
-	#endif // _DEBUGTOFILE
+	#endif // LWPP_SYNC_DEBUG_LOG
 	
 #endif // _DEBUG
 }
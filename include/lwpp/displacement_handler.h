@@ -141,6 +141,7 @@ class DisplacementAdaptor : public InstanceAdaptor <T>, public ItemAdaptor <T>,
 
 		static void Evaluate (LWInstance instance, LWDisplacementAccess *da)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Displacement::Evaluate");
 			try
 			{
 				T *plugin = (T *) instance;
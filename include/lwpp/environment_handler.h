@@ -58,6 +58,7 @@ namespace lwpp
 	private:
 		static LWError Evaluate (LWInstance inst, LWEnvironmentAccess* ma)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Environment::Evaluate");
 			T* plugin = static_cast<T*>(inst);
 			plugin->Evaluate(ma);
 			return NULL;
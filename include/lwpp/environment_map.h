@@ -0,0 +1,133 @@
+/*!
+ * @file
+ * @brief Baked latitude-longitude environment map with importance sampling
+ */
+#ifndef LWPP_ENVIRONMENT_MAP_H
+#define LWPP_ENVIRONMENT_MAP_H
+
+#include <lwpp/vector3d.h>
+#include <lwpp/threads.h>
+#include <lwimage.h>
+#include <vector>
+
+namespace lwpp
+{
+	//! An environment baked into a latitude-longitude map for fast lookups and importance sampling
+	/*!
+	 * @ingroup Helper
+	 * The map is baked from an image or from any function of the direction, typically in NewTime().
+	 * Baking builds a box filtered mip pyramid for filtered lookups, and the distribution tables for
+	 * sampling directions in proportion to their luminance.
+	 * After Build() all lookup and sampling functions are const and may be called from any number of threads,
+	 * so one map can be shared between an environment, a light and shaders.
+	 *
+	 * The map covers the sphere with u = 0.5 + atan2(x, z) / 2PI from left to right and
+	 * v = acos(y) / PI from the top (+Y) to the bottom, which matches LightWave's spherical image maps.
+	 * @code
+	 * envMap.Build(1024, 512, [&](const lwpp::Vector3d &dir, double rgb[3]) { sky.evaluate(dir, rgb); });
+	 * ...
+	 * lwpp::Vector3d dir;
+	 * double rgb[3], pdf;
+	 * if (envMap.Sample(u1, u2, dir, rgb, pdf)) { ... }
+	 * @endcode
+	 */
+	class EnvironmentMap
+	{
+	public:
+		EnvironmentMap();
+
+		//! Bake the map by evaluating func(const Vector3d &dir, double rgb[3]) at the centre of every texel
+		/*!
+		 * The function is called from several threads at once.
+		 */
+		template <typename F>
+		void Build(int width, int height, F func)
+		{
+			allocate(width, height);
+			std::vector<float> &texels = m_levels[0].rgb;
+			const int w = m_width;
+			ParallelFor(0, m_height, 4, [&](size_t b, size_t e, unsigned int)
+			{
+				for (int y = static_cast<int>(b); y < static_cast<int>(e); ++y)
+				{
+					for (int x = 0; x < w; ++x)
+					{
+						double rgb[3] = { 0.0, 0.0, 0.0 };
+						func(TexelDirection(x, y), rgb);
+						float *t = &texels[3 * (static_cast<size_t>(y) * w + x)];
+						t[0] = static_cast<float>(rgb[0]);
+						t[1] = static_cast<float>(rgb[1]);
+						t[2] = static_cast<float>(rgb[2]);
+					}
+				}
+			});
+			finalise();
+		}
+		//! Bake the map from a latitude-longitude image
+		/*!
+		 * @param width Width of the map, 0 for the width of the image. The height is half the width.
+		 * @return false if the image is invalid
+		 */
+		bool Build(LWImageID image, int width = 0);
+		void Clear();
+		bool isValid() const { return !m_levels.empty(); }
+
+		int getWidth() const { return m_width; }
+		int getHeight() const { return m_height; }
+		//! Average radiance over the sphere, useful to weight the map against other lights
+		double Power() const { return m_power; }
+
+		//! Direction through the centre of a texel
+		Vector3d TexelDirection(int x, int y) const;
+		//! Map a direction to map coordinates in [0, 1]
+		static void DirectionToUV(const Vector3d &dir, double &u, double &v);
+		static Vector3d UVToDirection(double u, double v);
+
+		//! Bilinear lookup in the finest level
+		void Lookup(const Vector3d &dir, double rgb[3]) const;
+		//! Filtered lookup
+		/*!
+		 * @param solidAngle Solid angle covered by the lookup, for example the spread of a glossy reflection
+		 */
+		void Lookup(const Vector3d &dir, double solidAngle, double rgb[3]) const;
+
+		//! Choose a direction in proportion to the luminance of the map
+		/*!
+		 * @param u1, u2 Uniform random numbers in [0, 1)
+		 * @param rgb The radiance from the direction
+		 * @param pdf Probability density with respect to solid angle
+		 * @return false if the map is black
+		 */
+		bool Sample(double u1, double u2, Vector3d &dir, double rgb[3], double &pdf) const;
+		//! Density of Sample() choosing a direction, for multiple importance sampling
+		double Pdf(const Vector3d &dir) const;
+
+	private:
+		struct Level
+		{
+			int width;
+			int height;
+			std::vector<float> rgb;
+		};
+
+		EnvironmentMap(const EnvironmentMap &);
+		EnvironmentMap &operator=(const EnvironmentMap &);
+
+		void allocate(int width, int height);
+		//! Build the mip pyramid and the sampling tables from level 0
+		void finalise();
+		void bilinear(const Level &level, double u, double v, double rgb[3]) const;
+		static size_t sampleCdf(const float *cdf, size_t n, double u, double &offset);
+
+		int m_width;
+		int m_height;
+		std::vector<Level> m_levels;
+		std::vector<float> m_conditional;	//!< Cumulative distribution of each row, width + 1 entries per row
+		std::vector<float> m_rowIntegral;	//!< Sum over each row
+		std::vector<float> m_marginal;		//!< Cumulative distribution of the rows, height + 1 entries
+		double m_integral;								//!< Sum of the sampling function over all texels
+		double m_power;
+	};
+} // end namespace lwpp
+
+#endif // LWPP_ENVIRONMENT_MAP_H
@@ -5,6 +5,10 @@
 #include <lwpp/storeable.h>
 #include <lwpp/message.h>
 #include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #ifndef LWFTYPE_INSTALL
 #define LWFTYPE_INSTALL					"Install" // installation directory, not defined by LW
@@ -58,20 +62,93 @@ class DirInfo	: protected GlobalBase<LWDirInfoFunc>
 		const char *stripPath(const char *fileName);
 	};
 
+	//! Entry of a directory listing
+	struct DirectoryEntry
+	{
+		std::string name;	//!< Name of the entry without the path
+		std::string path;	//!< Full path of the entry
+		bool directory;
+		size_t size;
+		time_t mtime;			//!< Time of the last modification
+	};
+	typedef std::vector<DirectoryEntry> DirectoryListing;
+
 	// Directory scanning
 	class Directory
 	{
 		DIR *directory;
 		struct dirent *entry;
+		std::string path;
 		public:
 			Directory(const std::string name);
 			~Directory();
 			bool exists();
 			const char *getEntry(void);
+			//! Read the next entry including its type, size and modification time
+			/*!
+			 * On Windows all of them come with the directory listing, elsewhere the type is taken from d_type where
+			 * the file system provides it and a single stat is done for the size and time.
+			 * @param withStat Set to false if only the name and type are needed, size and mtime will be 0
+			 */
+			bool getEntry(DirectoryEntry &info, bool withStat = true);
 	};
 
 	bool isDirectory(const std::string name);
 
+	//! Read all entries of a directory, sorted by name
+	/*!
+	 * @param hidden Include entries starting with a dot
+	 * @return false if the directory can't be opened
+	 */
+	bool ListDirectory(const std::string &path, DirectoryListing &entries, bool hidden = false);
+
+	//! Match a file name against a wildcard pattern with *, ? and [] character sets
+	/*!
+	 * Several patterns may be separated by ; as in "*.cube;*.3dl". Matching ignores case on Windows.
+	 */
+	bool MatchGlob(const char *pattern, const char *name);
+
+	//! Find all files below a directory matching a pattern
+	/*!
+	 * Directories are read in parallel level by level, the result is ordered by directory and name, just as a
+	 * serial depth first walk would return it.
+	 * @param pattern Wildcard pattern for the files, empty for all files. Directories are not returned.
+	 * @param numThreads Number of threads to use, 0 for ParallelThreadCount()
+	 */
+	void WalkDirectory(const std::string &path, DirectoryListing &files, const std::string &pattern = "", bool recursive = true, unsigned int numThreads = 0);
+
+	//! Cache of directory listings for browsers that read the same directories repeatedly
+	/*!
+	 * @ingroup Helper
+	 * A cached listing is used as long as the modification time of the directory is unchanged, so checking a
+	 * directory costs a single stat instead of reading it again. Time stamps only have a resolution of a second,
+	 * directories modified during the second they were read are read again the next time.
+	 *
+	 * Modifying a file in place doesn't change its directory, call Invalidate() after writing to a listed directory.
+	 * All functions are thread safe.
+	 */
+	class DirectoryCache
+	{
+	public:
+		typedef std::shared_ptr<const DirectoryListing> Listing;
+		//! Return the listing of a directory, or an empty pointer if it can't be read
+		Listing Get(const std::string &path);
+		//! As WalkDirectory(), using and filling the cache
+		void Walk(const std::string &path, DirectoryListing &files, const std::string &pattern = "", bool recursive = true, unsigned int numThreads = 0);
+		void Invalidate(const std::string &path);
+		void Clear();
+		size_t size();
+	private:
+		struct Cached
+		{
+			time_t mtime;
+			time_t read;
+			Listing listing;
+		};
+		std::mutex m_lock;
+		std::map<std::string, Cached> m_cache;
+	};
+
 	void makeAllDirectories(const char *path);
 
 	class FileType	: protected GlobalBase<LWFileTypeFunc>
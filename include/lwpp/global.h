@@ -7,6 +7,8 @@
 #include <lwpp/lw_server.h>
 #include <lwpp/exception.h>
 #include <lwhost.h>
+#include <atomic>
+#include <mutex>
 
 #ifndef NULL
 #define NULL 0
@@ -21,14 +23,16 @@
 
 #define IMPLEMENT_GLOBAL(base, name) \
 template<> base * GlobalBase< base >::globPtr = nullptr; \
-template<> size_t	GlobalBase< base >::usage_count = 0; \
+template<> std::atomic<size_t>	GlobalBase< base >::usage_count(0); \
+template<> std::atomic<int>	GlobalBase< base >::m_state(0); \
 template<> const char * GlobalBase< base >::m_globalName = name;
 
 // llvm needs this (and apparently it is a C++ requirement) but VC stumbles over it
 #ifdef __llvm__
 #define DEFINE_GLOBAL(base) \
 template<> base * GlobalBase< base >::globPtr; \
-template<> size_t	GlobalBase< base >::usage_count; \
+template<> std::atomic<size_t>	GlobalBase< base >::usage_count; \
+template<> std::atomic<int>	GlobalBase< base >::m_state; \
 template<> const char * GlobalBase< base >::m_globalName;
 #else
 #define DEFINE_GLOBAL(base)
@@ -154,58 +158,109 @@ namespace lwpp
 	 */
 	void SetSuperGlobal(GlobalFunc* g);
 
+	//! Keeps track of all globals acquired by GlobalBase
+	/*!
+	 * Each global is acquired once per plugin module and released when the module is unloaded.
+	 */
+	class GlobalRegistry
+	{
+	public:
+		typedef void ReleaseFunc(void);
+		//! Serialises acquiring and releasing globals
+		static std::mutex &Lock();
+		//! Register a function that releases a global, called with Lock() held
+		static void Register(ReleaseFunc *release);
+		//! Release all acquired globals, called when the module is unloaded
+		static void ReleaseAll();
+	};
+
 	//! Template class base for any kind of global that will be AQUIREd/RELEASEd,
+	/*!
+	 * The global is resolved by the first instance and kept until the plugin module is unloaded,
+	 * after that constructing an instance does not call LightWave and is safe on any thread.
+	 * Call Resolve() from the main thread, i.e. in Activate() or the constructor of the handler,
+	 * if instances are going to be created on render threads first.
+	 */
 	template<class G>
 	class GlobalBase
 	{
 	private:
+		enum { GLOBAL_UNRESOLVED = 0, GLOBAL_RESOLVED };
 		static const char* m_globalName; //!< Name of the global, should probably be static too
-		static size_t	usage_count; //!< Usage count for the global
-		bool _acquireGlobal()
+		static std::atomic<size_t>	usage_count; //!< Usage count for the global
+		static std::atomic<int> m_state; //!< GLOBAL_RESOLVED once the global has been acquired or found to be missing
+
+		//! Called with GlobalRegistry::Lock() held
+		static void _acquireGlobal()
 		{
 #ifdef _DEBUG
 			//dout << "Acquire: " << m_globalName << "\n";
 #endif 
 			globPtr = reinterpret_cast<G*> (SuperGlobal(m_globalName, GFUSE_ACQUIRE));
-			return (globPtr != nullptr);
+			if (globPtr) GlobalRegistry::Register(&_releaseGlobal);
+		}
+		//! Called by the GlobalRegistry with its lock held
+		static void _releaseGlobal()
+		{
+#ifdef _DEBUG
+			//dout << "Release: " << m_globalName << "\n";
+#endif 
+			if (globPtr && SuperGlobal) SuperGlobal(m_globalName, GFUSE_RELEASE); // release global
+			globPtr = nullptr;
+			m_state.store(GLOBAL_UNRESOLVED, std::memory_order_release);
 		}
 	protected:
-		static G* globPtr; //!< Pointer to the global functions
+		static G* globPtr; //!< Pointer to the global functions, written only while GlobalRegistry::Lock() is held
+		//! Release and acquire the global again
 		void updateGlobal()
 		{
-			if (usage_count > 0)
+			std::lock_guard<std::mutex> guard(GlobalRegistry::Lock());
+			if (!SuperGlobal) return;
+			if (globPtr)
 			{
 				SuperGlobal(m_globalName, GFUSE_RELEASE);
 				globPtr = reinterpret_cast<G*> (SuperGlobal(m_globalName, GFUSE_ACQUIRE));
 			}
-			else if	(_acquireGlobal())
-				usage_count++;
+			else
+			{
+				_acquireGlobal();
+			}
+			m_state.store(GLOBAL_RESOLVED, std::memory_order_release);
 		}
 	public:
-		//! Constructor, acquire the global and increase the usage counter
-		GlobalBase()
+		//! Acquire the global unless this already happened
+		/*!
+		 * @return true if the global is available
+		 */
+		static bool Resolve()
 		{
-			if (usage_count == 0)
+			if (m_state.load(std::memory_order_acquire) != GLOBAL_RESOLVED)
 			{
-				if (!_acquireGlobal())
+				std::lock_guard<std::mutex> guard(GlobalRegistry::Lock());
+				// a missing SuperGlobal is not cached, the global may be requested again once it is set
+				if ((m_state.load(std::memory_order_relaxed) != GLOBAL_RESOLVED) && SuperGlobal)
 				{
-					//throw MissingGlobal(name);
-					return;
+					_acquireGlobal();
+					m_state.store(GLOBAL_RESOLVED, std::memory_order_release);
 				}
 			}
-			usage_count++;
+			return (globPtr != nullptr);
 		}
-		//! Destructor, RELEASE the global if usage counter drops to 0
+		//! Constructor, acquire the global and increase the usage counter
+		GlobalBase()
+		{
+			Resolve();
+			usage_count.fetch_add(1, std::memory_order_relaxed);
+		}
+		//! Destructor, decrease the usage counter. The global is released when the plugin module is unloaded.
 		virtual ~GlobalBase()
 		{
-			usage_count--;
-			if (usage_count == 0)
-			{
-#ifdef _DEBUG
-				//dout << "Release: " << m_globalName << "\n";
-#endif 
-				SuperGlobal(m_globalName, GFUSE_RELEASE); // release global
-			}
+			usage_count.fetch_sub(1, std::memory_order_relaxed);
+		}
+		//! Number of live instances
+		static size_t UsageCount()
+		{
+			return usage_count.load(std::memory_order_relaxed);
 		}
 
 		//! Check if the global is available
@@ -191,6 +191,11 @@ namespace lwpp
 
 		//! Wrapper for LWImageList
 	//! @ingroup Globals
+	/*!
+	 * An Image tells LightWave which image it uses through the saver notification. It registers for it once it
+	 * holds an image, through the constructor, SetID(), load(), Load(), a pop-up or an assignment, and copies of a
+	 * registered Image register as well. An empty Image doesn't call the host.
+	 */
 	class Image : public PopUpCallback, public Storeable, protected GlobalBase<LWImageList>
 	{
 	private:
@@ -200,6 +205,7 @@ namespace lwpp
 			bool keepAspect : 1;
 			bool checkered : 1;
 		} mFlags{ true, true };
+		bool mSaverAttached = false;
 	public:
 		virtual const char *popName(int n);
 
@@ -207,21 +213,29 @@ namespace lwpp
 
 		Image(LWImageID _id = nullptr) : id(_id)
 		{
-			updateGlobal();
-			globPtr->saverNotifyAttach(this, ImageSaverCB);
+			if (id) NotifySaver();
 		}
 
 		Image(const Image &from)
 		{
 			id = from.id;
 			mFlags = from.mFlags;
-			updateGlobal();
-			globPtr->saverNotifyAttach(this, ImageSaverCB);
+			if (from.mSaverAttached) NotifySaver();
 		}
 
 		virtual ~Image()
 		{
-			globPtr->saverNotifyDetach(this);
+			if (mSaverAttached && available()) globPtr->saverNotifyDetach(this);
+		}
+
+		//! Report the image of this instance to LightWave when scenes are saved
+		void NotifySaver()
+		{
+			if (!mSaverAttached && available())
+			{
+				globPtr->saverNotifyAttach(this, ImageSaverCB);
+				mSaverAttached = true;
+			}
 		}
 
 		LWImageID saverNotify() const { return id; }
@@ -239,13 +253,18 @@ namespace lwpp
 			{
 				id = from.id;
 				mFlags = from.mFlags;
+				NotifySaver();
 			}
 			return *this;
 		}
 		//! Use the image aspect ratio when drawing a xpanel preview. Fit to view otherwise 
 		void PreviewKeepAspect(const bool keep = true) { mFlags.keepAspect = keep; }
 		void CheckeredBackground(const bool on = true) { mFlags.checkered = on; }
-		void SetID(LWImageID _id) {id = _id;}
+		void SetID(LWImageID _id)
+		{
+			id = _id;
+			NotifySaver();
+		}
 		LWImageID getID() const {return id;}
 		//! Get the value returned from a pop-up 
 		void GetPopUp(int i);
@@ -256,7 +275,11 @@ namespace lwpp
 		void first(void) {id = globPtr->first();}
 		void next(void) {id = globPtr->next(id);}
 		void clear(void) {globPtr->clear(id);}
-		void load(const char *filename) {id = globPtr->load(filename);}
+		void load(const char *filename)
+		{
+			id = globPtr->load(filename);
+			NotifySaver();
+		}
 		void load(const std::string filename) { load(filename.c_str()); }
 		const char *name() const {
 			static const char none[] = "(none)";
@@ -390,6 +413,7 @@ namespace lwpp
 		{
 			LWError err = 0;
 			id = globPtr->sceneLoad(ls.getState());
+			NotifySaver();
 			if (id == 0) err = "Could not load image";
 			return err;
 		}
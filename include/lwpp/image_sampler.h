@@ -0,0 +1,119 @@
+/*!
+ * @file
+ * @brief Plugin side image sampling with a mip-map pyramid and a tile cache
+ */
+#ifndef LWPP_IMAGE_SAMPLER_H
+#define LWPP_IMAGE_SAMPLER_H
+
+#include <lwpp/image.h>
+#include <lwtxtr.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace lwpp
+{
+	//! Filters supported by the ImageSampler
+	enum SamplerFilter
+	{
+		SAMPLE_NEAREST,	//!< Nearest texel of the finest level
+		SAMPLE_BILINEAR,	//!< Bilinear filtering on the finest level
+		SAMPLE_TRILINEAR,	//!< Bilinear filtering between two mip levels
+		SAMPLE_EWA				//!< Elliptical weighted average, anisotropic
+	};
+
+	//! Samples a LightWave image without calling into the host for every lookup
+	/*!
+	 * @ingroup Helper
+	 * The image is split into square tiles of RGBA floats. Tiles of the finest level are
+	 * read from the host when they are first touched, coarser mip levels are averaged from
+	 * the level below, also on demand. Tiles are published without locks, so all Sample()
+	 * functions may be called concurrently from any number of render threads once Build() returned.
+	 *
+	 * Texture coordinates follow the LightWave convention, u runs left to right and v
+	 * runs from the bottom to the top of the image.
+	 *
+	 * Typically Build() is called from NewTime() or Init() and Clear() from Cleanup().
+	 */
+	class ImageSampler
+	{
+	public:
+		static const int TileSize = 64;
+		static const int TileShift = 6;
+
+		ImageSampler();
+		~ImageSampler();
+
+		//! Prepare sampling of an image, discards all cached tiles
+		/*!
+		 * @return false if the image is invalid
+		 */
+		bool Build(LWImageID id);
+		//! Release all cached tiles
+		void Clear();
+		bool isValid() const { return !m_levels.empty(); }
+
+		int getWidth() const { return m_width; }
+		int getHeight() const { return m_height; }
+		int getLevels() const { return static_cast<int>(m_levels.size()); }
+		//! Memory currently used by cached tiles in bytes
+		size_t MemorySize() const { return m_memory.load(std::memory_order_relaxed); }
+
+		//! Fetch a single texel of a mip level, with wrapping applied
+		void Texel(int level, int x, int y, LWTextureWrap uWrap, LWTextureWrap vWrap, float rgba[4]) const;
+
+		//! Sample the image with the given screen space derivatives of u and v
+		/*!
+		 * @return the alpha value, the colour is returned in rgba[0..2]
+		 */
+		double Sample(double u, double v,
+									double dudx, double dvdx, double dudy, double dvdy,
+									SamplerFilter filter, LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const;
+		//! Sample without filter footprint
+		double Sample(double u, double v, SamplerFilter filter, LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const
+		{
+			return Sample(u, v, 0.0, 0.0, 0.0, 0.0, filter, uWrap, vWrap, rgba);
+		}
+		//! Drop in replacement for Image::evaluate()
+		double evaluate(const LWNodalProjection &proj, SamplerFilter filter, LWTextureWrap uWrap, LWTextureWrap vWrap, LWDVector colour) const
+		{
+			double rgba[4];
+			Sample(proj.u, proj.v, proj.dudx, proj.dvdx, proj.dudy, proj.dvdy, filter, uWrap, vWrap, rgba);
+			colour[0] = rgba[0];
+			colour[1] = rgba[1];
+			colour[2] = rgba[2];
+			return rgba[3];
+		}
+		//! Bump gradient computed from cached samples, see Image::evaluateBumpGradient()
+		Vector3d evaluateBumpGradient(LWNodalProjection proj, SamplerFilter filter, double bumpStrength,
+																	LWTextureWrap uWrap, LWTextureWrap vWrap) const;
+
+	private:
+		struct Level
+		{
+			int width;
+			int height;
+			int tilesX;
+			int tilesY;
+			std::unique_ptr<std::atomic<float *>[]> tiles;
+		};
+
+		ImageSampler(const ImageSampler &);
+		ImageSampler &operator=(const ImageSampler &);
+
+		const float *tile(int level, int tx, int ty) const;
+		void fillTile(int level, int tx, int ty, float *data) const;
+		void bilinear(int level, double x, double y, LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const;
+		void ewa(int level, double x, double y, double ax, double ay, double bx, double by,
+						 LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const;
+
+		Image m_image;
+		bool m_hasAlpha;
+		int m_width;
+		int m_height;
+		std::vector<Level> m_levels;
+		mutable std::atomic<size_t> m_memory;
+	};
+} // end namespace lwpp
+
+#endif // LWPP_IMAGE_SAMPLER_H
@@ -232,6 +232,7 @@ protected:
 		private:
 		static LWError Process (LWInstance instance, const LWFilterAccess *fa)
 		{
+			LWPP_PROFILE_CALLBACK(T, "ImageFilter::Process");
 			try
 			{
 				T *plugin = (T *) instance;
@@ -6,7 +6,15 @@
 #include <lwpp/lw_server.h>
 #include <lwpp/monitor.h>
 #include <lwpp/message.h>
+#include <lwpp/threads.h>
+#include <lwpp/math.h>
+#include <lwpp/mapped_file.h>
 #include <sstream>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
  
 namespace lwpp
 {
@@ -229,6 +237,235 @@ namespace lwpp
 			}
 	};
 	
+	//! Size of a pixel of an image type in bytes, 0 for unknown types
+	inline size_t BytesPerPixel(LWImageType type)
+	{
+		switch (type)
+		{
+			case LWIMTYP_GREY8:
+			case LWIMTYP_INDEX8:	return 1;
+			case LWIMTYP_RGB24:		return 3;
+			case LWIMTYP_RGBA32:	return 4;
+			case LWIMTYP_GREYFP:	return sizeof(float);
+			case LWIMTYP_RGBFP:		return 3 * sizeof(float);
+			case LWIMTYP_RGBAFP:	return 4 * sizeof(float);
+			default:							return 0;
+		}
+	}
+
+	//! Layout of an image decoded by a ParallelImageLoaderHandler
+	struct ImageStripLayout
+	{
+		int width;
+		int height;
+		LWImageType type;
+		int linesPerStrip;	//!< Number of scanlines decoded by one call of DecodeStrip(), the last strip may be shorter
+		ImageStripLayout() : width(0), height(0), type(LWIMTYP_RGBAFP), linesPerStrip(16) {}
+	};
+
+	//! Image loader that decodes strips of scanlines on several threads
+	/*!
+	 * @ingroup Handler
+	 * Derive from this instead of ImageLoaderHandler and implement Open() and DecodeStrip().
+	 * The strips are decoded in parallel into a reorder buffer, the calling thread then passes the scanlines to
+	 * LightWave in order as soon as they are complete and reports the progress to the monitor.
+	 * The number of strips in flight is limited to twice the number of threads, so the memory use does not depend
+	 * on the size of the image.
+	 *
+	 * DecodeStrip() is called from several threads at once and must not call into LightWave.
+	 * Strips may be of any size, for tiled formats use one row of tiles per strip.
+	 */
+	class ParallelImageLoaderHandler : public ImageLoaderHandler
+	{
+		ImageStripLayout layout;
+		size_t stride = 0;
+		int numStrips = 0;
+		int window = 0;
+		std::vector<std::vector<unsigned char> > slots;
+		std::vector<int> slotStrip;		//!< Strip decoded into each slot, -1 if none
+		std::atomic<int> nextStrip;
+		std::atomic<unsigned int> nextWorker;
+		std::atomic<bool> failed;
+		int sentStrips = 0;
+		std::mutex lock;
+		std::condition_variable stripDone;
+		std::condition_variable slotFree;
+
+		int stripLines(int strip) const
+		{
+			return std::min(layout.linesPerStrip, layout.height - strip * layout.linesPerStrip);
+		}
+		bool decode(int strip, unsigned int worker)
+		{
+			unsigned char *pixels = &slots[strip % window][0];
+			return DecodeStrip(strip, strip * layout.linesPerStrip, stripLines(strip), pixels, stride, worker);
+		}
+		void workerRun(unsigned int worker)
+		{
+			for (;;)
+			{
+				const int strip = nextStrip.fetch_add(1);
+				if (strip >= numStrips) return;
+				{
+					// wait for the slot of the strip to be sent
+					std::unique_lock<std::mutex> guard(lock);
+					slotFree.wait(guard, [&] { return failed || (strip < sentStrips + window); });
+					if (failed) return;
+				}
+				const bool ok = decode(strip, worker);
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (ok) slotStrip[strip % window] = strip;
+					else failed = true;
+				}
+				stripDone.notify_all();
+			}
+		}
+		static int workerFunc(void *arg)
+		{
+			ParallelImageLoaderHandler *loader = static_cast<ParallelImageLoaderHandler *>(arg);
+			loader->workerRun(loader->nextWorker.fetch_add(1));
+			return 0;
+		}
+		//! Send a decoded strip, returns false if the user aborted
+		bool send(int strip)
+		{
+			const unsigned char *pixels = &slots[strip % window][0];
+			const int first = strip * layout.linesPerStrip;
+			const int lines = stripLines(strip);
+			for (int i = 0; i < lines; ++i)
+			{
+				SendLine(first + i, (const LWPixelID)(pixels + i * stride));
+			}
+			return !monitor.StepAborted(lines);
+		}
+		int decodeAndSend(unsigned int numThreads)
+		{
+			numStrips = (layout.height + layout.linesPerStrip - 1) / layout.linesPerStrip;
+			numThreads = std::min(numThreads, static_cast<unsigned int>(numStrips));
+			window = (numThreads > 1) ? static_cast<int>(2 * numThreads) : 1;
+			slots.assign(window, std::vector<unsigned char>(stride * layout.linesPerStrip));
+			slotStrip.assign(window, -1);
+			nextStrip = 0;
+			nextWorker = 0;
+			failed = false;
+			sentStrips = 0;
+			monitor.Init(layout.height);
+
+			ThreadGroup *group = nullptr;
+			if (numThreads > 1)
+			{
+				group = new ThreadGroup(static_cast<int>(numThreads));
+				for (unsigned int i = 0; i < numThreads; ++i)
+				{
+					group->addThread(workerFunc, 0, this);
+				}
+				if ((group->getThreadCount() != static_cast<int>(numThreads)) || !group->begin())
+				{
+					delete group;
+					group = nullptr;
+				}
+			}
+
+			bool aborted = false;
+			for (int strip = 0; strip < numStrips; ++strip)
+			{
+				if (group)
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					stripDone.wait(guard, [&] { return failed || (slotStrip[strip % window] == strip); });
+					if (failed) break;
+				}
+				else if (!decode(strip, 0))
+				{
+					failed = true;
+					break;
+				}
+				aborted = !send(strip);
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					slotStrip[strip % window] = -1;
+					sentStrips = strip + 1;
+					if (aborted) failed = true;
+				}
+				slotFree.notify_all();
+				if (aborted) break;
+			}
+			if (group)
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (sentStrips < numStrips) failed = true;
+				}
+				slotFree.notify_all();
+				group->sync();
+				delete group;
+			}
+			monitor.Done();
+			slots.clear();
+			if (aborted) return IPSTAT_ABORT;
+			return failed ? IPSTAT_BADFILE : IPSTAT_OK;
+		}
+	protected:
+		//! Open the file and describe the image
+		/*!
+		 * @return IPSTAT_OK, or IPSTAT_NOREC if the file is not in the format of the loader
+		 */
+		virtual int Open(const char *filename, ImageStripLayout &layout) = 0;
+		//! Decode a strip of scanlines, called from worker threads
+		/*!
+		 * @param pixels Storage for the scanlines in the pixel format of the layout type
+		 * @param stride Bytes per scanline
+		 * @param worker Index of the calling thread, smaller than the number of threads, use it for per thread decoders
+		 * @return false if the data can not be decoded
+		 */
+		virtual bool DecodeStrip(int strip, int firstLine, int numLines, unsigned char *pixels, size_t stride, unsigned int worker) = 0;
+		//! Called after the image has been started, use it to set image parameters with SetParam()
+		virtual void SetParams() {}
+		//! Called once decoding is complete
+		virtual void Close() {}
+		//! Number of threads to decode with, 0 for ParallelThreadCount()
+		unsigned int maxThreads = 0;
+	public:
+		ParallelImageLoaderHandler()
+			: nextStrip(0), nextWorker(0), failed(false)
+		{
+			;
+		}
+		virtual int LoadImage(const char *filename)
+		{
+			layout = ImageStripLayout();
+			int rc = Open(filename, layout);
+			if (rc != IPSTAT_OK)
+			{
+				SetRC(rc);
+				return AFUNC_OK;
+			}
+			const size_t bpp = BytesPerPixel(layout.type);
+			if ((layout.width <= 0) || (layout.height <= 0) || (bpp == 0))
+			{
+				Close();
+				SetRC(IPSTAT_BADFILE);
+				return AFUNC_OK;
+			}
+			layout.linesPerStrip = Clamp(layout.linesPerStrip, 1, layout.height);
+			stride = bpp * layout.width;
+			if (!Begin(layout.type))
+			{
+				Close();
+				SetRC(IPSTAT_FAILED);
+				return AFUNC_OK;
+			}
+			SetSize(layout.width, layout.height);
+			SetParams();
+			rc = decodeAndSend(maxThreads ? maxThreads : ParallelThreadCount());
+			Close();
+			Done(rc);
+			SetRC(rc);
+			return AFUNC_OK;
+		}
+	};
+
 	/*
 	 * Image Saver
 	 */
@@ -447,6 +684,317 @@ namespace lwpp
 
 	};
 
+	//! Image saver that encodes strips of scanlines on several threads
+	/*!
+	 * @ingroup Handler
+	 * Derive from this instead of ImageSaverHandler and implement EncodeStrip() and either WriteStrip() or the
+	 * memory mapped output functions.
+	 * The scanlines passed by LightWave are copied into strips of linesPerStrip lines, each complete strip is
+	 * queued and encoded by worker threads while the following scanlines arrive. The encoded strips are written in
+	 * order, the ones that are ready while lines are being received right away, the remainder in Done().
+	 *
+	 * With mappedOutput set nothing is written until all strips are encoded. Done() then sizes the file from
+	 * MappedHeaderSize() and the strip sizes, maps it, lets WriteMappedHeader() fill in the header (and offset
+	 * table) and copies the strips into the mapping in parallel.
+	 *
+	 * EncodeStrip() is called from several threads at once and must not call into LightWave.
+	 */
+	class ParallelImageSaverHandler : public ImageSaverHandler
+	{
+		struct Strip
+		{
+			std::vector<unsigned char> raw;
+			std::vector<unsigned char> encoded;
+			int received;
+			bool queued;
+			bool ready;
+		};
+		std::vector<Strip> strips;
+		std::deque<int> queue;
+		size_t stride = 0;
+		int inFlight = 0;			//!< Strips queued or being encoded
+		int maxInFlight = 1;
+		int nextWrite = 0;
+		int result = IPSTAT_OK;
+		bool closing = false;
+		bool encodeFailed = false;
+		std::atomic<unsigned int> nextWorker;
+		ThreadGroup *group = nullptr;
+		std::mutex lock;
+		std::condition_variable work;
+		std::condition_variable encoded;
+
+		int stripLines(int strip) const
+		{
+			return std::min(linesPerStrip, height - strip * linesPerStrip);
+		}
+		bool encode(int strip, unsigned int worker)
+		{
+			Strip &s = strips[strip];
+			return EncodeStrip(strip, strip * linesPerStrip, stripLines(strip), &s.raw[0], stride, s.encoded, worker);
+		}
+		//! Mark a strip as encoded and free its raw scanlines, the lock must be held
+		void finishStrip(int strip, bool ok)
+		{
+			Strip &s = strips[strip];
+			std::vector<unsigned char>().swap(s.raw);
+			s.ready = true;
+			if (!ok) encodeFailed = true;
+		}
+		void workerRun(unsigned int worker)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				work.wait(guard, [&] { return closing || !queue.empty(); });
+				if (queue.empty()) return;
+				const int strip = queue.front();
+				queue.pop_front();
+				guard.unlock();
+				const bool ok = encode(strip, worker);
+				guard.lock();
+				finishStrip(strip, ok);
+				--inFlight;
+				encoded.notify_all();
+			}
+		}
+		static int workerFunc(void *arg)
+		{
+			ParallelImageSaverHandler *saver = static_cast<ParallelImageSaverHandler *>(arg);
+			saver->workerRun(saver->nextWorker.fetch_add(1));
+			return 0;
+		}
+		//! Queue a strip for encoding, blocks while too many strips are waiting
+		void submit(int strip)
+		{
+			strips[strip].queued = true;
+			if (!group)
+			{
+				const bool ok = encode(strip, 0);
+				finishStrip(strip, ok);
+				return;
+			}
+			std::unique_lock<std::mutex> guard(lock);
+			encoded.wait(guard, [&] { return inFlight < maxInFlight; });
+			queue.push_back(strip);
+			++inFlight;
+			guard.unlock();
+			work.notify_one();
+		}
+		//! Write the encoded strips that are next in order, the stream output only
+		int flush(bool wait)
+		{
+			while (nextWrite < static_cast<int>(strips.size()))
+			{
+				Strip &s = strips[nextWrite];
+				bool failed = false;
+				if (group)
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					if (wait) encoded.wait(guard, [&] { return s.ready; });
+					if (!s.ready) break;
+					failed = encodeFailed;
+				}
+				else if (!s.ready)
+				{
+					break;
+				}
+				else
+				{
+					failed = encodeFailed;
+				}
+				if (failed) return IPSTAT_FAILED;
+				const int rc = WriteStrip(nextWrite, s.encoded.empty() ? nullptr : &s.encoded[0], s.encoded.size());
+				std::vector<unsigned char>().swap(s.encoded);
+				if (rc != IPSTAT_OK) return rc;
+				++nextWrite;
+			}
+			return IPSTAT_OK;
+		}
+		void stopWorkers()
+		{
+			if (!group) return;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				closing = true;
+			}
+			work.notify_all();
+			group->sync();
+			delete group;
+			group = nullptr;
+		}
+		int writeMapped()
+		{
+			std::vector<size_t> sizes(strips.size());
+			for (size_t i = 0; i < strips.size(); ++i)
+			{
+				sizes[i] = strips[i].encoded.size();
+			}
+			size_t total = MappedHeaderSize(sizes);
+			const size_t header = total;
+			for (size_t i = 0; i < sizes.size(); ++i) total += sizes[i];
+
+			MappedOutputFile file;
+			if (!file.Open(fileName, total)) return IPSTAT_FAILED;
+			WriteMappedHeader(sizes, file.data());
+			std::vector<size_t> offsets(strips.size());
+			size_t offset = header;
+			for (size_t i = 0; i < strips.size(); ++i)
+			{
+				offsets[i] = offset;
+				offset += sizes[i];
+			}
+			unsigned char *dest = file.data();
+			ParallelFor(0, strips.size(), 1, [&](size_t b, size_t e, unsigned int)
+			{
+				for (size_t i = b; i < e; ++i)
+				{
+					if (sizes[i]) memcpy(dest + offsets[i], &strips[i].encoded[0], sizes[i]);
+					std::vector<unsigned char>().swap(strips[i].encoded);
+				}
+			});
+			return file.Close() ? IPSTAT_OK : IPSTAT_FAILED;
+		}
+	protected:
+		//! Scanlines per strip, can be changed in Start()
+		int linesPerStrip = 16;
+		//! Number of threads to encode with, 0 for ParallelThreadCount()
+		unsigned int maxThreads = 0;
+		//! Write the file through a memory mapping in Done(), see MappedHeaderSize()
+		bool mappedOutput = false;
+
+		//! Pixel type of the scanlines
+		LWImageType PixelType() const { return static_cast<LWImageType>(protocol.type); }
+
+		//! Called once the size of the image is known, before the first scanline
+		/*!
+		 * Open the output file and write the header here when not using mappedOutput.
+		 * @return IPSTAT_OK to continue
+		 */
+		virtual int Start() { return IPSTAT_OK; }
+		//! Encode a strip of scanlines, called from worker threads
+		/*!
+		 * @param pixels The scanlines of the strip in the pixel format of PixelType()
+		 * @param stride Bytes per scanline
+		 * @param out Receives the encoded data
+		 * @param worker Index of the calling thread, smaller than the number of threads, use it for per thread encoders
+		 * @return false if encoding failed
+		 */
+		virtual bool EncodeStrip(int strip, int firstLine, int numLines, const unsigned char *pixels, size_t stride,
+														 std::vector<unsigned char> &out, unsigned int worker) = 0;
+		//! Write an encoded strip to the file, strips are written in order
+		virtual int WriteStrip(int strip, const unsigned char *data, size_t size)
+		{
+			UNUSED(strip);
+			UNUSED(data);
+			UNUSED(size);
+			return IPSTAT_OK;
+		}
+		//! Size of the file in front of the first strip when using mappedOutput
+		/*!
+		 * @param stripSizes Encoded size of each strip
+		 */
+		virtual size_t MappedHeaderSize(const std::vector<size_t> &stripSizes) { UNUSED(stripSizes); return 0; }
+		//! Write the header into the mapped file, the strips follow directly in order
+		virtual void WriteMappedHeader(const std::vector<size_t> &stripSizes, unsigned char *dest)
+		{
+			UNUSED(stripSizes);
+			UNUSED(dest);
+		}
+		//! Called at the end after all strips are written, close the file here
+		virtual int Finish(int rc) { return rc; }
+
+	public:
+		using ImageSaverHandler::SendLine;
+
+		ParallelImageSaverHandler(int v, LWImageSaverLocal *l)
+			: ImageSaverHandler(v, l), nextWorker(0)
+		{
+			;
+		}
+		virtual ~ParallelImageSaverHandler()
+		{
+			stopWorkers();
+		}
+
+		virtual void SetSize(int w, int h)
+		{
+			ImageSaverHandler::SetSize(w, h);
+			result = Start();
+			linesPerStrip = Clamp(linesPerStrip, 1, Max(h, 1));
+			stride = BytesPerPixel(PixelType()) * w;
+			if ((result != IPSTAT_OK) || (stride == 0) || (h <= 0))
+			{
+				if (result == IPSTAT_OK) result = IPSTAT_FAILED;
+				return;
+			}
+			Strip empty = { std::vector<unsigned char>(), std::vector<unsigned char>(), 0, false, false };
+			strips.assign((h + linesPerStrip - 1) / linesPerStrip, empty);
+			nextWrite = 0;
+			inFlight = 0;
+			closing = false;
+			encodeFailed = false;
+
+			unsigned int numThreads = maxThreads ? maxThreads : ParallelThreadCount();
+			numThreads = std::min(numThreads, static_cast<unsigned int>(strips.size()));
+			maxInFlight = 2 * numThreads;
+			if (numThreads > 1)
+			{
+				nextWorker = 0;
+				group = new ThreadGroup(static_cast<int>(numThreads));
+				for (unsigned int i = 0; i < numThreads; ++i)
+				{
+					group->addThread(workerFunc, 0, this);
+				}
+				if ((group->getThreadCount() != static_cast<int>(numThreads)) || !group->begin())
+				{
+					delete group;
+					group = nullptr;
+				}
+			}
+		}
+
+		virtual int SendLine(int y, const LWPixelID buffer)
+		{
+			if (result != IPSTAT_OK) return result;
+			if ((y < 0) || (y >= height)) return IPSTAT_FAILED;
+			const int strip = y / linesPerStrip;
+			Strip &s = strips[strip];
+			if (s.raw.empty()) s.raw.resize(stride * stripLines(strip));
+			memcpy(&s.raw[(y - strip * linesPerStrip) * stride], buffer, stride);
+			if (++s.received == stripLines(strip))
+			{
+				submit(strip);
+				if (!mappedOutput) result = flush(false);
+			}
+			return result;
+		}
+
+		virtual int Done(int rc)
+		{
+			if ((rc == IPSTAT_OK) && (result == IPSTAT_OK))
+			{
+				// encode strips with missing scanlines as they are
+				for (size_t i = 0; i < strips.size(); ++i)
+				{
+					Strip &s = strips[i];
+					if (s.queued) continue;
+					if (s.raw.empty()) s.raw.resize(stride * stripLines(static_cast<int>(i)), 0);
+					submit(static_cast<int>(i));
+				}
+				if (!mappedOutput) result = flush(true);
+			}
+			stopWorkers();
+			if ((rc == IPSTAT_OK) && (result == IPSTAT_OK))
+			{
+				if (encodeFailed) result = IPSTAT_FAILED;
+				else if (mappedOutput) result = writeMapped();
+			}
+			strips.clear();
+			return Finish((rc != IPSTAT_OK) ? rc : result);
+		}
+	};
+
 	//! @ingroup Adaptor
 	template <class T>
 	class ImageSaverAdaptor
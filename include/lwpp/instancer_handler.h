@@ -1,8 +1,16 @@
 #ifndef LWPP_INSTANCER_HANDLER
 #define LWPP_INSTANCER_HANDLER
 #include "lwpp/plugin_handler.h"
+#include <lwpp/instances.h>
+#include <lwpp/threads.h>
 #include <lwinstancing.h>
 #include <lwsurf.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace lwpp
 {
@@ -23,6 +31,268 @@ namespace lwpp
 		virtual void Evaluate(LWInstance inst, const LWInstancerAccess *ia) = 0;
 	};
 
+	//! A chunk of instances in structure of arrays layout
+	/*!
+	 * Rotations are heading, pitch and bank in radians. The item of an instance is an index into the items of the
+	 * ParallelInstancerHandler.
+	 */
+	struct InstanceBatch
+	{
+		std::vector<double> px, py, pz;
+		std::vector<float> rh, rp, rb;
+		std::vector<float> sx, sy, sz;
+		std::vector<unsigned int> item;
+		std::vector<unsigned int> id;
+		std::vector<float> attributes;	//!< attributeCount values per instance
+		size_t attributeCount = 0;
+
+		size_t Count() const { return px.size(); }
+		void Clear()
+		{
+			px.clear(); py.clear(); pz.clear();
+			rh.clear(); rp.clear(); rb.clear();
+			sx.clear(); sy.clear(); sz.clear();
+			item.clear();
+			id.clear();
+			attributes.clear();
+		}
+		void Reserve(size_t n)
+		{
+			px.reserve(n); py.reserve(n); pz.reserve(n);
+			rh.reserve(n); rp.reserve(n); rb.reserve(n);
+			sx.reserve(n); sy.reserve(n); sz.reserve(n);
+			item.reserve(n);
+			id.reserve(n);
+			attributes.reserve(n * attributeCount);
+		}
+		//! Append an instance, returns its index within the batch
+		size_t Add(const Point3d &pos, const Vector3d &hpb, const Vector3d &scale, unsigned int itemIndex, unsigned int instanceID = 0)
+		{
+			px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+			rh.push_back(static_cast<float>(hpb.x)); rp.push_back(static_cast<float>(hpb.y)); rb.push_back(static_cast<float>(hpb.z));
+			sx.push_back(static_cast<float>(scale.x)); sy.push_back(static_cast<float>(scale.y)); sz.push_back(static_cast<float>(scale.z));
+			item.push_back(itemIndex);
+			id.push_back(instanceID);
+			attributes.resize(attributes.size() + attributeCount, 0.0f);
+			return px.size() - 1;
+		}
+		//! Per instance attributes, nullptr if there are none
+		float *Attributes(size_t index) { return attributeCount ? &attributes[index * attributeCount] : nullptr; }
+		const float *Attributes(size_t index) const { return attributeCount ? &attributes[index * attributeCount] : nullptr; }
+		size_t MemorySize() const
+		{
+			return px.capacity() * 3 * sizeof(double) + rh.capacity() * 6 * sizeof(float) +
+				(item.capacity() + id.capacity()) * sizeof(unsigned int) + attributes.capacity() * sizeof(float);
+		}
+	};
+
+	//! Instancer that generates its instances in parallel
+	/*!
+	 * @ingroup Handler
+	 * The instances are split into chunks that are filled by GenerateChunk() on worker threads. The chunks are
+	 * committed to LightWave on the calling thread in chunk order while the remaining ones are still being
+	 * generated, so the result does not depend on the number of threads as long as each chunk is deterministic,
+	 * for example by seeding the random numbers of a chunk with its index.
+	 *
+	 * If InputHash() returns the same non zero value as in the previous Evaluate(), the instances of the previous
+	 * evaluation are committed again without generating them. Set keepInstances to false to release the chunks
+	 * after committing instead.
+	 *
+	 * @note The instancer functions of the SDK have no bulk call, so committing still takes createInstance() and
+	 * five setters per instance on the calling thread, also for reused chunks. Only the generation is parallel and
+	 * cached, for very large counts the commit dominates.
+	 */
+	class ParallelInstancerHandler : public InstancerHandler
+	{
+		std::vector<InstanceBatch> chunks;
+		std::vector<char> chunkReady;
+		std::atomic<size_t> nextChunk;
+		std::atomic<unsigned int> nextWorker;
+		std::atomic<bool> cancelled;
+		std::mutex lock;
+		std::condition_variable chunkDone;
+		std::string error;
+		unsigned long long lastHash = 0;
+		bool cached = false;
+
+		void generate(size_t chunk, unsigned int worker)
+		{
+			InstanceBatch &batch = chunks[chunk];
+			batch.Clear();
+			batch.attributeCount = attributeCount;
+			try
+			{
+				GenerateChunk(chunk, batch, worker);
+			}
+			catch (std::exception &e)
+			{
+				batch.Clear();
+				std::lock_guard<std::mutex> guard(lock);
+				if (error.empty()) error = e.what();
+			}
+		}
+		void workerRun(unsigned int worker)
+		{
+			for (;;)
+			{
+				const size_t chunk = nextChunk.fetch_add(1);
+				if ((chunk >= chunks.size()) || cancelled) return;
+				generate(chunk, worker);
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					chunkReady[chunk] = 1;
+				}
+				chunkDone.notify_all();
+			}
+		}
+		static int workerFunc(void *arg)
+		{
+			ParallelInstancerHandler *instancer = static_cast<ParallelInstancerHandler *>(arg);
+			instancer->workerRun(instancer->nextWorker.fetch_add(1));
+			return 0;
+		}
+		void commit(ItemInstancer &instancer, const InstanceBatch &batch)
+		{
+			for (size_t i = 0; i < batch.Count(); ++i)
+			{
+				const unsigned int itemIndex = batch.item[i];
+				if (itemIndex >= items.size()) continue;
+				LWItemInstanceID inst = instancer.createInstance();
+				if (!inst) return;
+				const LWDVector pos = { batch.px[i], batch.py[i], batch.pz[i] };
+				const LWDVector hpb = { batch.rh[i], batch.rp[i], batch.rb[i] };
+				const LWDVector scale = { batch.sx[i], batch.sy[i], batch.sz[i] };
+				instancer.setItem(inst, items[itemIndex]);
+				instancer.setPosition(inst, 0, pos);
+				instancer.setRotation(inst, 0, hpb);
+				instancer.setScale(inst, 0, scale);
+				instancer.setID(inst, batch.id[i]);
+				CommitAttributes(inst, batch, i);
+			}
+		}
+		void generateAndCommit(ItemInstancer &instancer, unsigned int numThreads)
+		{
+			numThreads = std::min(numThreads, static_cast<unsigned int>(chunks.size()));
+			chunkReady.assign(chunks.size(), 0);
+			nextChunk = 0;
+			nextWorker = 0;
+			cancelled = false;
+			error.clear();
+
+			ThreadGroup *group = nullptr;
+			if (numThreads > 1)
+			{
+				group = new ThreadGroup(static_cast<int>(numThreads));
+				for (unsigned int i = 0; i < numThreads; ++i)
+				{
+					group->addThread(workerFunc, 0, this);
+				}
+				if ((group->getThreadCount() != static_cast<int>(numThreads)) || !group->begin())
+				{
+					delete group;
+					group = nullptr;
+				}
+			}
+
+			for (size_t chunk = 0; chunk < chunks.size(); ++chunk)
+			{
+				bool failed;
+				if (group)
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					chunkDone.wait(guard, [&] { return chunkReady[chunk] != 0; });
+					failed = !error.empty();
+				}
+				else
+				{
+					generate(chunk, 0);
+					failed = !error.empty();
+				}
+				if (failed) break;
+				commit(instancer, chunks[chunk]);
+				if (!keepInstances) chunks[chunk] = InstanceBatch();
+			}
+			if (group)
+			{
+				cancelled = true;
+				group->sync();
+				delete group;
+			}
+		}
+	protected:
+		//! Items to instance, referenced by index from InstanceBatch::item
+		std::vector<LWItemID> items;
+		//! Number of float attributes stored per instance
+		size_t attributeCount = 0;
+		//! Number of threads to generate with, 0 for ParallelThreadCount()
+		unsigned int maxThreads = 0;
+		//! Keep the generated instances for reuse while InputHash() does not change
+		bool keepInstances = true;
+
+		//! Number of chunks to generate for this evaluation
+		virtual size_t ChunkCount(const LWInstancerAccess *ia) = 0;
+		//! Fill a chunk, called from worker threads
+		/*!
+		 * @param worker Index of the calling thread, smaller than the number of threads
+		 */
+		virtual void GenerateChunk(size_t chunk, InstanceBatch &batch, unsigned int worker) = 0;
+		//! Hash of everything the instances depend on, 0 to generate them on every evaluation
+		virtual unsigned long long InputHash(const LWInstancerAccess *ia) { UNUSED(ia); return 0; }
+		//! Set additional data of a new instance from its attributes
+		virtual void CommitAttributes(LWItemInstanceID inst, const InstanceBatch &batch, size_t index)
+		{
+			UNUSED(inst);
+			UNUSED(batch);
+			UNUSED(index);
+		}
+	public:
+		ParallelInstancerHandler(void *g, void *context, LWError *err)
+			: InstancerHandler(g, context, err), nextChunk(0), nextWorker(0), cancelled(false)
+		{
+			;
+		}
+		virtual ~ParallelInstancerHandler() {;}
+
+		virtual void Evaluate(LWInstance inst, const LWInstancerAccess *ia)
+		{
+			UNUSED(inst);
+			ItemInstancer instancer(ia->instancer);
+			const unsigned long long hash = InputHash(ia);
+			if (cached && (hash != 0) && (hash == lastHash))
+			{
+				for (auto &batch : chunks) commit(instancer, batch);
+				return;
+			}
+			cached = false;
+			chunks.clear();
+			chunks.resize(ChunkCount(ia));
+			generateAndCommit(instancer, maxThreads ? maxThreads : ParallelThreadCount());
+			if (!error.empty())
+			{
+				chunks.clear();
+				throw std::runtime_error(error);
+			}
+			lastHash = hash;
+			cached = keepInstances && (hash != 0);
+			if (!keepInstances) chunks.clear();
+		}
+		//! Discard the cached instances, for example after the settings of the plugin changed
+		void Invalidate() { cached = false; }
+		//! Number of instances held for reuse
+		size_t InstanceCount() const
+		{
+			size_t count = 0;
+			for (auto &batch : chunks) count += batch.Count();
+			return count;
+		}
+		size_t MemorySize() const
+		{
+			size_t size = chunks.capacity() * sizeof(InstanceBatch);
+			for (auto &batch : chunks) size += batch.MemorySize();
+			return size;
+		}
+	};
+
 	//! Wrapper for an Instancer
 	/*!
 	* @ingroup Adaptor
@@ -61,6 +331,7 @@ namespace lwpp
 	private:
 		static void Evaluate (LWInstance instance, const LWInstancerAccess *ia)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Instancer::Evaluate");
 			try
 			{
 				T *plugin = (T *) instance;
@@ -37,6 +37,32 @@ namespace lwpp {
       return globPtr->instanceByIndex(mID, index);
     }
 
+    //! Add a new instance, used by instancer plugins during Evaluate()
+    LWItemInstanceID createInstance()
+    {
+      return globPtr->createInstance(mID);
+    }
+    void setItem(LWItemInstanceID inst, LWItemID item)
+    {
+      globPtr->setItem(inst, item);
+    }
+    void setPosition(LWItemInstanceID inst, unsigned int step, const LWDVector pos)
+    {
+      globPtr->setPosition(inst, step, pos);
+    }
+    void setRotation(LWItemInstanceID inst, unsigned int step, const LWDVector hpb)
+    {
+      globPtr->setRotation(inst, step, hpb);
+    }
+    void setScale(LWItemInstanceID inst, unsigned int step, const LWDVector scale)
+    {
+      globPtr->setScale(inst, step, scale);
+    }
+    void setID(LWItemInstanceID inst, unsigned int id)
+    {
+      globPtr->setID(inst, id);
+    }
+
   };
 
   class InstanceInfo :  protected GlobalBase<LWItemInstanceInfo>
@@ -59,6 +59,7 @@ namespace lwpp
 	private:
 		static void Evaluate (LWInstance inst, const LWItemMotionAccess* ma)
 		{
+			LWPP_PROFILE_CALLBACK(T, "ItemMotion::Evaluate");
 			T* plugin = static_cast<T*>(inst);
 			plugin->Evaluate(ma);
 		}
@@ -41,13 +41,51 @@ namespace lwpp
   {
 		bool mDestroy = false;
 		LWLightEvaluatorID mID;
+		LightEvaluation(const LightEvaluation &);
+		LightEvaluation &operator=(const LightEvaluation &);
 	public:
-		LightEvaluation(LWLightEvaluatorID id)
+		LightEvaluation(LWLightEvaluatorID id = nullptr)
 			: mID(id)
 		{}
 		~LightEvaluation() {
 			if (mDestroy) globPtr->destroy(mID);
 		}
+		//! Create a new evaluator for a light, it is destroyed with this object
+		bool create(LWItemID light)
+		{
+			if (mDestroy) globPtr->destroy(mID);
+			mID = available() ? globPtr->create(light) : nullptr;
+			mDestroy = (mID != nullptr);
+			return mDestroy;
+		}
+		bool isValid() const { return available() && (mID != nullptr); }
+		LWLightEvaluatorID getID() const { return mID; }
+		unsigned int flags()
+		{
+			return globPtr->flags(mID);
+		}
+		LWError init(int mode)
+		{
+			return globPtr->init(mID, mode);
+		}
+		void cleanUp()
+		{
+			globPtr->cleanUp(mID);
+		}
+		LWError newTime(LWFrame frame, LWTime time)
+		{
+			return globPtr->newTime(mID, frame, time);
+		}
+		//! World space bounds of the light, returns false for lights without bounds, such as distant lights
+		bool worldBounds(LWDVector min, LWDVector max)
+		{
+			return (globPtr->worldBounds(mID, min, max) != 0);
+		}
+		//! Emitted power of the light
+		bool power(LWDVector power)
+		{
+			return (globPtr->power(mID, power) != 0);
+		}
 		unsigned int evaluate(LWMemChunk memory, const LWRay* ray, unsigned int flags, const LWDVector p, unsigned int *samples)
 		{
 			return globPtr->evaluate(mID, memory, ray, flags, p, samples);
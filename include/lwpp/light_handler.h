@@ -113,6 +113,7 @@ namespace lwpp
     }
     static int Evaluate (LWInstance instance, const LWDVector spot, double fractime, LWIllumination illumination[], const LWLightAccess* lightaccess)
     {
+      LWPP_PROFILE_CALLBACK(T, "Light::Evaluate");
       try
       {
         T *plugin = (T *) instance;
@@ -166,6 +167,7 @@ namespace lwpp
     }
     static int Evaluate11 (LWInstance instance, const LWDVector spot, double fractime, LWIllumination illumination[], const LW11::LWLightAccess* lightaccess)
     {
+      LWPP_PROFILE_CALLBACK(T, "Light::Evaluate");
       try
       {
         T *plugin = (T *) instance;
@@ -0,0 +1,123 @@
+/*!
+ * @file
+ * @brief Bounding volume hierarchy over the lights of a scene for many-light importance sampling
+ */
+#ifndef LWPP_LIGHT_TREE_H
+#define LWPP_LIGHT_TREE_H
+
+#include <lwpp/point3d.h>
+#include <lwpp/vector3d.h>
+#include <lwrender.h>
+#include <vector>
+
+namespace lwpp
+{
+	//! Spatial and directional bounds of one or more lights
+	/*!
+	 * The directions of emission are bounded by a cone around axis: the normals of all emitters lie within
+	 * thetaO of the axis and each emitter radiates up to thetaE away from its normal.
+	 * An omni directional light has thetaO = PI and thetaE = PI/2.
+	 */
+	struct LightBounds
+	{
+		Point3d min;
+		Point3d max;
+		Vector3d axis;
+		double thetaO;
+		double thetaE;
+		double energy;	//!< Luminance of the emitted power
+
+		LightBounds();
+		bool isEmpty() const { return (min.x > max.x) || (min.y > max.y) || (min.z > max.z); }
+		Point3d Centre() const { return Point3d((min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5); }
+		//! Grow to include another set of bounds, including the emission cone
+		void Merge(const LightBounds &b);
+		//! Estimate of the contribution to a point
+		/*!
+		 * @param n Surface normal at p, may be nullptr for points in a volume
+		 */
+		double Importance(const Point3d &p, const Vector3d *n) const;
+	};
+
+	//! A light stored in a LightTree
+	struct LightTreeEntry
+	{
+		LWItemID light;
+		LightBounds bounds;	//!< Empty bounds for lights at infinity, such as distant lights
+	};
+
+	//! Stochastic selection of one light out of many
+	/*!
+	 * @ingroup Helper
+	 * Lights with bounds are organised in a binary tree, built with the surface area orientation heuristic.
+	 * Selection walks from the root to a leaf, choosing each child proportional to its importance for the shading
+	 * point, so the cost is logarithmic in the number of lights. Lights without bounds are chosen proportional to
+	 * their power.
+	 *
+	 * Build the tree in NewTime(), Sample() and Pdf() are thread safe.
+	 * @code
+	 * LightTree::Selection sel;
+	 * if (tree.Sample(p, &n, u, sel))
+	 * {
+	 *   // evaluate sel.light and divide its contribution by sel.pdf
+	 * }
+	 * @endcode
+	 */
+	class LightTree
+	{
+	public:
+		//! Result of Sample()
+		struct Selection
+		{
+			LWItemID light;
+			unsigned int index; //!< Index of the light, see getLight()
+			double pdf;					//!< Probability of the selection
+		};
+
+		LightTree();
+		//! Gather the lights of the scene using LWLightEvaluationFuncs and build the tree
+		/*!
+		 * @return false if no lights were found
+		 */
+		bool Build(LWFrame frame, LWTime time);
+		//! Build the tree from a list of lights
+		void Build(const std::vector<LightTreeEntry> &lights);
+		void Clear();
+
+		//! Choose a light for a point
+		/*!
+		 * @param n Surface normal, nullptr for volumes
+		 * @param u Uniform random number in [0, 1)
+		 * @return false if no light contributes to the point
+		 */
+		bool Sample(const Point3d &p, const Vector3d *n, double u, Selection &sel) const;
+		//! Probability of Sample() choosing a light
+		double Pdf(unsigned int index, const Point3d &p, const Vector3d *n) const;
+
+		size_t LightCount() const { return m_lights.size(); }
+		const LightTreeEntry &getLight(unsigned int index) const { return m_lights[index]; }
+		size_t NodeCount() const { return m_nodes.size(); }
+
+	private:
+		struct Node
+		{
+			LightBounds bounds;
+			int left;		//!< -1 for leaves
+			int right;
+			int parent;
+			int light;	//!< Light of a leaf
+		};
+
+		int build(std::vector<unsigned int> &order, size_t begin, size_t end, int parent);
+		double infiniteProbability() const;
+
+		std::vector<LightTreeEntry> m_lights;
+		std::vector<Node> m_nodes;
+		std::vector<int> m_leaf;								//!< Leaf node of each light, -1 for infinite lights
+		std::vector<unsigned int> m_infinite;		//!< Lights without bounds
+		std::vector<double> m_infiniteCdf;
+		double m_infiniteEnergy;
+	};
+} // end namespace lwpp
+
+#endif // LWPP_LIGHT_TREE_H
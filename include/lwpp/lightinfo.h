@@ -54,6 +54,9 @@ void		(*ambient)      (LWTime, LWDVector color);
 
     double getRange(LWTime time) {return globPtr->range(GetID(), time);}
 
+    //! Cone angle and soft edge angle of a spot light, in radians
+    void getConeAngles(LWTime time, double &radius, double &edge) {globPtr->coneAngles(GetID(), time, &radius, &edge);}
+
     int getFalloff() {return globPtr->falloff(GetID());}	
 
     unsigned int getFlags() {return globPtr->flags(GetID());}
@@ -0,0 +1,263 @@
+/*!
+ * @file
+ * @brief Asynchronous logging for LightWrap++
+ *
+ * Messages are copied into a ring buffer owned by the logging thread and written
+ * by a background thread, so logging never blocks on file or debugger I/O.
+ * If a ring buffer is full the message is dropped and counted instead.
+ *
+ * Use the LWPP_LOG_* macros, any message below LWPP_LOG_LEVEL is removed at compile time:
+ * @code
+ * LWPP_LOG_DEBUG("raycast", "hit " << distance);
+ * @endcode
+ */
+#ifndef LWPP_LOGGER_H
+#define LWPP_LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+//! Compile time log threshold, 0 = trace, 1 = debug, 2 = info, 3 = warning, 4 = error, 5 = none
+#ifndef LWPP_LOG_LEVEL
+	#ifdef _DEBUG
+		#define LWPP_LOG_LEVEL 1
+	#else
+		#define LWPP_LOG_LEVEL 3
+	#endif
+#endif
+
+namespace lwpp
+{
+	//! Severity of a log message
+	enum LogLevel
+	{
+		LOG_TRACE = 0,
+		LOG_DEBUG,
+		LOG_INFO,
+		LOG_WARNING,
+		LOG_ERROR,
+		LOG_NONE
+	};
+
+	//! Asynchronous log sink
+	/*!
+	 * @ingroup Tools
+	 * All functions are static and thread safe.
+	 * The category passed to Write() must be a string with static storage duration, usually a literal.
+	 */
+	class Logger
+	{
+	public:
+		//! Size of a single ring buffer slot, longer messages use several slots
+		static const unsigned int SlotSize = 240;
+		//! Slots per thread
+		static const unsigned int SlotsPerThread = 1024;
+
+		//! Destination of the log output
+		enum Sink
+		{
+			SINK_FILE,			//!< Append to a log file, lwpp.log by default
+			SINK_STDERR,		//!< std::cerr
+			SINK_DEBUGGER		//!< OutputDebugString on Windows, std::cerr elsewhere
+		};
+
+		//! Set the runtime threshold, messages below it are discarded
+		static void SetLevel(LogLevel level);
+		static LogLevel GetLevel();
+		//! Enable or disable a category at runtime
+		static void SetCategoryEnabled(const std::string &category, bool enabled);
+		static bool isCategoryEnabled(const std::string &category);
+		//! Incremented whenever a category is enabled or disabled
+		static unsigned int CategoryGeneration();
+		//! Maximum number of messages per second and call site, 0 to disable rate limiting
+		static void SetRateLimit(unsigned int messagesPerSecond);
+		static unsigned int GetRateLimit();
+
+		static void SetSink(Sink sink);
+		static void SetLogFile(const std::string &fileName);
+
+		//! Queue a message
+		/*!
+		 * @param suppressed Number of messages of the same call site that have been suppressed by the rate limit
+		 * @return false if the message was dropped since the ring buffer of this thread is full
+		 */
+		static bool Write(LogLevel level, const char *category, const char *text, size_t length, unsigned int suppressed = 0);
+		static bool Write(LogLevel level, const char *category, const std::string &text, unsigned int suppressed = 0)
+		{
+			return Write(level, category, text.c_str(), text.size(), suppressed);
+		}
+		//! Block until all messages queued so far have been written
+		static void Flush();
+		//! Number of messages dropped due to full ring buffers
+		static std::uint64_t Dropped();
+		//! Stop the background writer and write all pending messages, called when the plugin module is unloaded
+		static void Shutdown();
+	};
+
+	//! State of a single logging call site, used to cache the category filter and for rate limiting
+	/*!
+	 * @ingroup Tools
+	 */
+	class LogSite
+	{
+		const char *m_category;
+		std::atomic<unsigned int> m_generation;
+		std::atomic<bool> m_enabled;
+		std::atomic<std::int64_t> m_window;
+		std::atomic<unsigned int> m_count;
+		std::atomic<unsigned int> m_suppressed;
+	public:
+		explicit LogSite(const char *category)
+			: m_category(category), m_generation(~0u), m_enabled(true), m_window(0), m_count(0), m_suppressed(0)
+		{
+			;
+		}
+		const char *getCategory() const { return m_category; }
+		//! Returns true if a message of the given level should be logged
+		bool Accept(LogLevel level);
+		//! Returns and resets the number of suppressed messages
+		unsigned int TakeSuppressed()
+		{
+			return m_suppressed.exchange(0, std::memory_order_relaxed);
+		}
+	};
+
+	//! Stream buffer that forwards complete lines to the Logger
+	/*!
+	 * Each thread assembles its own line per stream, so a LogStream may be shared by all threads.
+	 * flush() passes on a partial line.
+	 */
+	class LogStreamBuf : public std::streambuf
+	{
+		LogLevel m_level;
+		const char *m_category;
+		const std::uint64_t m_id;	//!< Unique key of the pending lines, unlike this it isn't reused
+		//! Pending line of the current thread, 0 once the thread is shutting down
+		std::string *lineBuffer();
+		void releaseLineBuffer();
+		void append(const char *s, size_t n)
+		{
+			std::string *line = lineBuffer();
+			if (line)
+				line->append(s, n);
+			else if (n)
+				Logger::Write(m_level, m_category, s, n);
+		}
+		void flushLine()
+		{
+			std::string *line = lineBuffer();
+			if (line && !line->empty())
+			{
+				Logger::Write(m_level, m_category, *line);
+				line->clear();
+			}
+		}
+		static std::uint64_t nextID();
+	public:
+		LogStreamBuf(LogLevel level, const char *category)
+			: m_level(level), m_category(category), m_id(nextID())
+		{
+			;
+		}
+		virtual ~LogStreamBuf()
+		{
+			flushLine();
+			releaseLineBuffer();
+		}
+	protected:
+		virtual int sync()
+		{
+			flushLine();
+			return 0;
+		}
+		virtual int_type overflow(int_type c)
+		{
+			if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+			if (traits_type::to_char_type(c) == '\n')
+				flushLine();
+			else
+			{
+				const char ch = traits_type::to_char_type(c);
+				append(&ch, 1);
+			}
+			return c;
+		}
+		virtual std::streamsize xsputn(const char *s, std::streamsize n)
+		{
+			std::streamsize done = 0;
+			while (done < n)
+			{
+				const char *end = static_cast<const char *>(memchr(s + done, '\n', static_cast<size_t>(n - done)));
+				if (!end)
+				{
+					append(s + done, static_cast<size_t>(n - done));
+					break;
+				}
+				append(s + done, static_cast<size_t>(end - (s + done)));
+				flushLine();
+				done = (end - s) + 1;
+			}
+			return n;
+		}
+	};
+
+	//! std::ostream front-end for the Logger
+	class LogStream : public std::ostream
+	{
+		LogStreamBuf m_buf;
+	public:
+		LogStream(LogLevel level = LOG_DEBUG, const char *category = "log")
+			: std::ostream(nullptr), m_buf(level, category)
+		{
+			rdbuf(&m_buf);
+		}
+	};
+} // end namespace lwpp
+
+//! Log a message, the message is only formatted if it passes the level, category and rate filters
+#define LWPP_LOG(level, category, message) \
+	do { \
+		if ((level) >= LWPP_LOG_LEVEL) \
+		{ \
+			static lwpp::LogSite lwpp_log_site(category); \
+			if (lwpp_log_site.Accept(level)) \
+			{ \
+				std::ostringstream lwpp_log_stream; \
+				lwpp_log_stream << message; \
+				lwpp::Logger::Write(level, lwpp_log_site.getCategory(), lwpp_log_stream.str(), lwpp_log_site.TakeSuppressed()); \
+			} \
+		} \
+	} while (0)
+
+#if LWPP_LOG_LEVEL <= 0
+#define LWPP_LOG_TRACE(category, message) LWPP_LOG(lwpp::LOG_TRACE, category, message)
+#else
+#define LWPP_LOG_TRACE(category, message) do {} while (0)
+#endif
+#if LWPP_LOG_LEVEL <= 1
+#define LWPP_LOG_DEBUG(category, message) LWPP_LOG(lwpp::LOG_DEBUG, category, message)
+#else
+#define LWPP_LOG_DEBUG(category, message) do {} while (0)
+#endif
+#if LWPP_LOG_LEVEL <= 2
+#define LWPP_LOG_INFO(category, message) LWPP_LOG(lwpp::LOG_INFO, category, message)
+#else
+#define LWPP_LOG_INFO(category, message) do {} while (0)
+#endif
+#if LWPP_LOG_LEVEL <= 3
+#define LWPP_LOG_WARNING(category, message) LWPP_LOG(lwpp::LOG_WARNING, category, message)
+#else
+#define LWPP_LOG_WARNING(category, message) do {} while (0)
+#endif
+#if LWPP_LOG_LEVEL <= 4
+#define LWPP_LOG_ERROR(category, message) LWPP_LOG(lwpp::LOG_ERROR, category, message)
+#else
+#define LWPP_LOG_ERROR(category, message) do {} while (0)
+#endif
+
+#endif // LWPP_LOGGER_H
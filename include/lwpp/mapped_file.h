@@ -0,0 +1,43 @@
+/*!
+ * @file
+ * @brief Output files written through a memory mapping
+ */
+#ifndef LWPP_MAPPED_FILE_H
+#define LWPP_MAPPED_FILE_H
+
+#include <cstddef>
+
+namespace lwpp
+{
+	//! A file of a fixed size, written through a memory mapping
+	/*!
+	 * @ingroup Helper
+	 * The file is created or truncated to the requested size on Open(), different parts of data() may then be
+	 * written from several threads at once.
+	 */
+	class MappedOutputFile
+	{
+		unsigned char *m_data;
+		size_t m_size;
+#ifdef _MSWIN
+		void *m_file;
+		void *m_mapping;
+#else
+		int m_file;
+#endif
+		MappedOutputFile(const MappedOutputFile &);
+		MappedOutputFile &operator=(const MappedOutputFile &);
+	public:
+		MappedOutputFile();
+		~MappedOutputFile();
+		//! Create the file and map it, returns false on failure
+		bool Open(const char *filename, size_t size);
+		//! Flush and unmap the file, returns false if the data could not be written
+		bool Close();
+		bool isOpen() const { return m_data != nullptr; }
+		unsigned char *data() { return m_data; }
+		size_t size() const { return m_size; }
+	};
+} // end namespace lwpp
+
+#endif // LWPP_MAPPED_FILE_H
@@ -6,9 +6,14 @@
 #include <lwpp/plugin_handler.h>
 #include <lwpp/point3d.h>
 #include <lwpp/vector3d.h>
+#include <lwpp/meshfuncs.h>
+#include <lwpp/threads.h>
 #include <lwdisplce.h>
 #include <lwmeshmodifier.h>
 #include <lwmeshes.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 namespace lwpp
 {
@@ -46,6 +51,219 @@ namespace lwpp
 		virtual void            End(LWMeshDeformerAccess*) { ; }
 	};
 
+	//! Positions of the points of a mesh, stored as separate coordinate arrays
+	struct MeshDeformerPoints
+	{
+		std::vector<LWPntID> ids;
+		std::vector<float> x, y, z;					//!< Input positions
+		std::vector<float> outX, outY, outZ;	//!< Deformed positions
+
+		size_t size() const { return ids.size(); }
+		void resize(size_t n)
+		{
+			ids.resize(n);
+			x.resize(n); y.resize(n); z.resize(n);
+			outX.resize(n); outY.resize(n); outZ.resize(n);
+		}
+		//! Collect all points of a mesh with their current positions
+		size_t Gather(MeshFuncs &mesh)
+		{
+			struct Collector : public PointVisitor
+			{
+				MeshFuncs &mesh;
+				MeshDeformerPoints &points;
+				Collector(MeshFuncs &m, MeshDeformerPoints &p) : mesh(m), points(p) {}
+				size_t process(LWMeshID, LWPntID pnt)
+				{
+					LWFVector pos = { 0.0f, 0.0f, 0.0f };
+					mesh.getPosition(pnt, pos);
+					points.ids.push_back(pnt);
+					points.x.push_back(pos[0]);
+					points.y.push_back(pos[1]);
+					points.z.push_back(pos[2]);
+					return 0;
+				}
+			} collector(mesh, *this);
+			const size_t reserve = ids.size();
+			ids.clear(); x.clear(); y.clear(); z.clear();
+			ids.reserve(reserve); x.reserve(reserve); y.reserve(reserve); z.reserve(reserve);
+			mesh.foreach(collector);
+			outX.resize(size()); outY.resize(size()); outZ.resize(size());
+			return size();
+		}
+	};
+
+	//! One-ring neighbourhood of each point of a mesh
+	/*!
+	 * The neighbours are stored in compressed rows and refer to the indices of MeshDeformerPoints.
+	 * Building walks the polygons around every point, so keep the cache across frames and only rebuild it when the
+	 * number of points changes or Invalidate() is called.
+	 */
+	class MeshTopologyCache
+	{
+		std::vector<unsigned int> m_offsets;
+		std::vector<unsigned int> m_neighbours;
+		bool m_valid;
+	public:
+		MeshTopologyCache() : m_valid(false) {}
+		bool isValid(size_t numPoints) const { return m_valid && (m_offsets.size() == numPoints + 1); }
+		void Invalidate() { m_valid = false; }
+
+		void Build(MeshFuncs &mesh, const MeshDeformerPoints &points)
+		{
+			std::unordered_map<LWPntID, unsigned int> index;
+			index.reserve(points.size());
+			for (size_t i = 0; i < points.size(); ++i) index[points.ids[i]] = static_cast<unsigned int>(i);
+
+			// vertices of a polygon in order
+			struct PolygonPoints : public PolygonPointVisitor
+			{
+				std::vector<LWPntID> pnts;
+				size_t process(LWMeshID, LWPolID, LWPntID pnt) { pnts.push_back(pnt); return 0; }
+			} polygon;
+			// polygons around a point
+			struct PointPolygons
+			{
+				std::vector<LWPolID> pols;
+				size_t MeshPntPol(LWMeshID, LWPntID, LWPolID pol) { pols.push_back(pol); return 0; }
+			} around;
+
+			m_offsets.assign(1, 0);
+			m_offsets.reserve(points.size() + 1);
+			m_neighbours.clear();
+			std::vector<unsigned int> ring;
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				const LWPntID pnt = points.ids[i];
+				around.pols.clear();
+				mesh.foreach_vp(&around, pnt);
+				ring.clear();
+				for (size_t p = 0; p < around.pols.size(); ++p)
+				{
+					polygon.pnts.clear();
+					mesh.foreach(around.pols[p], polygon);
+					const size_t n = polygon.pnts.size();
+					for (size_t v = 0; v < n; ++v)
+					{
+						if (polygon.pnts[v] != pnt) continue;
+						// the edges of the polygon at the point, a two point polygon has only one
+						const LWPntID adjacent[2] = { polygon.pnts[(v + n - 1) % n], polygon.pnts[(v + 1) % n] };
+						for (int a = 0; a < 2; ++a)
+						{
+							if (adjacent[a] == pnt) continue;
+							auto found = index.find(adjacent[a]);
+							if (found != index.end()) ring.push_back(found->second);
+						}
+					}
+				}
+				std::sort(ring.begin(), ring.end());
+				ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+				m_neighbours.insert(m_neighbours.end(), ring.begin(), ring.end());
+				m_offsets.push_back(static_cast<unsigned int>(m_neighbours.size()));
+			}
+			m_valid = true;
+		}
+
+		size_t Valence(size_t point) const { return m_offsets[point + 1] - m_offsets[point]; }
+		//! The neighbours of a point are [begin(point), end(point))
+		const unsigned int *begin(size_t point) const { return m_neighbours.data() + m_offsets[point]; }
+		const unsigned int *end(size_t point) const { return m_neighbours.data() + m_offsets[point + 1]; }
+	};
+
+	//! A range of points to be deformed by a ParallelMeshDeformerHandler
+	struct MeshDeformerChunk
+	{
+		size_t begin;
+		size_t end;
+		unsigned int worker;							//!< Index of the thread, use it to address per thread storage
+		int pass;													//!< Pass of the deformation, see ParallelMeshDeformerHandler::Passes()
+		const float *x, *y, *z;						//!< Input positions of all points
+		float *outX, *outY, *outZ;				//!< Output positions of all points, only write [begin, end)
+		const MeshTopologyCache *topology;	//!< One-ring neighbours, only valid if requested
+	};
+
+	//! Base class for MeshDeformer plugins that deform points in parallel
+	/*!
+	 * @ingroup Handler
+	 * Evaluate() gathers the point positions into arrays, splits them into chunks of chunkSize points and runs
+	 * DeformChunk() for the chunks on a thread group. The results are passed back to ScatterPoints().
+	 * Deformers that need the neighbours of a point, such as smoothing, set needsTopology. The one-ring adjacency is
+	 * then built on the first evaluation and reused as long as the number of points does not change.
+	 * Deformers with several iterations return the number from Passes(), the output of a pass is the input of the
+	 * next one.
+	 *
+	 * The mesh access of LWMeshDeformerAccess differs between SDK versions, so the deformer provides the mesh to
+	 * read from in GetMesh() and writes the result back in ScatterPoints().
+	 */
+	class ParallelMeshDeformerHandler : public MeshDeformerHandler
+	{
+	protected:
+		MeshDeformerPoints points;
+		MeshTopologyCache topology;
+		size_t chunkSize = 4096;
+		bool needsTopology = false;
+		//! Number of threads to use, 0 for ParallelThreadCount()
+		unsigned int maxThreads = 0;
+
+		//! The mesh to deform
+		virtual LWMeshID GetMesh(LWMeshDeformerAccess *mda) = 0;
+		//! Collect the points to deform, the default reads all points of GetMesh()
+		virtual bool GatherPoints(LWMeshDeformerAccess *mda, MeshDeformerPoints &pts)
+		{
+			MeshFuncs mesh(GetMesh(mda));
+			return pts.Gather(mesh) > 0;
+		}
+		//! Number of passes of DeformChunk() per evaluation
+		virtual int Passes() { return 1; }
+		//! Deform the points of a chunk, called from several threads at once
+		virtual void DeformChunk(const MeshDeformerChunk &chunk) = 0;
+		//! Write the deformed positions (outX, outY, outZ) back to the mesh
+		virtual unsigned int ScatterPoints(LWMeshDeformerAccess *mda, const MeshDeformerPoints &pts) = 0;
+
+	public:
+		ParallelMeshDeformerHandler(void* g, void* context, LWError* err)
+			: MeshDeformerHandler(g, context, err)
+		{
+			;
+		}
+
+		virtual unsigned int Evaluate(LWMeshDeformerAccess *mda)
+		{
+			if (!GatherPoints(mda, points)) return 0;
+			const size_t n = points.size();
+			if (needsTopology && !topology.isValid(n))
+			{
+				MeshFuncs mesh(GetMesh(mda));
+				topology.Build(mesh, points);
+			}
+
+			const int passes = Max(Passes(), 1);
+			for (int pass = 0; pass < passes; ++pass)
+			{
+				if (pass > 0)
+				{
+					points.x.swap(points.outX);
+					points.y.swap(points.outY);
+					points.z.swap(points.outZ);
+				}
+				MeshDeformerChunk base;
+				base.pass = pass;
+				base.x = points.x.data(); base.y = points.y.data(); base.z = points.z.data();
+				base.outX = points.outX.data(); base.outY = points.outY.data(); base.outZ = points.outZ.data();
+				base.topology = needsTopology ? &topology : nullptr;
+				ParallelFor(0, n, Max(chunkSize, static_cast<size_t>(1)), [&](size_t b, size_t e, unsigned int worker)
+				{
+					MeshDeformerChunk chunk = base;
+					chunk.begin = b;
+					chunk.end = e;
+					chunk.worker = worker;
+					DeformChunk(chunk);
+				}, maxThreads);
+			}
+			return ScatterPoints(mda, points);
+		}
+	};
+
 	//! Wrapper for an DisplacementHandler
 	/*!
 	 * @ingroup Adaptor
@@ -89,6 +307,7 @@ namespace lwpp
 
 		static unsigned int Evaluate(LWInstance instance, LWMeshDeformerAccess* mda)
 		{
+			LWPP_PROFILE_CALLBACK(T, "MeshDeformer::Evaluate");
 			try
 			{
 				T* plugin = (T*)instance;
@@ -138,6 +138,11 @@ namespace lwpp
 				if (monitor) return (monitor->step(monitor->data, step) != 0);
         return true;
 			}
+			//! Advance the monitor, true only if a monitor is attached and the user aborted
+			bool StepAborted(int step = 1)
+			{
+				return monitor && (monitor->step(monitor->data, step) != 0);
+			}
 			void Done()
 			{
 				if (monitor) monitor->done(monitor->data);
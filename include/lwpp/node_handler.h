@@ -210,6 +210,7 @@ namespace lwpp
 
 		static void evaluate (LWInstance instance, LWShadingGeometry* sg, NodeOutputID outID, NodeValue value)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Node::Evaluate");
 			try
 			{
 				if (instance)
@@ -297,6 +298,136 @@ namespace lwpp
 			}
 	};
 
+	class FusedNodeHandler;
+
+	//! Node input that calls the kernel of a connected FusedNodeHandler directly
+	/*!
+	 * If the input is connected to an output of the same type of a FusedNodeHandler, evaluating it calls
+	 * FusedNodeHandler::Kernel() of that node instead of going through LightWave. Any other connection is
+	 * evaluated by LightWave as usual.
+	 */
+	class FusedInput
+	{
+		LWNodeInput *m_input;
+		FusedNodeHandler *m_source;
+		NodeOutputID m_output;
+	public:
+		FusedInput() : m_input(0), m_source(0), m_output(0) {}
+		//! Set the input to evaluate, the input is not owned
+		void Attach(LWNodeInput *input)
+		{
+			m_input = input;
+			m_source = 0;
+		}
+		//! Look up the connected node, done by FusedNodeHandler::Init()
+		void Resolve();
+		//! Evaluate through LightWave until resolved again
+		void Reset() { m_source = 0; }
+		bool isFused() const { return m_source != 0; }
+		bool isConnected() const { return m_input && m_input->isConnected(); }
+		//! Evaluate a scalar, colour or vector input
+		/*!
+		 * @return false if the input is not connected, value is left unchanged then
+		 */
+		bool evaluate(LWShadingGeometry *sg, double *value);
+		bool evaluate(LWShadingGeometry *sg, Vector3d &value) { return evaluate(sg, value.asLWVector()); }
+	};
+
+	//! Node with a pure per sample kernel that connected lwpp nodes can call directly
+	/*!
+	 * @ingroup Handler
+	 * Chains of FusedNodeHandlers connected output to input evaluate as nested kernel calls, only inputs coming
+	 * from other nodes make a round trip through LightWave. Connections are resolved in Init() and reset on any
+	 * input event.
+	 *
+	 * Implement Kernel() instead of Evaluate() and read inputs through FusedInputs added with addFusedInput().
+	 * Kernel() may be called from several threads at once for any output of the node, it must only read members
+	 * that don't change during rendering.
+	 * @note Only scalar, colour and vector connections between outputs and inputs of the same type are fused.
+	 */
+	class FusedNodeHandler : public NodeHandler
+	{
+		std::vector<FusedInput *> m_fusedInputs;
+	protected:
+		//! Make an input available for fusion, both must outlive the node
+		void addFusedInput(FusedInput &fused, LWNodeInput *input)
+		{
+			fused.Attach(input);
+			m_fusedInputs.push_back(&fused);
+		}
+		virtual int NodeInputEvent(NodeInputID nid, LWNodalEvent nevent, ConnectionType type)
+		{
+			for (auto fused : m_fusedInputs) fused->Reset();
+			return NodeHandler::NodeInputEvent(nid, nevent, type);
+		}
+	public:
+		FusedNodeHandler(void *priv, void *context, LWError *err) : NodeHandler(priv, context, err)
+		{
+			Register(Context, this);
+		}
+		virtual ~FusedNodeHandler()
+		{
+			Unregister(Context);
+		}
+		//! Compute one output as a pure function of the shading geometry and the inputs
+		/*!
+		 * @param value Receives 1 value for scalar and 3 for colour and vector outputs
+		 * @return false if the output was not computed
+		 */
+		virtual bool Kernel(LWShadingGeometry *sg, NodeOutputID outID, double *value) = 0;
+
+		virtual LWError Init(int mode)
+		{
+			LWError err = NodeHandler::Init(mode);
+			for (auto fused : m_fusedInputs) fused->Resolve();
+			return err;
+		}
+		virtual void Evaluate(LWShadingGeometry *sg, NodeOutputID outID, NodeValue value)
+		{
+			double v[3] = { 0.0, 0.0, 0.0 };
+			if (Kernel(sg, outID, v)) setValue(value, v);
+		}
+
+		/*!
+		 * @name Registry
+		 * All FusedNodeHandlers of the plugin by node
+		 */
+		//@{
+		static void Register(NodeID node, FusedNodeHandler *handler);
+		static void Unregister(NodeID node);
+		static FusedNodeHandler *Find(NodeID node);
+		//@}
+	};
+
+	//! @ingroup XPanelHandler
+	class XPanelFusedNodeHandler : public FusedNodeHandler, public XPanelInterface
+	{
+		public:
+			XPanelFusedNodeHandler(void *priv, void *context, LWError *err) : FusedNodeHandler(priv, context, err)
+			{
+				;
+			}
+			virtual ~XPanelFusedNodeHandler() {;}
+			virtual int NodeInputEvent ( NodeInputID nid, LWNodalEvent nevent, ConnectionType type) override
+			{
+				auto ret = FusedNodeHandler::NodeInputEvent(nid, nevent, type);
+				LW_XPanel.ViewRefresh();
+				return ret;
+			}
+			virtual LWXPRefreshCode ChangeNotify (LWXPanelID , unsigned int , unsigned int , int event_type) override
+			{
+				if ( ( event_type == LWXPEVENT_VALUE ) || ( event_type == LWXPEVENT_HIT ) )
+				{
+					Update();
+				}
+				else if (event_type == LWXPEVENT_TRACK)
+				{
+					UpdateNodePreview();
+				}
+				return LWXPRC_DFLT;
+			}
+	};
+
 	//! @ingroup XPanelAdaptor
 	IMPLEMENT_XPANELADAPTOR(Node, LWNODECLASS_VERSION);
 
@@ -0,0 +1,414 @@
+/*!
+ * @file
+ * @brief Procedural noise functions
+ */
+#ifndef LWPP_NOISE_H
+#define LWPP_NOISE_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace lwpp
+{
+	//! Basis function for fractal noise
+	enum NoiseBasis
+	{
+		NOISE_PERLIN,
+		NOISE_SIMPLEX
+	};
+
+	//! Gradient, simplex, cellular and curl noise in 3D
+	/*!
+	 * @ingroup Helper
+	 * All functions are const and thread safe. The lattice is hashed rather than looked up in a permutation
+	 * table, so the pattern only depends on the seed and repeats only at the integer range.
+	 * Derivatives are analytic and returned as gradients with respect to the position.
+	 *
+	 * The batch variants evaluate arrays of points in a structure of arrays layout. They are plain scalar loops
+	 * over the scalar functions, which branch and look up hashed gradients per lattice point, so they save the
+	 * call overhead and keep the data contiguous but don't rely on vectorisation.
+	 * @code
+	 * lwpp::Noisef noise(seed);
+	 * float grad[3];
+	 * float density = noise.fBm(p[0], p[1], p[2], 6, 2.0f, 0.5f, NOISE_PERLIN, grad);
+	 * @endcode
+	 */
+	template <typename T>
+	class NoiseGenerator
+	{
+		unsigned int m_seed;
+
+		static unsigned int hash(int x, int y, int z, unsigned int seed)
+		{
+			unsigned int h = seed;
+			h = (h ^ static_cast<unsigned int>(x)) * 0x8DA6B343u;
+			h = (h ^ static_cast<unsigned int>(y)) * 0xD8163841u;
+			h = (h ^ static_cast<unsigned int>(z)) * 0xCB1AB31Fu;
+			// Murmur3 finaliser
+			h ^= h >> 16;
+			h *= 0x85EBCA6Bu;
+			h ^= h >> 13;
+			h *= 0xC2B2AE35u;
+			h ^= h >> 16;
+			return h;
+		}
+		static unsigned int octaveSeed(unsigned int seed, int octave)
+		{
+			return seed + static_cast<unsigned int>(octave) * 0x9E3779B9u;
+		}
+		//! Edges of a cube, padded to 16
+		static const T *gradient(unsigned int h)
+		{
+			static const T g[16][3] =
+			{
+				{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+				{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+				{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+				{ 1, 1, 0 }, { 0, -1, 1 }, { -1, 1, 0 }, { 0, -1, -1 }
+			};
+			return g[h & 15];
+		}
+		static T dot(const T *g, T x, T y, T z) { return g[0] * x + g[1] * y + g[2] * z; }
+		static T fade(T t) { return t * t * t * (t * (t * T(6) - T(15)) + T(10)); }
+		static T dfade(T t) { return T(30) * t * t * (t * (t - T(2)) + T(1)); }
+
+		static T perlin(T x, T y, T z, unsigned int seed, T *d)
+		{
+			const T x0 = std::floor(x), y0 = std::floor(y), z0 = std::floor(z);
+			const int ix = static_cast<int>(x0), iy = static_cast<int>(y0), iz = static_cast<int>(z0);
+			const T fx = x - x0, fy = y - y0, fz = z - z0;
+			const T u = fade(fx), v = fade(fy), w = fade(fz);
+
+			const T *ga = gradient(hash(ix, iy, iz, seed));
+			const T *gb = gradient(hash(ix + 1, iy, iz, seed));
+			const T *gc = gradient(hash(ix, iy + 1, iz, seed));
+			const T *gd = gradient(hash(ix + 1, iy + 1, iz, seed));
+			const T *ge = gradient(hash(ix, iy, iz + 1, seed));
+			const T *gf = gradient(hash(ix + 1, iy, iz + 1, seed));
+			const T *gg = gradient(hash(ix, iy + 1, iz + 1, seed));
+			const T *gh = gradient(hash(ix + 1, iy + 1, iz + 1, seed));
+
+			const T va = dot(ga, fx, fy, fz);
+			const T vb = dot(gb, fx - T(1), fy, fz);
+			const T vc = dot(gc, fx, fy - T(1), fz);
+			const T vd = dot(gd, fx - T(1), fy - T(1), fz);
+			const T ve = dot(ge, fx, fy, fz - T(1));
+			const T vf = dot(gf, fx - T(1), fy, fz - T(1));
+			const T vg = dot(gg, fx, fy - T(1), fz - T(1));
+			const T vh = dot(gh, fx - T(1), fy - T(1), fz - T(1));
+
+			const T k1 = vb - va;
+			const T k2 = vc - va;
+			const T k3 = ve - va;
+			const T k4 = va - vb - vc + vd;
+			const T k5 = va - vc - ve + vg;
+			const T k6 = va - vb - ve + vf;
+			const T k7 = -va + vb + vc - vd + ve - vf - vg + vh;
+
+			if (d)
+			{
+				const T du = dfade(fx), dv = dfade(fy), dw = dfade(fz);
+				for (int i = 0; i < 3; ++i)
+				{
+					d[i] = ga[i] + u * (gb[i] - ga[i]) + v * (gc[i] - ga[i]) + w * (ge[i] - ga[i]) +
+						u * v * (ga[i] - gb[i] - gc[i] + gd[i]) + v * w * (ga[i] - gc[i] - ge[i] + gg[i]) +
+						w * u * (ga[i] - gb[i] - ge[i] + gf[i]) +
+						u * v * w * (-ga[i] + gb[i] + gc[i] - gd[i] + ge[i] - gf[i] - gg[i] + gh[i]);
+				}
+				d[0] += du * (k1 + k4 * v + k6 * w + k7 * v * w);
+				d[1] += dv * (k2 + k5 * w + k4 * u + k7 * w * u);
+				d[2] += dw * (k3 + k6 * u + k5 * v + k7 * u * v);
+			}
+			return va + k1 * u + k2 * v + k3 * w + k4 * u * v + k5 * v * w + k6 * w * u + k7 * u * v * w;
+		}
+
+		//! Contribution of one simplex corner
+		static T corner(T x, T y, T z, unsigned int h, T *d)
+		{
+			const T t = T(0.5) - x * x - y * y - z * z;
+			if (t <= T(0)) return T(0);
+			const T *g = gradient(h);
+			const T t2 = t * t;
+			const T t4 = t2 * t2;
+			const T gdotx = dot(g, x, y, z);
+			if (d)
+			{
+				const T a = T(-8) * t2 * t * gdotx;
+				d[0] += a * x + t4 * g[0];
+				d[1] += a * y + t4 * g[1];
+				d[2] += a * z + t4 * g[2];
+			}
+			return t4 * gdotx;
+		}
+
+		static T simplex(T x, T y, T z, unsigned int seed, T *d)
+		{
+			const T F3 = T(1.0 / 3.0), G3 = T(1.0 / 6.0);
+			const T s = (x + y + z) * F3;
+			const T xs = std::floor(x + s), ys = std::floor(y + s), zs = std::floor(z + s);
+			const int i = static_cast<int>(xs), j = static_cast<int>(ys), k = static_cast<int>(zs);
+			const T t = (xs + ys + zs) * G3;
+			const T x0 = x - (xs - t), y0 = y - (ys - t), z0 = z - (zs - t);
+
+			// the simplex of the point is given by the order of the offsets
+			int i1, j1, k1, i2, j2, k2;
+			if (x0 >= y0)
+			{
+				if (y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+				else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+				else               { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+			}
+			else
+			{
+				if (y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+				else if (x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+				else               { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+			}
+
+			if (d) d[0] = d[1] = d[2] = T(0);
+			T n = corner(x0, y0, z0, hash(i, j, k, seed), d);
+			n += corner(x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3, hash(i + i1, j + j1, k + k1, seed), d);
+			n += corner(x0 - i2 + T(2) * G3, y0 - j2 + T(2) * G3, z0 - k2 + T(2) * G3, hash(i + i2, j + j2, k + k2, seed), d);
+			n += corner(x0 - T(1) + T(3) * G3, y0 - T(1) + T(3) * G3, z0 - T(1) + T(3) * G3, hash(i + 1, j + 1, k + 1, seed), d);
+			// scale to about [-1, 1]
+			if (d)
+			{
+				d[0] *= T(76);
+				d[1] *= T(76);
+				d[2] *= T(76);
+			}
+			return T(76) * n;
+		}
+
+		static T basis(NoiseBasis type, T x, T y, T z, unsigned int seed, T *d)
+		{
+			return (type == NOISE_SIMPLEX) ? simplex(x, y, z, seed, d) : perlin(x, y, z, seed, d);
+		}
+
+		template <bool absolute>
+		T fractal(T x, T y, T z, int octaves, T lacunarity, T gain, NoiseBasis type, T *d) const
+		{
+			T sum = T(0), amplitude = T(1), frequency = T(1);
+			if (d) d[0] = d[1] = d[2] = T(0);
+			for (int o = 0; o < octaves; ++o)
+			{
+				T nd[3];
+				T n = basis(type, x * frequency, y * frequency, z * frequency, octaveSeed(m_seed, o), d ? nd : 0);
+				T sign = T(1);
+				if (absolute && (n < T(0)))
+				{
+					n = -n;
+					sign = T(-1);
+				}
+				sum += amplitude * n;
+				if (d)
+				{
+					const T scale = sign * amplitude * frequency;
+					d[0] += scale * nd[0];
+					d[1] += scale * nd[1];
+					d[2] += scale * nd[2];
+				}
+				amplitude *= gain;
+				frequency *= lacunarity;
+			}
+			return sum;
+		}
+
+	public:
+		explicit NoiseGenerator(unsigned int seed = 0) : m_seed(seed) {}
+		void SetSeed(unsigned int seed) { m_seed = seed; }
+		unsigned int GetSeed() const { return m_seed; }
+
+		//! Improved Perlin noise in about [-1, 1]
+		/*!
+		 * @param d Receives the gradient if not 0
+		 */
+		T Perlin(T x, T y, T z, T *d = 0) const { return perlin(x, y, z, m_seed, d); }
+		//! Simplex noise in about [-1, 1], cheaper than Perlin noise and without axis aligned artefacts
+		T Simplex(T x, T y, T z, T *d = 0) const { return simplex(x, y, z, m_seed, d); }
+
+		//! Cellular noise with one feature point per unit cell
+		/*!
+		 * @param f1 Distance to the nearest feature point
+		 * @param f2 Distance to the second nearest feature point
+		 * @param id Receives a random id of the nearest feature point if not 0
+		 * @param d1 Receives the gradient of f1 if not 0
+		 */
+		void Worley(T x, T y, T z, T &f1, T &f2, unsigned int *id = 0, T *d1 = 0) const
+		{
+			const T x0 = std::floor(x), y0 = std::floor(y), z0 = std::floor(z);
+			const int ix = static_cast<int>(x0), iy = static_cast<int>(y0), iz = static_cast<int>(z0);
+			const T fx = x - x0, fy = y - y0, fz = z - z0;
+			T d1sq = T(1e10), d2sq = T(1e10);
+			T nearest[3] = { 0, 0, 0 };
+			unsigned int nearId = 0;
+			const T scale = T(1.0 / 1024.0);
+			for (int dz = -1; dz <= 1; ++dz)
+			{
+				for (int dy = -1; dy <= 1; ++dy)
+				{
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						const unsigned int h = hash(ix + dx, iy + dy, iz + dz, m_seed);
+						// offset of the point from the sample position
+						const T px = dx + (static_cast<T>(h & 0x3FF) + T(0.5)) * scale - fx;
+						const T py = dy + (static_cast<T>((h >> 10) & 0x3FF) + T(0.5)) * scale - fy;
+						const T pz = dz + (static_cast<T>((h >> 20) & 0x3FF) + T(0.5)) * scale - fz;
+						const T dist = px * px + py * py + pz * pz;
+						if (dist < d1sq)
+						{
+							d2sq = d1sq;
+							d1sq = dist;
+							nearest[0] = px;
+							nearest[1] = py;
+							nearest[2] = pz;
+							nearId = h;
+						}
+						else if (dist < d2sq)
+						{
+							d2sq = dist;
+						}
+					}
+				}
+			}
+			f1 = std::sqrt(d1sq);
+			f2 = std::sqrt(d2sq);
+			if (id) *id = nearId;
+			if (d1)
+			{
+				const T inv = (f1 > T(0)) ? T(-1) / f1 : T(0);
+				d1[0] = nearest[0] * inv;
+				d1[1] = nearest[1] * inv;
+				d1[2] = nearest[2] * inv;
+			}
+		}
+
+		//! Fractal sum of noise
+		/*!
+		 * @param octaves Number of noise layers
+		 * @param lacunarity Frequency factor between octaves
+		 * @param gain Amplitude factor between octaves
+		 * @param d Receives the gradient if not 0
+		 */
+		T fBm(T x, T y, T z, int octaves, T lacunarity = T(2), T gain = T(0.5), NoiseBasis type = NOISE_PERLIN, T *d = 0) const
+		{
+			return fractal<false>(x, y, z, octaves, lacunarity, gain, type, d);
+		}
+		//! Fractal sum of the absolute value of noise
+		T Turbulence(T x, T y, T z, int octaves, T lacunarity = T(2), T gain = T(0.5), NoiseBasis type = NOISE_PERLIN, T *d = 0) const
+		{
+			return fractal<true>(x, y, z, octaves, lacunarity, gain, type, d);
+		}
+
+		//! Divergence free vector noise, the curl of a vector potential of three fBm fields
+		void Curl(T x, T y, T z, T out[3], int octaves = 1, T lacunarity = T(2), T gain = T(0.5)) const
+		{
+			T dx[3], dy[3], dz[3];
+			NoiseGenerator px(hash(1, 0, 0, m_seed)), py(hash(0, 1, 0, m_seed)), pz(hash(0, 0, 1, m_seed));
+			px.fBm(x, y, z, octaves, lacunarity, gain, NOISE_PERLIN, dx);
+			py.fBm(x, y, z, octaves, lacunarity, gain, NOISE_PERLIN, dy);
+			pz.fBm(x, y, z, octaves, lacunarity, gain, NOISE_PERLIN, dz);
+			out[0] = dz[1] - dy[2];
+			out[1] = dx[2] - dz[0];
+			out[2] = dy[0] - dx[1];
+		}
+
+		/*!
+		 * @name Batch evaluation
+		 * Evaluate n points given as separate coordinate arrays. Gradient arrays are optional.
+		 */
+		//@{
+		void Perlin(size_t n, const T *x, const T *y, const T *z, T *out, T *dx = 0, T *dy = 0, T *dz = 0) const
+		{
+			if (dx && dy && dz)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					T d[3];
+					out[i] = perlin(x[i], y[i], z[i], m_seed, d);
+					dx[i] = d[0];
+					dy[i] = d[1];
+					dz[i] = d[2];
+				}
+				return;
+			}
+			for (size_t i = 0; i < n; ++i) out[i] = perlin(x[i], y[i], z[i], m_seed, 0);
+		}
+		void Simplex(size_t n, const T *x, const T *y, const T *z, T *out, T *dx = 0, T *dy = 0, T *dz = 0) const
+		{
+			if (dx && dy && dz)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					T d[3];
+					out[i] = simplex(x[i], y[i], z[i], m_seed, d);
+					dx[i] = d[0];
+					dy[i] = d[1];
+					dz[i] = d[2];
+				}
+				return;
+			}
+			for (size_t i = 0; i < n; ++i) out[i] = simplex(x[i], y[i], z[i], m_seed, 0);
+		}
+		void Worley(size_t n, const T *x, const T *y, const T *z, T *f1, T *f2, unsigned int *id = 0) const
+		{
+			for (size_t i = 0; i < n; ++i) Worley(x[i], y[i], z[i], f1[i], f2[i], id ? id + i : 0);
+		}
+		//! Octave by octave over all points, which keeps the inner loop free of the octave logic
+		void fBm(size_t n, const T *x, const T *y, const T *z, T *out, int octaves, T lacunarity = T(2), T gain = T(0.5), NoiseBasis type = NOISE_PERLIN) const
+		{
+			for (size_t i = 0; i < n; ++i) out[i] = T(0);
+			T amplitude = T(1), frequency = T(1);
+			for (int o = 0; o < octaves; ++o)
+			{
+				const unsigned int seed = octaveSeed(m_seed, o);
+				if (type == NOISE_SIMPLEX)
+				{
+					for (size_t i = 0; i < n; ++i) out[i] += amplitude * simplex(x[i] * frequency, y[i] * frequency, z[i] * frequency, seed, 0);
+				}
+				else
+				{
+					for (size_t i = 0; i < n; ++i) out[i] += amplitude * perlin(x[i] * frequency, y[i] * frequency, z[i] * frequency, seed, 0);
+				}
+				amplitude *= gain;
+				frequency *= lacunarity;
+			}
+		}
+		void Turbulence(size_t n, const T *x, const T *y, const T *z, T *out, int octaves, T lacunarity = T(2), T gain = T(0.5), NoiseBasis type = NOISE_PERLIN) const
+		{
+			for (size_t i = 0; i < n; ++i) out[i] = T(0);
+			T amplitude = T(1), frequency = T(1);
+			for (int o = 0; o < octaves; ++o)
+			{
+				const unsigned int seed = octaveSeed(m_seed, o);
+				if (type == NOISE_SIMPLEX)
+				{
+					for (size_t i = 0; i < n; ++i) out[i] += amplitude * std::fabs(simplex(x[i] * frequency, y[i] * frequency, z[i] * frequency, seed, 0));
+				}
+				else
+				{
+					for (size_t i = 0; i < n; ++i) out[i] += amplitude * std::fabs(perlin(x[i] * frequency, y[i] * frequency, z[i] * frequency, seed, 0));
+				}
+				amplitude *= gain;
+				frequency *= lacunarity;
+			}
+		}
+		void Curl(size_t n, const T *x, const T *y, const T *z, T *cx, T *cy, T *cz, int octaves = 1, T lacunarity = T(2), T gain = T(0.5)) const
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				T c[3];
+				Curl(x[i], y[i], z[i], c, octaves, lacunarity, gain);
+				cx[i] = c[0];
+				cy[i] = c[1];
+				cz[i] = c[2];
+			}
+		}
+		//@}
+	};
+
+	typedef NoiseGenerator<float> Noisef;
+	typedef NoiseGenerator<double> Noise;
+} // end namespace lwpp
+
+#endif // LWPP_NOISE_H
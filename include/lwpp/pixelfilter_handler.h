@@ -2,6 +2,9 @@
 #define LWPP_PIXELFILTER_HANDLER_H
 
 #include "lwpp/imagefilter_handler.h"
+#include <algorithm>
+#include <string>
+#include <vector>
 
 namespace lwpp
 {
@@ -57,6 +60,213 @@ namespace lwpp
     }
 	};
 
+	//! A buffer read by a PixelBatchKernel
+	struct PixelBufferSlot
+	{
+		const char *name;	//!< Buffer name as passed to LightWave
+		int channels;			//!< Number of float channels read from the buffer
+		int offset;				//!< Index of the first channel within a PixelBatch
+	};
+
+	//! Input and output of a number of pixels as a structure of arrays
+	/*!
+	 * Input(slot, channel)[i] is channel of the buffer slot for pixel i, Output(c)[i] is the resulting RGBA.
+	 * The output is initialised with the final render RGBA.
+	 */
+	class PixelBatch
+	{
+		const float * const *m_in;
+		float * const *m_out;
+		const PixelBufferSlot *m_slots;
+	public:
+		int count;	//!< Number of pixels in the batch
+		int x;			//!< Column of the first pixel, 0 when evaluating single pixels
+		int y;			//!< Scanline of the batch, 0 when evaluating single pixels
+		double sx;	//!< Screen position of a single pixel
+		double sy;
+
+		PixelBatch(const float * const *in, float * const *out, const PixelBufferSlot *slots, int n)
+			: m_in(in), m_out(out), m_slots(slots), count(n), x(0), y(0), sx(0.0), sy(0.0)
+		{
+			;
+		}
+		const float *Input(int slot, int channel = 0) const
+		{
+			return m_in[m_slots[slot].offset + channel];
+		}
+		float *Output(int channel)
+		{
+			return m_out[channel];
+		}
+	};
+
+	//! Evaluates a pixel filter on batches of pixels
+	/*!
+	 * @ingroup Helper
+	 * Buffers are requested once per frame by name in UpdateBuffers() and then addressed by the returned index,
+	 * so the plugin doesn't compare names per pixel. Slot 0 is always the final render RGBA.
+	 * @note LWPixelAccess::getVal() only takes buffer names, so LightWave still looks up every buffer for every
+	 * pixel of a pixel filter. Image filters read the scanlines directly and avoid that.
+	 * The same EvaluateBatch() serves single pixels of a pixel filter (EvaluatePixel()) and whole scanlines of an
+	 * image filter (ProcessLines()), where the buffers are read straight from the scanlines without copying.
+	 */
+	class PixelBatchKernel
+	{
+		std::vector<std::string> m_names;
+		std::vector<PixelBufferSlot> m_slots;
+		int m_channels;
+
+		struct Scratch
+		{
+			std::vector<float> values;
+			std::vector<const float *> in;
+			std::vector<float> out;
+			float *outPtr[4];
+		};
+		static Scratch &scratch()
+		{
+			static thread_local Scratch s;
+			return s;
+		}
+	protected:
+		//! Request a buffer, only valid within UpdateBuffers()
+		/*!
+		 * @return the slot index used to access the buffer in the PixelBatch
+		 */
+		int UseBuffer(const std::string &name, int channels)
+		{
+			for (size_t i = 0; i < m_names.size(); ++i)
+			{
+				if (m_names[i] == name)
+				{
+					m_slots[i].channels = std::max(m_slots[i].channels, channels);
+					return static_cast<int>(i);
+				}
+			}
+			m_names.push_back(name);
+			PixelBufferSlot slot = { nullptr, channels, 0 };
+			m_slots.push_back(slot);
+			return static_cast<int>(m_slots.size() - 1);
+		}
+		//! Request the buffers used by EvaluateBatch()
+		virtual void UpdateBuffers() {;}
+		//! Filter a batch of pixels
+		virtual void EvaluateBatch(PixelBatch &batch) = 0;
+
+	public:
+		PixelBatchKernel() : m_channels(4) {;}
+		virtual ~PixelBatchKernel() {;}
+
+		const std::vector<PixelBufferSlot> &getSlots() const { return m_slots; }
+
+		//! Rebuild the buffer table, call once per frame from UpdateFlags()
+		void RebuildBufferTable(BufferNameSet &used)
+		{
+			m_names.clear();
+			m_slots.clear();
+			UseBuffer(LWBUFFER_FINAL_RENDER_RGBA, 4);
+			UpdateBuffers();
+			m_channels = 0;
+			for (size_t i = 0; i < m_slots.size(); ++i)
+			{
+				m_slots[i].name = m_names[i].c_str();
+				m_slots[i].offset = m_channels;
+				m_channels += m_slots[i].channels;
+				used.insert(m_names[i]);
+			}
+		}
+
+		//! Filter a single pixel of a pixel filter
+		void EvaluatePixel(const LWPixelAccess *pfa)
+		{
+			if (m_slots.empty()) return;
+			Scratch &s = scratch();
+			s.values.resize(m_channels);
+			s.in.resize(m_channels);
+			s.out.resize(4);
+			for (int c = 0; c < m_channels; ++c) s.in[c] = &s.values[c];
+			for (auto &slot : m_slots)
+			{
+				pfa->getVal(slot.name, slot.channels, &s.values[slot.offset]);
+			}
+			for (int c = 0; c < 4; ++c)
+			{
+				s.out[c] = s.values[c];
+				s.outPtr[c] = &s.out[c];
+			}
+			PixelBatch batch(s.in.data(), s.outPtr, m_slots.data(), 1);
+			batch.sx = pfa->sx;
+			batch.sy = pfa->sy;
+			EvaluateBatch(batch);
+			pfa->setRGBA(s.out.data());
+		}
+
+		//! Filter a whole image a scanline at a time, for use in ImageFilterHandler::Process()
+		LWError ProcessLines(const LWFilterAccess *fa)
+		{
+			if (m_slots.empty()) return 0;
+			Scratch &s = scratch();
+			const int width = fa->width;
+			s.values.assign(width, 0.0f); // used for missing buffers
+			s.in.resize(m_channels);
+			s.out.resize(4 * width);
+			for (int c = 0; c < 4; ++c) s.outPtr[c] = &s.out[c * width];
+
+			for (int y = 0; y < fa->height; ++y)
+			{
+				for (auto &slot : m_slots)
+				{
+					for (int c = 0; c < slot.channels; ++c)
+					{
+						const float *line = fa->getLine(slot.name, c, y);
+						s.in[slot.offset + c] = line ? line : s.values.data();
+					}
+				}
+				for (int c = 0; c < 4; ++c)
+				{
+					const float *line = s.in[c];
+					std::copy(line, line + width, s.outPtr[c]);
+				}
+				PixelBatch batch(s.in.data(), s.outPtr, m_slots.data(), width);
+				batch.y = y;
+				EvaluateBatch(batch);
+				for (int x = 0; x < width; ++x)
+				{
+					float rgb[3] = { s.outPtr[0][x], s.outPtr[1][x], s.outPtr[2][x] };
+					fa->setRGB(x, y, rgb);
+					fa->setAlpha(x, y, s.outPtr[3][x]);
+				}
+			}
+			return 0;
+		}
+	};
+
+	//! Pixel filter that evaluates a PixelBatchKernel
+	/*!
+	 * @ingroup Handler
+	 * Base may be PixelFilterHandler, XPanelPixelFilterHandler or LWPanelPixelFilterHandler.
+	 * Implement UpdateBuffers() and EvaluateBatch() instead of UpdateFlags() and Evaluate().
+	 * The per pixel scratch memory is thread local, so the filter stays LWPFF_MULTITHREADED.
+	 */
+	template <class Base>
+	class BatchedPixelFilter : public Base, public PixelBatchKernel
+	{
+	public:
+		BatchedPixelFilter(void *g, void *context, LWError *err)
+			: Base(g, context, err)
+		{
+			;
+		}
+		virtual void UpdateFlags()
+		{
+			RebuildBufferTable(this->m_bufferNameSet);
+		}
+		virtual void Evaluate(const LWPixelAccess *pfa)
+		{
+			EvaluatePixel(pfa);
+		}
+	};
+
 	//! @ingroup Adaptor
 	template <class T, int Version>
 	class PixelFilterAdaptor : public InstanceAdaptor <T>, public ItemAdaptor <T> , public RenderAdaptor<T>
@@ -94,6 +304,7 @@ namespace lwpp
 	private:
 		static void Evaluate (LWInstance inst, const LWPixelAccess* ma)
 		{
+			LWPP_PROFILE_CALLBACK(T, "PixelFilter::Evaluate");
 			T* plugin = static_cast<T*>(inst);
 			plugin->Evaluate(ma);
 		}
@@ -119,5 +330,12 @@ namespace lwpp
 	IMPLEMENT_LWPANELHANDLER(PixelFilter);
 	//! @ingroup LWPanelAdaptor
 	IMPLEMENT_LWPANELADAPTOR(PixelFilter, LWPIXELFILTER_VERSION);
+
+	//! @ingroup Handler
+	typedef BatchedPixelFilter<PixelFilterHandler> BatchedPixelFilterHandler;
+	//! @ingroup XPanelHandler
+	typedef BatchedPixelFilter<XPanelPixelFilterHandler> XPanelBatchedPixelFilterHandler;
+	//! @ingroup LWPanelHandler
+	typedef BatchedPixelFilter<LWPanelPixelFilterHandler> LWPanelBatchedPixelFilterHandler;
 }
 #endif // LWPP_PIXELFILTER_HANDLER_H
\ No newline at end of file
@@ -58,11 +58,18 @@
 * If you don't have this file, write to the Free Software Foundation, Inc.,
 * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 ******************************************************************************/
+#define DT_UNKNOWN 0
+#define DT_DIR 4
+#define DT_REG 8
+
 struct dirent
 {
   long d_ino; /* unique file number */
   off_t d_off; /*offset of this file within the director*/
   unsigned short d_reclen; /*length of this entry*/
+  unsigned char d_type; /*DT_DIR or DT_REG*/
+  unsigned long long d_size; /*size of the file, not POSIX*/
+  time_t d_mtime; /*time of the last modification, not POSIX*/
   char d_name[MAX_PATH]; /*name of the entry*/
 };
 
@@ -74,6 +81,7 @@ typedef struct DIR_
   int position;
   WIN32_FIND_DATA findData;
   char d_name[MAX_PATH];
+  struct dirent entry; /*returned by readdir, so separate directories can be read by separate threads*/
 }DIR;
 
 int            closedir(DIR *);
@@ -8,6 +8,7 @@
 #include <lwpp/dynamicHints.h>
 #include "lwpp/item.h"
 #include "lwpp/customobject_access.h"
+#include "lwpp/profiler.h"
 
 #pragma warning( push )
 #pragma warning( disable : 4100 )
@@ -323,6 +324,7 @@ namespace lwpp
 
 		static LWError NewTime (LWInstance instance, LWFrame frame, LWTime time)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Render::NewTime");
 			try
 			{
 				T *plugin = static_cast<T *>(instance);
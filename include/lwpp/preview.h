@@ -2,6 +2,14 @@
 #define LWPP_PREVIEW_H
 
 #include <lwpreview.h>
+#include <lwpp/threads.h>
+#include <lwpp/timer.h>
+#include <lwpp/math.h>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 namespace lwpp
 {
@@ -82,6 +90,326 @@ namespace lwpp
 		void getView(int *width, int *height, double *pixelAspect) {globPtr->getView(width, height, pixelAspect);}
 		void setPreset(PreviewCallbacks *prevCB) {globPtr->setPreset(id, prevCB->presetFunc);}
 	};
+	//! Preview renderer that refines the image progressively on a thread pool
+	/*!
+	 * Implement ShadeSample(), and BeginPreview() to set up shading state per worker. The state is reused for all
+	 * passes of a render. The image is rendered by a background thread in passes:
+	 * - blocks of coarseBlock pixels, halving the block size down to single pixels
+	 * - refinement passes adding one jittered sample to every pixel whose noise is still above noiseThreshold,
+	 *   up to maxSamples samples per pixel
+	 *
+	 * previewEvaluate() answers the host with the latest finished pass. With a Preview set by setPreview(), the
+	 * host is asked for another sweep whenever a newer pass is available, until the image is complete. Newer passes
+	 * are polled for with a host timer, so the interface isn't blocked while a pass renders.
+	 * StopPreview() cancels the render, call it from the destructor of the derived class and whenever the previewed
+	 * settings change.
+	 */
+	class ProgressivePreview : public PreviewCallbacks
+	{
+		struct PixelState
+		{
+			float sum[4];
+			float lumaSquared;
+			int count;
+		};
+		Preview *preview = nullptr;
+		ThreadGroup *driver = nullptr;
+		int width = 0;
+		int height = 0;
+		unsigned int workers = 1;
+		std::vector<PixelState> pixels;
+		std::vector<float> back;		//!< Pass being rendered
+		std::vector<float> front;		//!< Last finished pass, shown to the host
+		std::atomic<bool> cancelled;
+		bool complete = false;
+		int published = 0;					//!< Number of finished passes
+		int shown = 0;							//!< Passes shown by the last sweep
+		int swept = 0;							//!< Pixels evaluated in the current sweep
+		bool refreshing = false;
+		bool restart = true;				//!< Start a new render with the next evaluation
+		bool begun = false;					//!< BeginPreview() succeeded, EndPreview() is due
+		std::mutex lock;
+		std::condition_variable passDone;
+
+		//! Polls for a newer pass from a host timer
+		/*!
+		 * Timers can't be removed per instance, so the poll outlives a destroyed preview until it fires again.
+		 */
+		struct RefreshPoll
+		{
+			ProgressivePreview *owner;
+			bool TimerEvent()
+			{
+				if (owner && !owner->pollRefresh()) return false;
+				if (owner) owner->poll = nullptr;
+				delete this;
+				return true;
+			}
+		};
+		RefreshPoll *poll = nullptr;
+		static const unsigned int PollInterval = 50; //!< ms
+
+		//! Ask the host for another sweep if a newer pass is available
+		/*!
+		 * @return false if a newer pass is still to come
+		 */
+		bool pollRefresh()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (cancelled || (swept == 0)) return true;
+				if (published <= shown) return complete;
+				refreshing = true;
+			}
+			preview->startRender();
+			return true;
+		}
+		void detachPoll()
+		{
+			if (poll) poll->owner = nullptr;
+			poll = nullptr;
+		}
+
+		void sample(int x, int y, double sx, double sy, unsigned int worker)
+		{
+			float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			ShadeSample(x + sx, y + sy, width, height, worker, rgba);
+			PixelState &p = pixels[static_cast<size_t>(y) * width + x];
+			for (int c = 0; c < 4; ++c) p.sum[c] += rgba[c];
+			const float luma = (rgba[0] + rgba[1] + rgba[2]) / 3.0f;
+			p.lumaSquared += luma * luma;
+			++p.count;
+		}
+		void fill(int x0, int y0, int size)
+		{
+			const PixelState &p = pixels[static_cast<size_t>(y0) * width + x0];
+			const float scale = p.count ? 1.0f / p.count : 0.0f;
+			for (int y = y0; y < std::min(y0 + size, height); ++y)
+			{
+				for (int x = x0; x < std::min(x0 + size, width); ++x)
+				{
+					float *d = &back[4 * (static_cast<size_t>(y) * width + x)];
+					for (int c = 0; c < 4; ++c) d[c] = p.sum[c] * scale;
+				}
+			}
+		}
+		//! Standard error of the luminance of a pixel
+		float noise(const PixelState &p) const
+		{
+			if (p.count < 2) return 1e30f;
+			const float mean = (p.sum[0] + p.sum[1] + p.sum[2]) / (3.0f * p.count);
+			const float variance = std::max(p.lumaSquared / p.count - mean * mean, 0.0f);
+			return std::sqrt(variance / p.count);
+		}
+		void publish(bool last)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				front = back;
+				++published;
+				complete = last;
+			}
+			passDone.notify_all();
+		}
+		void run()
+		{
+			// coarse to fine blocks, each pass samples the corners not sampled by the previous one
+			int block = 1;
+			while (block * 2 <= coarseBlock) block *= 2;
+			for (bool first = true; block >= 1; block /= 2, first = false)
+			{
+				const int rows = (height + block - 1) / block;
+				ParallelFor(0, rows, 1, [&](size_t b, size_t e, unsigned int worker)
+				{
+					for (int row = static_cast<int>(b); (row < static_cast<int>(e)) && !cancelled; ++row)
+					{
+						const int y = row * block;
+						for (int x = 0; x < width; x += block)
+						{
+							if (first || (x % (2 * block)) || (y % (2 * block))) sample(x, y, 0.5, 0.5, worker);
+							fill(x, y, block);
+						}
+					}
+				}, workers);
+				if (cancelled) return;
+				publish((block == 1) && (maxSamples <= 1));
+			}
+
+			// adaptive refinement
+			for (int pass = 1; pass < maxSamples; ++pass)
+			{
+				std::atomic<int> refined(0);
+				ParallelFor(0, height, 4, [&](size_t b, size_t e, unsigned int worker)
+				{
+					int count = 0;
+					for (int y = static_cast<int>(b); (y < static_cast<int>(e)) && !cancelled; ++y)
+					{
+						for (int x = 0; x < width; ++x)
+						{
+							PixelState &p = pixels[static_cast<size_t>(y) * width + x];
+							if ((p.count >= maxSamples) || (noise(p) <= noiseThreshold)) continue;
+							// R2 sequence, rotated per pixel
+							const unsigned int hash = (static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u);
+							const double rx = (hash & 0xffff) / 65536.0, ry = (hash >> 16) / 65536.0;
+							double sx = 0.5 + rx + p.count * 0.7548776662466927, sy = 0.5 + ry + p.count * 0.5698402909980532;
+							sample(x, y, sx - std::floor(sx), sy - std::floor(sy), worker);
+							fill(x, y, 1);
+							++count;
+						}
+					}
+					refined += count;
+				}, workers);
+				if (cancelled) return;
+				const bool last = (refined == 0) || (pass + 1 >= maxSamples);
+				publish(last);
+				if (last) return;
+			}
+		}
+		static int driverFunc(void *arg)
+		{
+			static_cast<ProgressivePreview *>(arg)->run();
+			return 0;
+		}
+		void start(int w, int h)
+		{
+			cancel();
+			width = w;
+			height = h;
+			workers = maxThreads ? maxThreads : ParallelThreadCount();
+			PixelState empty = { { 0.0f, 0.0f, 0.0f, 0.0f }, 0.0f, 0 };
+			pixels.assign(static_cast<size_t>(w) * h, empty);
+			back.assign(4 * static_cast<size_t>(w) * h, 0.0f);
+			front.clear();
+			published = shown = swept = 0;
+			complete = false;
+			cancelled = false;
+			begun = (w > 0) && (h > 0) && BeginPreview(w, h, workers);
+			if (!begun)
+			{
+				complete = true;
+				return;
+			}
+			driver = new ThreadGroup(1);
+			driver->addThread(driverFunc, 0, this);
+			if ((driver->getThreadCount() != 1) || !driver->begin())
+			{
+				delete driver;
+				driver = nullptr;
+				run();
+			}
+		}
+		void cancel()
+		{
+			cancelled = true;
+			passDone.notify_all();
+			if (driver)
+			{
+				driver->sync();
+				delete driver;
+				driver = nullptr;
+			}
+			if (begun)
+			{
+				begun = false;
+				EndPreview();
+			}
+		}
+	protected:
+		//! Number of threads to shade with, 0 for ParallelThreadCount()
+		unsigned int maxThreads = 0;
+		//! Size of the blocks of the first pass in pixels
+		int coarseBlock = 16;
+		//! Maximum number of samples per pixel
+		int maxSamples = 16;
+		//! Standard error of the pixel luminance below which a pixel is not refined any more
+		float noiseThreshold = 0.005f;
+
+		//! Called before the first pass with the number of workers, set up the shading state here
+		/*!
+		 * @return false to render nothing
+		 */
+		virtual bool BeginPreview(int w, int h, unsigned int numWorkers) { UNUSED(w); UNUSED(h); UNUSED(numWorkers); return true; }
+		//! Shade a sample, called from worker threads
+		/*!
+		 * @param x, y Position in pixels from the top left corner, including the offset within the pixel
+		 * @param worker Index of the calling thread, smaller than numWorkers of BeginPreview()
+		 * @param rgba Colour and alpha of the sample, alpha is preset to 1
+		 */
+		virtual void ShadeSample(double x, double y, int w, int h, unsigned int worker, float rgba[4]) = 0;
+		//! Called after the render was finished or cancelled
+		virtual void EndPreview() {}
+
+		virtual int previewInit(bool manual)
+		{
+			UNUSED(manual);
+			std::lock_guard<std::mutex> guard(lock);
+			// unless this is a refresh sweep, a new render starts with the size of the first evaluation
+			if (!refreshing) restart = true;
+			refreshing = false;
+			swept = 0;
+			return 0;
+		}
+		virtual int previewEvaluate(int w, int h, PvSample *pixel)
+		{
+			if (restart || (w != width) || (h != height))
+			{
+				restart = false;
+				start(w, h);
+			}
+			std::unique_lock<std::mutex> guard(lock);
+			passDone.wait(guard, [&] { return cancelled || complete || (published > 0); });
+			if (front.empty()) return 0;
+			const int x = Clamp(pixel->x, 0, width - 1), y = Clamp(pixel->y, 0, height - 1);
+			const float *c = &front[4 * (static_cast<size_t>(y) * width + x)];
+			pixel->rgb[0] = c[0];
+			pixel->rgb[1] = c[1];
+			pixel->rgb[2] = c[2];
+			pixel->alpha = c[3];
+			if (++swept == 1) shown = published;
+			return 0;
+		}
+		virtual void previewCleanup()
+		{
+			if (!preview || poll || pollRefresh()) return;
+			// don't block the interface until the next pass is finished, poll for it
+			Timer timer;
+			if (!timer.available()) return;
+			poll = new RefreshPoll{ this };
+			timer.addTimer(poll, PollInterval);
+		}
+		virtual void previewClose()
+		{
+			detachPoll();
+			cancel();
+		}
+	public:
+		ProgressivePreview() : cancelled(false) {}
+		virtual ~ProgressivePreview()
+		{
+			detachPoll();
+			cancel();
+		}
+		//! Preview to refresh while the image is refined
+		void setPreview(Preview *p) { preview = p; }
+		//! Cancel the render and stop the preview
+		void StopPreview()
+		{
+			cancel();
+			restart = true;
+			if (preview) preview->stopRender();
+		}
+		bool isComplete()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return complete;
+		}
+		//! Number of passes finished so far
+		int FinishedPasses()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return published;
+		}
+	};
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+/*!
+ * @file
+ * @brief Bounding volume hierarchy over spheres, triangles and curves for Primitive plugins
+ */
+#ifndef LWPP_PRIMITIVE_BVH_H
+#define LWPP_PRIMITIVE_BVH_H
+
+#include <lwpp/point3d.h>
+#include <lwpp/vector3d.h>
+#include <vector>
+
+namespace lwpp
+{
+	//! Compact bounding volume hierarchy over simple geometric primitives
+	/*!
+	 * @ingroup Helper
+	 * Holds spheres, triangles and curve segments, each either static or moving linearly between two keys.
+	 * Keys are given for the fractional time 0 (shutter open) and 1 (shutter close), primitives may also exist
+	 * for part of the shutter interval only, such as debris that is spawned during the frame.
+	 *
+	 * Curve segments are round: a cylinder between two points capped with hemispheres, which is what hair and fur
+	 * are usually rendered as.
+	 *
+	 * The tree is built with a binned surface area heuristic and flattened into 32 byte nodes.
+	 * Fill and Build() it in NewFrame(), all queries are const and thread safe.
+	 * @code
+	 * bvh.Clear();
+	 * for (auto &strand : hair) for (size_t i = 1; i < strand.size(); ++i) bvh.AddCurve(strand[i - 1], strand[i], radius, id);
+	 * bvh.Build();
+	 * @endcode
+	 */
+	class PrimitiveBVH
+	{
+	public:
+		enum PrimitiveType
+		{
+			PRIM_SPHERE,
+			PRIM_TRIANGLE,
+			PRIM_CURVE
+		};
+
+		struct Ray
+		{
+			Point3d origin;
+			Vector3d dir;
+			double tMin;
+			double tMax;
+			double time;	//!< Fractional time within the shutter interval, 0 to 1
+			Ray() : tMin(0.0), tMax(1e30), time(0.0) {}
+			Ray(const Point3d &o, const Vector3d &d, double t = 0.0) : origin(o), dir(d), tMin(0.0), tMax(1e30), time(t) {}
+		};
+
+		//! Result of a query
+		struct Hit
+		{
+			double t;								//!< Ray parameter, or distance for NearestPoint()
+			unsigned int primitive;	//!< Index of the primitive in the order of adding
+			unsigned int id;				//!< User id of the primitive
+			PrimitiveType type;
+			double u, v;						//!< Barycentric for triangles, spherical for spheres, along and around for curves
+			Point3d p;
+			Vector3d n;							//!< Normal, not flipped towards the ray
+			Vector3d dPdu;
+			Vector3d dPdv;
+		};
+
+		PrimitiveBVH();
+		void Clear();
+		//! Reserve storage for a number of primitives
+		void Reserve(size_t count);
+
+		/*!
+		 * @name Adding primitives
+		 * All return the index of the primitive. The tree needs to be rebuilt after adding primitives.
+		 */
+		//@{
+		unsigned int AddSphere(const Point3d &centre, double radius, unsigned int id = 0);
+		unsigned int AddSphere(const Point3d &centre0, double radius0, const Point3d &centre1, double radius1, unsigned int id = 0);
+		unsigned int AddTriangle(const Point3d &p0, const Point3d &p1, const Point3d &p2, unsigned int id = 0);
+		unsigned int AddTriangle(const Point3d key0[3], const Point3d key1[3], unsigned int id = 0);
+		unsigned int AddCurve(const Point3d &p0, const Point3d &p1, double radius, unsigned int id = 0);
+		unsigned int AddCurve(const Point3d &p0, const Point3d &p1, const Point3d &q0, const Point3d &q1, double radius, unsigned int id = 0);
+		//! Limit the existence of a primitive to part of the shutter interval
+		void SetTimeInterval(unsigned int primitive, double open, double close);
+		//@}
+
+		//! Build the tree, must be called before any query
+		void Build();
+		bool isValid() const { return !m_nodes.empty(); }
+		size_t PrimitiveCount() const { return m_prims.size(); }
+		size_t NodeCount() const { return m_nodes.size(); }
+		//! Depth of the deepest leaf, the root is at depth 0
+		int Depth() const { return m_depth; }
+		bool hasMotion() const { return m_motion; }
+		//! Bounds of all primitives over the whole shutter interval
+		bool Bounds(Point3d &min, Point3d &max) const;
+		//! Memory used by the primitives and the tree
+		size_t MemorySize() const;
+
+		//! Closest intersection within [ray.tMin, ray.tMax]
+		bool Intersect(const Ray &ray, Hit &hit) const;
+		//! Any intersection within [ray.tMin, ray.tMax], for shadow rays
+		bool Occluded(const Ray &ray) const;
+		//! Closest point on any primitive
+		/*!
+		 * @param maxDistance Points farther away are ignored
+		 */
+		bool NearestPoint(const Point3d &p, double time, double maxDistance, Hit &hit) const;
+
+		//! Total surface area at a time
+		double Area(double time) const;
+		//! Choose a point on the surface, roughly uniform by area
+		/*!
+		 * @param u Three uniform random numbers in [0, 1)
+		 */
+		bool Sample(double time, const double u[3], Point3d &p, Vector3d &n) const;
+		//! Density of Sample() with respect to area at a point of a primitive
+		double Pdf(unsigned int primitive, double time) const;
+
+	private:
+		struct Primitive
+		{
+			unsigned char type;
+			unsigned char motion;
+			unsigned short pad;
+			unsigned int id;
+			unsigned int data;	//!< Offset of the key(s) in m_data
+			unsigned int index;	//!< Index in the order of adding
+			float open;
+			float close;
+		};
+		//! Flattened node, the left child of an interior node directly follows it
+		struct Node
+		{
+			float min[3];
+			float max[3];
+			unsigned int offset;	//!< First primitive of a leaf or right child of an interior node
+			unsigned short count;	//!< Number of primitives, 0 for interior nodes
+			unsigned short axis;
+		};
+		struct BuildItem
+		{
+			float min[3];
+			float max[3];
+			float centre[3];
+			unsigned int prim;
+		};
+
+		unsigned int add(PrimitiveType type, bool motion, unsigned int id, const double *key0, const double *key1, size_t floats);
+		void primitiveBounds(const Primitive &prim, float min[3], float max[3]) const;
+		unsigned int build(std::vector<BuildItem> &items, size_t begin, size_t end, std::vector<Primitive> &ordered, int depth);
+		const float *key(const Primitive &prim, double time, float *scratch) const;
+		bool exists(const Primitive &prim, double time) const { return (time >= prim.open) && (time <= prim.close); }
+		bool intersect(const Primitive &prim, const Ray &ray, double tMax, Hit *hit) const;
+		double primitiveArea(const Primitive &prim, double time) const;
+		template <typename Visit>
+		void traverse(const Ray &ray, double &tMax, Visit visit) const;
+
+		std::vector<Primitive> m_prims;
+		std::vector<float> m_data;
+		std::vector<Node> m_nodes;
+		std::vector<unsigned int> m_order;	//!< Position in m_prims of each primitive by index
+		std::vector<double> m_areaCdf;
+		double m_area;
+		int m_depth;	//!< Depth of the deepest leaf
+		bool m_motion;
+	};
+} // end namespace lwpp
+
+#endif // LWPP_PRIMITIVE_BVH_H
@@ -3,6 +3,7 @@
 
 #include <lwpp/plugin_handler.h>
 #include <lwpp/customobject_access.h>
+#include <lwpp/primitive_bvh.h>
 #include <lwprimitive.h>
 
 namespace lwpp
@@ -52,6 +53,106 @@ namespace lwpp
 		virtual double VolumeSamplePhase(const LWPrimitiveInstance* pinst, const LWVolumeSpot*, const LWDVector sample, LWDVector wo) { return 0.0; }
 	};
 
+	//! Base class for Primitive plugins that keep their geometry in a PrimitiveBVH
+	/*!
+	* @ingroup Handler
+	* Fill bvh in NewFrame() and call bvh.Build(), Bounds, MemorySize, Intersect, NearestPoint, Area, Sample and Pdf are
+	* then answered by the tree. The fractional time of a ray selects the position of moving primitives.
+	*
+	* Rays and shading geometry are converted by GetRay() and SetGeometry(), override those to add texture coordinates
+	* or interpolated normals from the id of the primitive that was hit.
+	*/
+	class BVHPrimitiveHandler : public PrimitiveHandler
+	{
+	protected:
+		PrimitiveBVH bvh;
+
+		virtual void GetRay(const LWRay* ray, PrimitiveBVH::Ray &r)
+		{
+			r.origin = Point3d(ray->origin[0], ray->origin[1], ray->origin[2]);
+			r.dir = Vector3d(ray->dir[0], ray->dir[1], ray->dir[2]);
+			r.time = ray->time;
+		}
+		virtual void SetGeometry(const PrimitiveBVH::Hit &hit, const LWRay* ray, LWShadingGeometry* is)
+		{
+			UNUSED(ray);
+			is->P[0] = is->oP[0] = hit.p.x;
+			is->P[1] = is->oP[1] = hit.p.y;
+			is->P[2] = is->oP[2] = hit.p.z;
+			is->N[0] = is->gN[0] = hit.n.x;
+			is->N[1] = is->gN[1] = hit.n.y;
+			is->N[2] = is->gN[2] = hit.n.z;
+			is->u = hit.u;
+			is->v = hit.v;
+			is->dPdu[0] = hit.dPdu.x; is->dPdu[1] = hit.dPdu.y; is->dPdu[2] = hit.dPdu.z;
+			is->dPdv[0] = hit.dPdv.x; is->dPdv[1] = hit.dPdv.y; is->dPdv[2] = hit.dPdv.z;
+		}
+	public:
+		BVHPrimitiveHandler(void *g, void *context, LWError *err) : PrimitiveHandler(g, context, err) {}
+		virtual ~BVHPrimitiveHandler() {;}
+
+		virtual int Bounds(LWPrimitiveType, LWDVector min, LWDVector max, LWPrimitiveCoordinateSys*)
+		{
+			Point3d bmin, bmax;
+			if (!bvh.Bounds(bmin, bmax)) return 0;
+			min[0] = bmin.x; min[1] = bmin.y; min[2] = bmin.z;
+			max[0] = bmax.x; max[1] = bmax.y; max[2] = bmax.z;
+			return 1;
+		}
+		virtual size_t MemorySize() { return sizeof(*this) + bvh.MemorySize() - sizeof(bvh); }
+		virtual int Intersect(const LWPrimitiveInstance* pinst, const LWRay* ray, LWShadingGeometry* is)
+		{
+			UNUSED(pinst);
+			PrimitiveBVH::Ray r;
+			GetRay(ray, r);
+			PrimitiveBVH::Hit hit;
+			if (!bvh.Intersect(r, hit)) return 0;
+			SetGeometry(hit, ray, is);
+			return 1;
+		}
+		//! Closest point on the surface to the origin of the ray
+		virtual int NearestPoint(const LWPrimitiveInstance* pinst, const LWRay* ray, LWShadingGeometry* is)
+		{
+			UNUSED(pinst);
+			PrimitiveBVH::Ray r;
+			GetRay(ray, r);
+			PrimitiveBVH::Hit hit;
+			if (!bvh.NearestPoint(r.origin, r.time, r.tMax, hit)) return 0;
+			SetGeometry(hit, ray, is);
+			return 1;
+		}
+		virtual double Area(const LWPrimitiveInstance* pinst, LWTime fracTime)
+		{
+			UNUSED(pinst);
+			return bvh.Area(fracTime);
+		}
+		virtual int Sample(const LWPrimitiveInstance* pinst, LWTime fracTime, const LWDVector randomSample, LWDVector p, LWDVector n)
+		{
+			UNUSED(pinst);
+			Point3d sp;
+			Vector3d sn;
+			if (!bvh.Sample(fracTime, randomSample, sp, sn)) return 0;
+			p[0] = sp.x; p[1] = sp.y; p[2] = sp.z;
+			n[0] = sn.x; n[1] = sn.y; n[2] = sn.z;
+			return 1;
+		}
+		//! Density of Sample() with respect to solid angle, as seen from the origin of the ray
+		virtual double Pdf(const LWPrimitiveInstance* pinst, const LWRay* ray, const LWShadingGeometry* is)
+		{
+			UNUSED(pinst);
+			UNUSED(is);
+			PrimitiveBVH::Ray r;
+			GetRay(ray, r);
+			PrimitiveBVH::Hit hit;
+			// trace again to find the primitive, the shading geometry does not carry it
+			if (!bvh.Intersect(r, hit)) return 0.0;
+			const double len = r.dir.Magnitude();
+			const double cosine = std::fabs(Dot(hit.n, r.dir)) / len;
+			if (cosine <= 0.0) return 0.0;
+			return bvh.Pdf(hit.primitive, r.time) * Sqr(hit.t * len) / cosine;
+		}
+	};
+
 	//! Wrapper for a Primitive
 	/*!
 	* @ingroup Adaptor
@@ -160,6 +261,7 @@ namespace lwpp
 		}
 		static int Intersect(LWInstance inst, const LWPrimitiveInstance* pinst, const LWRay* ray, LWShadingGeometry* is)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Primitive::Intersect");
 			try
 			{
 				T *plugin = (T *)inst;
@@ -0,0 +1,172 @@
+/*!
+ * @file
+ * @brief Low overhead scoped profiler for plugin callbacks
+ *
+ * Zones are named code regions, a ProfileScope measures the time spent inside a zone.
+ * Each thread records into its own event buffer and per zone histogram, so recording
+ * never takes a lock. Profiling is switched on and off at runtime using Profiler::Enable(),
+ * or by setting the environment variable LWPP_PROFILE to the name of a Chrome trace file
+ * that is written when the plugin module is unloaded.
+ *
+ * Define LWPP_NO_PROFILER to compile all LWPP_PROFILE_* macros out,
+ * define LWPP_PROFILER_TSC to time using the CPU time stamp counter instead of std::chrono::steady_clock.
+ */
+#ifndef LWPP_PROFILER_H
+#define LWPP_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+
+#ifdef LWPP_PROFILER_TSC
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#elif defined(__i386__) || defined(__x86_64__)
+		#include <x86intrin.h>
+	#else
+		#undef LWPP_PROFILER_TSC
+	#endif
+#endif
+
+namespace lwpp
+{
+	//! Raw time stamp as recorded by the profiler
+	typedef std::uint64_t ProfileTicks;
+
+	//! Collected timings of a single zone
+	struct ProfileZoneStats
+	{
+		std::string name;
+		std::uint64_t count;
+		double total; //!< microseconds
+		double min; //!< microseconds
+		double max; //!< microseconds
+		//! Number of calls per bucket, bucket n holds calls taking between 2^(n-1) and 2^n ticks
+		std::uint64_t histogram[32];
+	};
+
+	//! Global profiler state
+	/*!
+	 * @ingroup Tools
+	 * All functions are static and may be called from any thread.
+	 * Reset(), GetZoneStats(), WriteReport() and WriteChromeTrace() should be called while
+	 * no zones are being recorded, i.e. outside of rendering, to get consistent results.
+	 */
+	class Profiler
+	{
+		static std::atomic<bool> s_enabled;
+	public:
+		static const unsigned int MaxZones = 256;
+		static const unsigned int HistogramBuckets = 32;
+		static const unsigned int EventsPerThread = 1 << 16;
+
+		//! Returns true if scopes should be recorded
+		static bool isEnabled()
+		{
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+		//! Switch recording on or off
+		static void Enable(bool enable = true);
+
+		//! Current time stamp
+		static ProfileTicks Now()
+		{
+#ifdef LWPP_PROFILER_TSC
+			return __rdtsc();
+#else
+			return static_cast<ProfileTicks>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+		}
+		//! Convert a difference of time stamps to microseconds
+		static double TicksToMicroseconds(ProfileTicks ticks);
+
+		//! Register a new zone, zones with identical names share their statistics
+		/*!
+		 * @return the id of the zone, or MaxZones if no more zones are available
+		 */
+		static unsigned int RegisterZone(const std::string &name);
+		//! Record a finished scope of a zone for the calling thread
+		static void Record(unsigned int zone, ProfileTicks start, ProfileTicks end);
+
+		//! Discard all recorded events and statistics
+		static void Reset();
+		//! Number of registered zones
+		static unsigned int ZoneCount();
+		//! Statistics of a zone, accumulated over all threads
+		static bool GetZoneStats(unsigned int zone, ProfileZoneStats &stats);
+		//! Write a plain text summary of all zones that have been hit
+		static void WriteReport(std::ostream &os);
+		//! Write the recorded events in the Chrome trace event format (chrome://tracing)
+		static bool WriteChromeTrace(const std::string &fileName);
+	};
+
+	//! A named region of code
+	/*!
+	 * @ingroup Tools
+	 * Usually created as a function local static by LWPP_PROFILE_SCOPE
+	 */
+	class ProfileZone
+	{
+		unsigned int m_id;
+	public:
+		explicit ProfileZone(const std::string &name)
+			: m_id(Profiler::RegisterZone(name))
+		{
+			;
+		}
+		unsigned int getID() const { return m_id; }
+	};
+
+	//! Measures the time between construction and destruction for a ProfileZone
+	/*!
+	 * @ingroup Tools
+	 */
+	class ProfileScope
+	{
+		unsigned int m_zone;
+		ProfileTicks m_start;
+		bool m_active;
+		ProfileScope(const ProfileScope &);
+		ProfileScope &operator=(const ProfileScope &);
+	public:
+		explicit ProfileScope(const ProfileZone &zone)
+			: m_zone(zone.getID()), m_start(0), m_active(Profiler::isEnabled())
+		{
+			if (m_active) m_start = Profiler::Now();
+		}
+		~ProfileScope()
+		{
+			if (m_active) Profiler::Record(m_zone, m_start, Profiler::Now());
+		}
+	};
+
+	//! Build a zone name for a plugin callback of the plugin class T
+	template <class T>
+	std::string ProfileCallbackName(const char *callback)
+	{
+		return std::string(callback) + " [" + typeid(T).name() + "]";
+	}
+} // end namespace lwpp
+
+#define LWPP_PROFILE_CONCAT2(a, b) a##b
+#define LWPP_PROFILE_CONCAT(a, b) LWPP_PROFILE_CONCAT2(a, b)
+
+#ifndef LWPP_NO_PROFILER
+//! Profile the rest of the enclosing scope as a zone called name
+#define LWPP_PROFILE_SCOPE(name) \
+	static const lwpp::ProfileZone LWPP_PROFILE_CONCAT(lwpp_profile_zone_, __LINE__)(name); \
+	lwpp::ProfileScope LWPP_PROFILE_CONCAT(lwpp_profile_scope_, __LINE__)(LWPP_PROFILE_CONCAT(lwpp_profile_zone_, __LINE__))
+//! Profile the rest of the enclosing function
+#define LWPP_PROFILE_FUNCTION() LWPP_PROFILE_SCOPE(__FUNCTION__)
+//! Profile a plugin callback inside an adaptor, the zone is named after the callback and the plugin class
+#define LWPP_PROFILE_CALLBACK(T, callback) LWPP_PROFILE_SCOPE(lwpp::ProfileCallbackName<T>(callback))
+#else
+#define LWPP_PROFILE_SCOPE(name)
+#define LWPP_PROFILE_FUNCTION()
+#define LWPP_PROFILE_CALLBACK(T, callback)
+#endif
+
+#endif // LWPP_PROFILER_H
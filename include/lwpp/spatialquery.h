@@ -30,15 +30,13 @@ namespace lwpp
       LWRayCastInfo* data)
     {
       auto ret = globPtr->raycast(mID, item, origin, direction, data);
-#ifdef _DEBUG
-      dout << "raycast( " << mID << ", " << item << ", <"
+      LWPP_LOG_TRACE("spatialquery", "raycast( " << mID << ", " << item << ", <"
         << origin[0] << ", " << origin[1] << ", " << origin[2] << ">, <"
         << direction[0] << ", " << direction[1] << ", " << direction[2] << ">, "
-        << data << ") = " << ret << "\n";
-      dout << "LWRayCastInfo.polygon = " << data->polygon << ", .hitpoint = <"
+        << data << ") = " << ret);
+      LWPP_LOG_TRACE("spatialquery", "LWRayCastInfo.polygon = " << data->polygon << ", .hitpoint = <"
         << data->hitpoint[0] << ", " << data->hitpoint[1] << ", " << data->hitpoint[2] << ">, .distance = "
-        << data->distance << " , .item = " << data->item << "\n";
-#endif 
+        << data->distance << " , .item = " << data->item);
       return (ret != 0);
     }
 
@@ -8,8 +8,10 @@
 #define LWPP_TEXTURE_H
 
 #include <lwpp/global.h>
+#include <lwpp/point3d.h>
 #include <lwpp/vector3d.h>
 #include <lwtxtr.h>
+#include <vector>
 
 namespace lwpp
 {
@@ -181,6 +183,98 @@ namespace lwpp
 
 	};
 
+	//! Serves texture lookups from a grid baked once per frame
+	/*!
+	 * @ingroup Helper
+	 * Evaluating a Texture calls into LightWave for every sample, which is too slow for ray marched volumes or
+	 * dense displacements. A TextureCache evaluates the texture once for every node of a regular grid spanning a
+	 * bounding box and answers lookups inside the box with a trilinear interpolation of the grid. Positions outside
+	 * the box are evaluated by the texture itself.
+	 *
+	 * An axis with a resolution of 1 is not sampled along, so a resolution of (n, n, 1) bakes a 2D grid for
+	 * textures that don't vary along z.
+	 *
+	 * Bake in NewTime() of the plugin, after Texture::newtime(), or use TextureCache::NewTime() for both. Lookups
+	 * only read the grid and may be done from any number of threads.
+	 * @code
+	 * // in NewTime()
+	 * fogCache.Setup(Point3d(-10, 0, -10), Point3d(10, 5, 10), 64, 16, 64);
+	 * fogCache.NewTime(mp, time, frame);
+	 * // while rendering
+	 * double alpha = fogCache.Evaluate(&mp, colour);
+	 * @endcode
+	 */
+	class TextureCache
+	{
+		Texture m_texture;
+		double m_min[3], m_max[3];
+		int m_res[3];
+		double m_scale[3];			//!< grid cells per unit
+		bool m_world;
+		std::vector<float> m_grid;	//!< value[3] and alpha per grid node
+		void lookup(const double pos[3], double value[3], double &alpha) const;
+	public:
+		TextureCache(Texture texture = Texture())
+			: m_texture(texture), m_world(true)
+		{
+			m_res[0] = m_res[1] = m_res[2] = 0;
+			m_scale[0] = m_scale[1] = m_scale[2] = 0.0;
+		}
+
+		void setTexture(Texture texture)
+		{
+			m_texture = texture;
+			Clear();
+		}
+		Texture &getTexture() { return m_texture; }
+
+		//! Set the region and grid resolution to bake
+		/*!
+		 * @param world Look up LWMicropol::wPos if true, LWMicropol::oPos otherwise
+		 */
+		void Setup(const Point3d &boxMin, const Point3d &boxMax, int resX, int resY, int resZ, bool world = true);
+
+		//! Evaluate the texture at all grid nodes
+		/*!
+		 * @param templ Micropolygon used for the texture evaluation, only the positions and the spot size are changed
+		 */
+		void Bake(const LWMicropol &templ);
+		//! Update the texture to a new time and bake it
+		void NewTime(const LWMicropol &templ, LWTime time, LWFrame frame)
+		{
+			m_texture.newtime(time, frame);
+			Bake(templ);
+		}
+		//! Free the grid, all lookups are evaluated by the texture
+		void Clear() { m_grid.clear(); }
+		bool isBaked() const { return !m_grid.empty(); }
+
+		//! Check if a position is within the baked region
+		bool Contains(const double pos[3]) const
+		{
+			if (m_grid.empty()) return false;
+			for (int i = 0; i < 3; ++i)
+			{
+				if ((m_res[i] > 1) && ((pos[i] < m_min[i]) || (pos[i] > m_max[i]))) return false;
+			}
+			return true;
+		}
+
+		//! Same as Texture::evaluate(), served from the grid within the baked region
+		/*!
+		 * @param value Receives 3 values, also for scalar textures
+		 * @return The alpha of the texture
+		 */
+		double Evaluate(LWMicropol *mp, double *value)
+		{
+			const double *pos = m_world ? mp->wPos : mp->oPos;
+			if (!Contains(pos)) return m_texture.evaluate(mp, value);
+			double alpha;
+			lookup(pos, value, alpha);
+			return alpha;
+		}
+	};
+
 	// LAYERS
 
 	/*! Wrapper for Texture Layers
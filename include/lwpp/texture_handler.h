@@ -60,6 +60,7 @@ class TextureHandler : public InstanceHandler, public ItemHandler, public Render
 		private:
 		static double Evaluate (LWInstance instance, LWTextureAccess *ta)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Texture::Evaluate");
 			try
 			{
 				T *plugin = (T *) instance;
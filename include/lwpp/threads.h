@@ -7,6 +7,9 @@
 
 #include "lwmtutil.h"
 #include "lwpp/global.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 namespace lwpp 
 {
@@ -473,6 +476,85 @@ namespace lwpp
 			return 0;
 		}
 	};
+
+	//! Number of threads to use for ParallelFor()
+	//! @ingroup Globals
+	inline unsigned int ParallelThreadCount()
+	{
+		ThreadUtils tu;
+		int n = tu.available() ? tu.numCPUCores() : 0;
+		if (n <= 0) n = static_cast<int>(std::thread::hardware_concurrency());
+		return (n > 0) ? static_cast<unsigned int>(n) : 1;
+	}
+
+	//! Shared state of a ParallelFor() call
+	template <typename F>
+	class ParallelForTask
+	{
+		F &m_func;
+		const size_t m_end;
+		const size_t m_grain;
+		std::atomic<size_t> m_next;
+		std::atomic<unsigned int> m_workers;
+	public:
+		ParallelForTask(F &func, size_t begin, size_t end, size_t grain)
+			: m_func(func), m_end(end), m_grain(grain), m_next(begin), m_workers(0)
+		{
+			;
+		}
+		//! Process chunks until all are taken
+		void Run(unsigned int worker)
+		{
+			for (;;)
+			{
+				const size_t b = m_next.fetch_add(m_grain);
+				if (b >= m_end) break;
+				m_func(b, std::min(b + m_grain, m_end), worker);
+			}
+		}
+		static int LWMTThreadFunc(void *arg)
+		{
+			ParallelForTask *task = static_cast<ParallelForTask *>(arg);
+			task->Run(task->m_workers.fetch_add(1));
+			return 0;
+		}
+	};
+
+	//! Call func(chunkBegin, chunkEnd, worker) for chunks of at most grain indices of [begin, end)
+	/*!
+	 * @ingroup Globals
+	 * The chunks are processed by a LightWave thread group, the call blocks until all chunks are done.
+	 * worker is unique per thread and smaller than numThreads, use it to address per thread storage.
+	 * If the thread group can't be created the chunks are processed on the calling thread as worker 0.
+	 *
+	 * @note The same restrictions as for ThreadGroup apply, do not call into LightWave from func
+	 * unless the function is known to be thread safe.
+	 * @param numThreads Number of threads to use, 0 for ParallelThreadCount()
+	 */
+	template <typename F>
+	void ParallelFor(size_t begin, size_t end, size_t grain, F func, unsigned int numThreads = 0)
+	{
+		if (end <= begin) return;
+		if (grain == 0) grain = 1;
+		if (numThreads == 0) numThreads = ParallelThreadCount();
+		const size_t chunks = (end - begin + grain - 1) / grain;
+		if (chunks < numThreads) numThreads = static_cast<unsigned int>(chunks);
+
+		ParallelForTask<F> task(func, begin, end, grain);
+		if (numThreads > 1)
+		{
+			ThreadGroup group(static_cast<int>(numThreads));
+			for (unsigned int i = 0; i < numThreads; ++i)
+			{
+				group.addThread(ParallelForTask<F>::LWMTThreadFunc, 0, &task);
+			}
+			if (group.getThreadCount() == static_cast<int>(numThreads))
+			{
+				group.run();
+			}
+		}
+		task.Run(0); // remaining chunks, if any
+	}
 }
 
 #endif // LWPP_THREADS_H
\ No newline at end of file
@@ -0,0 +1,318 @@
+/*!
+ * @file
+ * @brief Adaptive integration of participating media for VolumetricHandler plugins
+ */
+#ifndef LWPP_VOLUME_INTEGRATOR_H
+#define LWPP_VOLUME_INTEGRATOR_H
+
+#include <lwpp/volumetric_handler.h>
+#include <lwpp/item.h>
+#include <lwpp/math.h>
+#include <lwpp/saruprng.h>
+#include <cmath>
+#include <vector>
+
+namespace lwpp
+{
+	//! How shadow rays (rays without LWVEF_COLOR) are integrated
+	enum VolumeShadowMode
+	{
+		VOLUME_SHADOW_MARCH,	//!< Deterministic ray marching, same as camera rays but without lighting
+		VOLUME_SHADOW_RATIO,	//!< Ratio tracking, unbiased transmittance estimate, needs a majorant
+		VOLUME_SHADOW_DELTA		//!< Delta tracking, the ray is either fully blocked or not, needs a majorant
+	};
+
+	//! Settings of a VolumeIntegrator
+	struct VolumeIntegratorSettings
+	{
+		double stepTolerance;			//!< Target optical depth per step
+		double errorTolerance;		//!< Maximum change of optical depth per step before the step is halved
+		double minStep;						//!< Smallest step
+		double maxStep;						//!< Largest step
+		bool relativeSteps;				//!< minStep, maxStep and lightSpacing are multiplied by the distance from the ray origin
+		double lightSpacing;			//!< Lights are evaluated again once the ray advanced this far, 0 to evaluate at every step
+		double minTransmittance;	//!< The march stops once the transmittance drops below this value
+		double opacityScale;			//!< Scale applied to the optical depth of every sample
+		int maxSteps;
+		VolumeShadowMode shadowMode;
+
+		VolumeIntegratorSettings()
+			: stepTolerance(0.05), errorTolerance(0.1), minStep(0.01), maxStep(100.0), relativeSteps(false),
+			lightSpacing(0.0), minTransmittance(0.001), opacityScale(1.0), maxSteps(1000), shadowMode(VOLUME_SHADOW_MARCH)
+		{
+			;
+		}
+	};
+
+	//! Shading of a medium at a point, filled in by the medium
+	struct VolumeShading
+	{
+		double colour[3];		//!< Scattering colour, multiplied by the incoming light
+		double emission[3];	//!< Emitted light per unit optical depth, not affected by lights
+		bool lit;						//!< Set to false if the point receives no light, only the emission contributes
+	};
+
+	//! Base class for media integrated by a VolumeIntegrator
+	/*!
+	 * @ingroup Helper
+	 * Derive from it and implement Extinction(), the other functions may be hidden by the derived class
+	 * to improve the integration. Calls are resolved at compile time, there is no need for virtual functions.
+	 */
+	class VolumeMedium
+	{
+	public:
+		//! Clip the ray to the extent of the medium
+		/*!
+		 * t0 and t1 are initialised to the near and far clipping distance of the ray.
+		 * @return false if the ray misses the medium
+		 */
+		bool Interval(const Point3d &origin, const Vector3d &dir, double &t0, double &t1) const
+		{
+			UNUSED(origin); UNUSED(dir); UNUSED(t0); UNUSED(t1);
+			return true;
+		}
+		//! Upper bound of the extinction along [t0, t1], return a negative value if unknown
+		double Majorant(const Point3d &origin, const Vector3d &dir, double t0, double t1) const
+		{
+			UNUSED(origin); UNUSED(dir); UNUSED(t0); UNUSED(t1);
+			return -1.0;
+		}
+		/* Must be implemented by the derived class:
+		 * Returns the extinction coefficient at p, footprint is the current step size.
+		 * shade is initialised to a white colour, no emission and lit = true.
+		double Extinction(const Point3d &p, double footprint, VolumeShading &shade);
+		 */
+	};
+
+	//! Adaptive volume integration engine
+	/*!
+	 * @ingroup Helper
+	 * Camera and reflection rays are integrated with an adaptive trapezoid rule: the step is chosen so that
+	 * it covers about stepTolerance of optical depth and is halved whenever the extinction changes too much
+	 * within a step. The march stops early once the ray is practically opaque.
+	 * Lights are collected once per frame by UpdateLights() and evaluated with VolumetricAccess::illuminate(),
+	 * their contribution is cached along the ray for lightSpacing.
+	 *
+	 * Shadow rays can use ratio or delta tracking if the medium provides a majorant.
+	 *
+	 * A single VolumeIntegrator may be used by all render threads, Integrate() does not modify it.
+	 */
+	class VolumeIntegrator
+	{
+		std::vector<LWItemID> m_lights;
+	public:
+		VolumeIntegratorSettings settings;
+
+		//! Collect the lights of the scene, call from NewTime(), without lights only emission is visible
+		void UpdateLights()
+		{
+			m_lights.clear();
+			ItemInfo itemInfo;
+			if (!itemInfo.isValid()) return;
+			for (LWItemID light = itemInfo.first(LWI_LIGHT, LWITEM_NULL); light != LWITEM_NULL; light = itemInfo.next(light))
+			{
+				m_lights.push_back(light);
+			}
+		}
+		const std::vector<LWItemID> &getLights() const { return m_lights; }
+
+		//! Integrate a medium along the ray of va, adding samples to the ray
+		/*!
+		 * @return the transmittance of the ray through the medium
+		 */
+		template <class M>
+		double Integrate(VolumetricAccess &va, M &medium) const
+		{
+			const Point3d origin = va.getOrigin();
+			const Vector3d dir = va.getDirection();
+			double t0 = va.getNearClip();
+			double t1 = va.getFarClip();
+			if (!medium.Interval(origin, dir, t0, t1)) return 1.0;
+			t0 = Max(t0, va.getNearClip());
+			t1 = Min(t1, va.getFarClip());
+			if (t0 >= t1) return 1.0;
+
+			if (!(va.getFlags() & LWVEF_COLOR) && (settings.shadowMode != VOLUME_SHADOW_MARCH))
+			{
+				const double majorant = medium.Majorant(origin, dir, t0, t1);
+				if (majorant > 0.0) return track(va, medium, origin, dir, t0, t1, majorant);
+			}
+			return march(va, medium, origin, dir, t0, t1);
+		}
+
+	private:
+		double stepScale(double t) const
+		{
+			return settings.relativeSteps ? Max(t, 1e-6) : 1.0;
+		}
+
+		void illuminate(VolumetricAccess &va, const Point3d &p, double light[3]) const
+		{
+			light[0] = light[1] = light[2] = 0.0;
+			double pos[3] = { p.x, p.y, p.z };
+			for (auto id : m_lights)
+			{
+				double ldir[3], colour[3];
+				if (va.illuminate(id, pos, ldir, colour))
+				{
+					light[0] += colour[0];
+					light[1] += colour[1];
+					light[2] += colour[2];
+				}
+			}
+		}
+
+		template <class M>
+		double evaluate(M &medium, const Point3d &p, double footprint, VolumeShading &shade) const
+		{
+			shade.colour[0] = shade.colour[1] = shade.colour[2] = 1.0;
+			shade.emission[0] = shade.emission[1] = shade.emission[2] = 0.0;
+			shade.lit = true;
+			return Max(0.0, medium.Extinction(p, footprint, shade));
+		}
+
+		//! Adaptive trapezoid integration
+		template <class M>
+		double march(VolumetricAccess &va, M &medium, const Point3d &origin, const Vector3d &dir, double t0, double t1) const
+		{
+			const bool colour = (va.getFlags() & LWVEF_COLOR) != 0;
+			const double tauLimit = -std::log(Max(settings.minTransmittance, 1e-12));
+
+			LWVolumeSample sample;
+			VolumeShading shadeA, shadeB;
+			double lightA[3] = { 0.0, 0.0, 0.0 }, lightB[3] = { 0.0, 0.0, 0.0 };
+			double lightT = -1e300;
+
+			double t = t0;
+			double step = settings.minStep * stepScale(t);
+			double sigmaA = evaluate(medium, origin + dir * t, step, shadeA);
+			if (colour && shadeA.lit && (sigmaA > 0.0))
+			{
+				illuminate(va, origin + dir * t, lightA);
+				lightT = t;
+				// steps within the light spacing reuse lightB
+				lightB[0] = lightA[0]; lightB[1] = lightA[1]; lightB[2] = lightA[2];
+			}
+			double tau = 0.0;
+
+			for (int n = 0; (n < settings.maxSteps) && (t < t1) && (tau < tauLimit); ++n)
+			{
+				const double scale = stepScale(t);
+				const double minStep = settings.minStep * scale;
+				step = (sigmaA > 0.0) ? settings.stepTolerance / sigmaA : settings.maxStep * scale;
+				step = Clamp(step, minStep, settings.maxStep * scale);
+				step = Min(step, t1 - t);
+
+				// shrink the step while the extinction changes too fast
+				double sigmaB = evaluate(medium, origin + dir * (t + step), step, shadeB);
+				for (int refine = 0; refine < 4; ++refine)
+				{
+					if ((std::fabs(sigmaB - sigmaA) * step <= settings.errorTolerance) || (step * 0.5 < minStep)) break;
+					step *= 0.5;
+					sigmaB = evaluate(medium, origin + dir * (t + step), step, shadeB);
+				}
+				const double tB = t + step;
+
+				if (colour && shadeB.lit && (sigmaB > 0.0))
+				{
+					// otherwise lightB still holds the cached value
+					if ((settings.lightSpacing <= 0.0) || (tB - lightT >= settings.lightSpacing * scale))
+					{
+						illuminate(va, origin + dir * tB, lightB);
+						lightT = tB;
+					}
+				}
+				else if (!shadeB.lit)
+				{
+					lightB[0] = lightB[1] = lightB[2] = 0.0;
+					lightT = -1e300;
+				}
+
+				const double dtau = 0.5 * step * (sigmaA + sigmaB) * settings.opacityScale;
+				if (dtau > 0.0)
+				{
+					sample.dist = t;
+					sample.stride = step;
+					for (int c = 0; c < 3; ++c)
+					{
+						if (colour)
+						{
+							const double a = sigmaA * (shadeA.colour[c] * lightA[c] + shadeA.emission[c]);
+							const double b = sigmaB * (shadeB.colour[c] * lightB[c] + shadeB.emission[c]);
+							sample.color[c] = 0.5 * step * (a + b);
+						}
+						else
+						{
+							sample.color[c] = 0.0;
+						}
+						sample.opacity[c] = dtau;
+					}
+					va.addSample(&sample);
+					tau += dtau;
+				}
+
+				t = tB;
+				sigmaA = sigmaB;
+				shadeA = shadeB;
+				lightA[0] = lightB[0]; lightA[1] = lightB[1]; lightA[2] = lightB[2];
+			}
+			return std::exp(-tau);
+		}
+
+		//! Ratio or delta tracking against a constant majorant, used for shadow rays
+		template <class M>
+		double track(VolumetricAccess &va, M &medium, const Point3d &origin, const Vector3d &dir, double t0, double t1, double majorant) const
+		{
+			// decorrelate rays by their sub pixel position and origin
+			unsigned int seed[3];
+			seed[0] = static_cast<unsigned int>(va.getSubPixelX() * 4294967295.0);
+			seed[1] = static_cast<unsigned int>(va.getSubPixelY() * 4294967295.0);
+			seed[2] = static_cast<unsigned int>(origin.x * 73856093.0) ^ static_cast<unsigned int>(origin.y * 19349663.0) ^ static_cast<unsigned int>(origin.z * 83492791.0);
+			Saru rng(seed[0], seed[1], seed[2]);
+
+			VolumeShading shade;
+			const double invMajorant = 1.0 / majorant;
+			double transmittance = 1.0;
+			double t = t0;
+			for (int n = 0; n < settings.maxSteps; ++n)
+			{
+				t -= std::log(1.0 - rng.d()) * invMajorant;
+				if (t >= t1) break;
+				const double sigma = Min(evaluate(medium, origin + dir * t, invMajorant, shade), majorant);
+				if (settings.shadowMode == VOLUME_SHADOW_DELTA)
+				{
+					if (rng.d() < sigma * invMajorant)
+					{
+						transmittance = 0.0;
+						break;
+					}
+				}
+				else
+				{
+					transmittance *= 1.0 - sigma * invMajorant;
+					if (transmittance < settings.minTransmittance)
+					{
+						transmittance = 0.0;
+						break;
+					}
+				}
+			}
+			if (transmittance >= 1.0) return 1.0;
+
+			// a single sample carrying the optical depth of the whole interval
+			const double tau = (transmittance > 0.0) ? -std::log(transmittance) : -std::log(Max(settings.minTransmittance, 1e-12));
+			LWVolumeSample sample;
+			sample.dist = t0;
+			sample.stride = t1 - t0;
+			for (int c = 0; c < 3; ++c)
+			{
+				sample.color[c] = 0.0;
+				sample.opacity[c] = tau * settings.opacityScale;
+			}
+			va.addSample(&sample);
+			return std::exp(-tau * settings.opacityScale);
+		}
+	};
+} // end namespace lwpp
+
+#endif // LWPP_VOLUME_INTEGRATOR_H
@@ -193,6 +193,7 @@ namespace lwpp
 
 		static double Evaluate (LWInstance instance, LWVolumeAccess *lw_voa)
 		{
+			LWPP_PROFILE_CALLBACK(T, "Volumetric::Evaluate");
 			try
 			{
 				T *plugin = (T *) instance;
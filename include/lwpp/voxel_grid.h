@@ -0,0 +1,665 @@
+/*!
+ * @file
+ * @brief Sparse voxel grid for volumetric plugins
+ *
+ * The grid is organised as a shallow tree similar to OpenVDB:
+ * a hashed root holds internal nodes of 16^3 leaves, each leaf holds 8^3 voxels plus a bit mask of active voxels.
+ * Only leaves that contain data are allocated. Every leaf and internal node stores the minimum and maximum
+ * of its active voxels, which is used to skip empty space while ray marching.
+ */
+#ifndef LWPP_VOXEL_GRID_H
+#define LWPP_VOXEL_GRID_H
+
+#include <lwpp/math.h>
+#include <lwpp/point3d.h>
+#include <lwpp/threads.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lwpp
+{
+	//! Integer voxel coordinate
+	struct VoxelCoord
+	{
+		int x, y, z;
+		VoxelCoord(int _x = 0, int _y = 0, int _z = 0) : x(_x), y(_y), z(_z) {}
+		bool operator==(const VoxelCoord &c) const { return (x == c.x) && (y == c.y) && (z == c.z); }
+		bool operator!=(const VoxelCoord &c) const { return !(*this == c); }
+	};
+
+	struct VoxelCoordHash
+	{
+		size_t operator()(const VoxelCoord &c) const
+		{
+			return (static_cast<size_t>(c.x) * 73856093u) ^ (static_cast<size_t>(c.y) * 19349663u) ^ (static_cast<size_t>(c.z) * 83492791u);
+		}
+	};
+
+	//! A block of 8^3 voxels
+	template <typename T>
+	class VoxelLeaf
+	{
+	public:
+		static const int Log2Dim = 3;
+		static const int Dim = 1 << Log2Dim;
+		static const int Size = Dim * Dim * Dim;
+		static const int Mask = Dim - 1;
+
+		T values[Size];
+		std::uint64_t active[Size / 64];
+		T minValue;
+		T maxValue;
+
+		explicit VoxelLeaf(T background)
+			: minValue(background), maxValue(background)
+		{
+			std::fill(values, values + Size, background);
+			std::fill(active, active + Size / 64, std::uint64_t(0));
+		}
+		//! Linear offset of a voxel within the leaf
+		static int Offset(int x, int y, int z)
+		{
+			return ((x & Mask) << (2 * Log2Dim)) | ((y & Mask) << Log2Dim) | (z & Mask);
+		}
+		bool isActive(int offset) const
+		{
+			return (active[offset >> 6] & (std::uint64_t(1) << (offset & 63))) != 0;
+		}
+		void setActive(int offset)
+		{
+			active[offset >> 6] |= (std::uint64_t(1) << (offset & 63));
+		}
+		bool isEmpty() const
+		{
+			for (int i = 0; i < Size / 64; ++i) if (active[i]) return false;
+			return true;
+		}
+		//! Recompute minValue and maxValue of the active voxels
+		void UpdateStatistics()
+		{
+			bool first = true;
+			for (int i = 0; i < Size; ++i)
+			{
+				if (!isActive(i)) continue;
+				if (first)
+				{
+					minValue = maxValue = values[i];
+					first = false;
+				}
+				else
+				{
+					minValue = Min(minValue, values[i]);
+					maxValue = Max(maxValue, values[i]);
+				}
+			}
+		}
+	};
+
+	//! A block of 16^3 leaves, i.e. 128^3 voxels
+	template <typename T>
+	class VoxelInternal
+	{
+	public:
+		static const int Log2Dim = 4;
+		static const int Dim = 1 << Log2Dim;
+		static const int Size = Dim * Dim * Dim;
+		static const int Log2Total = Log2Dim + VoxelLeaf<T>::Log2Dim;
+		static const int TotalMask = (1 << Log2Total) - 1;
+
+		std::unique_ptr<VoxelLeaf<T>> children[Size];
+		T minValue;
+		T maxValue;
+
+		explicit VoxelInternal(T background)
+			: minValue(background), maxValue(background)
+		{
+			;
+		}
+		//! Linear offset of the leaf containing a voxel
+		static int Offset(int x, int y, int z)
+		{
+			const int l = VoxelLeaf<T>::Log2Dim;
+			return (((x & TotalMask) >> l) << (2 * Log2Dim)) | (((y & TotalMask) >> l) << Log2Dim) | ((z & TotalMask) >> l);
+		}
+		void UpdateStatistics()
+		{
+			bool first = true;
+			for (int i = 0; i < Size; ++i)
+			{
+				VoxelLeaf<T> *leaf = children[i].get();
+				if (!leaf) continue;
+				leaf->UpdateStatistics();
+				if (first)
+				{
+					minValue = leaf->minValue;
+					maxValue = leaf->maxValue;
+					first = false;
+				}
+				else
+				{
+					minValue = Min(minValue, leaf->minValue);
+					maxValue = Max(maxValue, leaf->maxValue);
+				}
+			}
+		}
+	};
+
+	//! Sparse voxel grid
+	/*!
+	 * @ingroup Helper
+	 * Voxel centres sit at integer index coordinates, world positions are mapped to index space
+	 * using the origin and the voxel size.
+	 *
+	 * Reading (getValue(), Sample(), MarchLeaves()) is thread safe, writing is not.
+	 * Call UpdateStatistics() after modifying the grid and before using MarchLeaves().
+	 */
+	template <typename T>
+	class VoxelGrid
+	{
+	public:
+		typedef VoxelLeaf<T> Leaf;
+		typedef VoxelInternal<T> Internal;
+		enum MergeMode { MERGE_ADD, MERGE_MAX, MERGE_REPLACE };
+
+	private:
+		typedef std::unordered_map<VoxelCoord, std::unique_ptr<Internal>, VoxelCoordHash> RootMap;
+		RootMap m_root;
+		Point3d m_origin;
+		double m_voxelSize;
+		T m_background;
+		VoxelCoord m_bboxMin, m_bboxMax; //!< index space bounds of all leaves, valid after UpdateStatistics()
+		bool m_empty;
+
+		static VoxelCoord rootKey(int x, int y, int z)
+		{
+			return VoxelCoord(x & ~Internal::TotalMask, y & ~Internal::TotalMask, z & ~Internal::TotalMask);
+		}
+
+	public:
+		explicit VoxelGrid(double voxelSize = 1.0, T background = T(0))
+			: m_origin(0.0, 0.0, 0.0), m_voxelSize(voxelSize), m_background(background), m_empty(true)
+		{
+			;
+		}
+
+		//! Set the transformation from world to index space
+		void SetTransform(const Point3d &origin, double voxelSize)
+		{
+			m_origin = origin;
+			m_voxelSize = voxelSize;
+		}
+		const Point3d &getOrigin() const { return m_origin; }
+		double getVoxelSize() const { return m_voxelSize; }
+		T getBackground() const { return m_background; }
+
+		void WorldToIndex(const Point3d &p, double idx[3]) const
+		{
+			idx[0] = (p.x - m_origin.x) / m_voxelSize;
+			idx[1] = (p.y - m_origin.y) / m_voxelSize;
+			idx[2] = (p.z - m_origin.z) / m_voxelSize;
+		}
+		Point3d IndexToWorld(double x, double y, double z) const
+		{
+			return Point3d(m_origin.x + x * m_voxelSize, m_origin.y + y * m_voxelSize, m_origin.z + z * m_voxelSize);
+		}
+
+		//! Remove all voxels
+		void Clear()
+		{
+			m_root.clear();
+			m_empty = true;
+		}
+		bool isEmpty() const { return m_root.empty(); }
+
+		//! Returns the leaf containing a voxel, or nullptr
+		Leaf *probeLeaf(int x, int y, int z) const
+		{
+			auto it = m_root.find(rootKey(x, y, z));
+			if (it == m_root.end()) return nullptr;
+			return it->second->children[Internal::Offset(x, y, z)].get();
+		}
+		//! Returns the leaf containing a voxel, creating it if needed
+		Leaf *touchLeaf(int x, int y, int z)
+		{
+			std::unique_ptr<Internal> &node = m_root[rootKey(x, y, z)];
+			if (!node) node.reset(new Internal(m_background));
+			std::unique_ptr<Leaf> &leaf = node->children[Internal::Offset(x, y, z)];
+			if (!leaf) leaf.reset(new Leaf(m_background));
+			return leaf.get();
+		}
+
+		T getValue(int x, int y, int z) const
+		{
+			const Leaf *leaf = probeLeaf(x, y, z);
+			return leaf ? leaf->values[Leaf::Offset(x, y, z)] : m_background;
+		}
+		bool isActive(int x, int y, int z) const
+		{
+			const Leaf *leaf = probeLeaf(x, y, z);
+			return leaf ? leaf->isActive(Leaf::Offset(x, y, z)) : false;
+		}
+		void setValue(int x, int y, int z, T value)
+		{
+			Leaf *leaf = touchLeaf(x, y, z);
+			const int o = Leaf::Offset(x, y, z);
+			leaf->values[o] = value;
+			leaf->setActive(o);
+		}
+		void addValue(int x, int y, int z, T value)
+		{
+			Leaf *leaf = touchLeaf(x, y, z);
+			const int o = Leaf::Offset(x, y, z);
+			leaf->values[o] += value;
+			leaf->setActive(o);
+		}
+
+		//! Call func(const VoxelCoord &leafOrigin, Leaf &leaf) for every leaf
+		template <typename F>
+		void ForEachLeaf(F func) const
+		{
+			for (auto &node : m_root)
+			{
+				for (int i = 0; i < Internal::Size; ++i)
+				{
+					Leaf *leaf = node.second->children[i].get();
+					if (!leaf) continue;
+					const int l = Leaf::Log2Dim;
+					const int d = Internal::Log2Dim;
+					VoxelCoord c(node.first.x + (((i >> (2 * d)) & (Internal::Dim - 1)) << l),
+											 node.first.y + (((i >> d) & (Internal::Dim - 1)) << l),
+											 node.first.z + ((i & (Internal::Dim - 1)) << l));
+					func(c, *leaf);
+				}
+			}
+		}
+
+		size_t LeafCount() const
+		{
+			size_t count = 0;
+			ForEachLeaf([&count](const VoxelCoord &, Leaf &) { ++count; });
+			return count;
+		}
+		//! Memory used by the grid in bytes
+		size_t MemorySize() const
+		{
+			return sizeof(*this) + m_root.size() * sizeof(Internal) + LeafCount() * sizeof(Leaf);
+		}
+
+		//! Update the minimum/maximum of all leaves and internal nodes and the bounding box
+		void UpdateStatistics()
+		{
+			m_empty = true;
+			std::vector<Internal *> nodes;
+			for (auto &node : m_root) nodes.push_back(node.second.get());
+			ParallelFor(0, nodes.size(), 1, [&nodes](size_t b, size_t e, unsigned int)
+			{
+				for (size_t i = b; i < e; ++i) nodes[i]->UpdateStatistics();
+			});
+			ForEachLeaf([this](const VoxelCoord &c, Leaf &)
+			{
+				if (m_empty)
+				{
+					m_bboxMin = c;
+					m_bboxMax = c;
+					m_empty = false;
+				}
+				m_bboxMin = VoxelCoord(Min(m_bboxMin.x, c.x), Min(m_bboxMin.y, c.y), Min(m_bboxMin.z, c.z));
+				m_bboxMax = VoxelCoord(Max(m_bboxMax.x, c.x), Max(m_bboxMax.y, c.y), Max(m_bboxMax.z, c.z));
+			});
+			m_bboxMax = VoxelCoord(m_bboxMax.x + Leaf::Mask, m_bboxMax.y + Leaf::Mask, m_bboxMax.z + Leaf::Mask);
+		}
+		//! Index space bounds of all voxels, valid after UpdateStatistics()
+		bool Bounds(VoxelCoord &bmin, VoxelCoord &bmax) const
+		{
+			bmin = m_bboxMin;
+			bmax = m_bboxMax;
+			return !m_empty;
+		}
+
+		//! Move or combine all leaves of another grid with the same transform into this one
+		/*!
+		 * other is empty afterwards.
+		 */
+		void Merge(VoxelGrid &other, MergeMode mode = MERGE_ADD)
+		{
+			for (auto &node : other.m_root)
+			{
+				std::unique_ptr<Internal> &dst = m_root[node.first];
+				if (!dst)
+				{
+					dst = std::move(node.second);
+					continue;
+				}
+				for (int i = 0; i < Internal::Size; ++i)
+				{
+					std::unique_ptr<Leaf> &src = node.second->children[i];
+					if (!src) continue;
+					std::unique_ptr<Leaf> &d = dst->children[i];
+					if (!d)
+					{
+						d = std::move(src);
+						continue;
+					}
+					for (int v = 0; v < Leaf::Size; ++v)
+					{
+						if (!src->isActive(v)) continue;
+						if (!d->isActive(v))
+							d->values[v] = src->values[v];
+						else if (mode == MERGE_ADD)
+							d->values[v] += src->values[v];
+						else if (mode == MERGE_MAX)
+							d->values[v] = Max(d->values[v], src->values[v]);
+						else
+							d->values[v] = src->values[v];
+						d->setActive(v);
+					}
+				}
+			}
+			other.m_root.clear();
+		}
+
+		//! Cached read access, remembers the last leaf. Use one accessor per thread.
+		class Accessor
+		{
+			const VoxelGrid &m_grid;
+			VoxelCoord m_key;
+			const Leaf *m_leaf;
+			bool m_valid;
+		public:
+			explicit Accessor(const VoxelGrid &grid)
+				: m_grid(grid), m_leaf(nullptr), m_valid(false)
+			{
+				;
+			}
+			T getValue(int x, int y, int z)
+			{
+				const VoxelCoord key(x & ~Leaf::Mask, y & ~Leaf::Mask, z & ~Leaf::Mask);
+				if (!m_valid || (key != m_key))
+				{
+					m_key = key;
+					m_leaf = m_grid.probeLeaf(x, y, z);
+					m_valid = true;
+				}
+				return m_leaf ? m_leaf->values[Leaf::Offset(x, y, z)] : m_grid.m_background;
+			}
+			//! Trilinear interpolation at an index space position
+			T SampleIndex(double x, double y, double z)
+			{
+				const int ix = Floor(x), iy = Floor(y), iz = Floor(z);
+				const double fx = x - ix, fy = y - iy, fz = z - iz;
+				const T c000 = getValue(ix, iy, iz), c001 = getValue(ix, iy, iz + 1);
+				const T c010 = getValue(ix, iy + 1, iz), c011 = getValue(ix, iy + 1, iz + 1);
+				const T c100 = getValue(ix + 1, iy, iz), c101 = getValue(ix + 1, iy, iz + 1);
+				const T c110 = getValue(ix + 1, iy + 1, iz), c111 = getValue(ix + 1, iy + 1, iz + 1);
+				const T c00 = Lerp(fz, c000, c001), c01 = Lerp(fz, c010, c011);
+				const T c10 = Lerp(fz, c100, c101), c11 = Lerp(fz, c110, c111);
+				return Lerp(fx, Lerp(fy, c00, c01), Lerp(fy, c10, c11));
+			}
+			//! Trilinear interpolation at a world space position
+			T Sample(const Point3d &p)
+			{
+				double idx[3];
+				m_grid.WorldToIndex(p, idx);
+				return SampleIndex(idx[0], idx[1], idx[2]);
+			}
+		};
+
+		//! Trilinear interpolation at a world space position, prefer an Accessor for repeated lookups
+		T Sample(const Point3d &p) const
+		{
+			Accessor acc(*this);
+			return acc.Sample(p);
+		}
+
+		//! Walk a world space ray through the leaves of the grid, skipping empty space
+		/*!
+		 * Calls func(double t0, double t1, T minValue, T maxValue) for every leaf the ray passes through,
+		 * in front to back order. Returning false from func stops the walk.
+		 * The parameter t is measured in world units along dir, which should be normalized.
+		 */
+		template <typename F>
+		void MarchLeaves(const Point3d &origin, const Vector3d &dir, double tmin, double tmax, F func) const
+		{
+			if (m_empty) return;
+			double o[3], d[3];
+			WorldToIndex(origin, o);
+			d[0] = dir.x / m_voxelSize;
+			d[1] = dir.y / m_voxelSize;
+			d[2] = dir.z / m_voxelSize;
+
+			// clip against the bounding box, voxels extend half a unit around their centre
+			const double lo[3] = { m_bboxMin.x - 0.5, m_bboxMin.y - 0.5, m_bboxMin.z - 0.5 };
+			const double hi[3] = { m_bboxMax.x + 0.5, m_bboxMax.y + 0.5, m_bboxMax.z + 0.5 };
+			for (int a = 0; a < 3; ++a)
+			{
+				if (d[a] == 0.0)
+				{
+					if ((o[a] < lo[a]) || (o[a] > hi[a])) return;
+					continue;
+				}
+				double t0 = (lo[a] - o[a]) / d[a];
+				double t1 = (hi[a] - o[a]) / d[a];
+				if (t0 > t1) Swap(t0, t1);
+				tmin = Max(tmin, t0);
+				tmax = Min(tmax, t1);
+			}
+			if (tmin >= tmax) return;
+
+			// 3D DDA over cells of leaf size, cell boundaries are offset by half a voxel
+			const double cell = static_cast<double>(Leaf::Dim);
+			int c[3], step[3];
+			double tNext[3], tDelta[3];
+			for (int a = 0; a < 3; ++a)
+			{
+				const double p = o[a] + d[a] * tmin + 0.5;
+				c[a] = Floor(p / cell);
+				if (d[a] > 0.0)
+				{
+					step[a] = 1;
+					tDelta[a] = cell / d[a];
+					tNext[a] = tmin + ((c[a] + 1) * cell - p) / d[a];
+				}
+				else if (d[a] < 0.0)
+				{
+					step[a] = -1;
+					tDelta[a] = -cell / d[a];
+					tNext[a] = tmin + (c[a] * cell - p) / d[a];
+				}
+				else
+				{
+					step[a] = 0;
+					tDelta[a] = tNext[a] = 1e300;
+				}
+			}
+
+			double t = tmin;
+			while (t < tmax)
+			{
+				const int axis = (tNext[0] < tNext[1]) ? ((tNext[0] < tNext[2]) ? 0 : 2) : ((tNext[1] < tNext[2]) ? 1 : 2);
+				const double tExit = Min(tNext[axis], tmax);
+				const Leaf *leaf = probeLeaf(c[0] * Leaf::Dim, c[1] * Leaf::Dim, c[2] * Leaf::Dim);
+				if (leaf)
+				{
+					if (!func(t, tExit, leaf->minValue, leaf->maxValue)) return;
+				}
+				t = tExit;
+				c[axis] += step[axis];
+				tNext[axis] += tDelta[axis];
+			}
+		}
+	};
+
+	typedef VoxelGrid<float> FloatGrid;
+
+	//! Splat particles into a grid
+	/*!
+	 * @ingroup Helper
+	 * Each particle adds density * (1 - (d/r)^2)^3 to every voxel within its radius r.
+	 * The particles are processed in parallel, each thread fills its own grid, which are merged at the end.
+	 * @param radii Radius per particle, if it has only one element it is used for all particles
+	 */
+	template <typename T>
+	void VoxelizeParticles(VoxelGrid<T> &grid, const std::vector<Point3d> &positions, const std::vector<double> &radii, T density, unsigned int numThreads = 0)
+	{
+		if (positions.empty() || radii.empty()) return;
+		if (numThreads == 0) numThreads = ParallelThreadCount();
+		std::vector<std::unique_ptr<VoxelGrid<T>>> local(numThreads);
+		const double vs = grid.getVoxelSize();
+
+		ParallelFor(0, positions.size(), 1024, [&](size_t b, size_t e, unsigned int worker)
+		{
+			std::unique_ptr<VoxelGrid<T>> &g = local[worker];
+			if (!g)
+			{
+				g.reset(new VoxelGrid<T>(vs, grid.getBackground()));
+				g->SetTransform(grid.getOrigin(), vs);
+			}
+			for (size_t i = b; i < e; ++i)
+			{
+				const double r = ((radii.size() > 1) ? radii[i] : radii[0]) / vs;
+				if (r <= 0.0) continue;
+				double p[3];
+				grid.WorldToIndex(positions[i], p);
+				const double invR2 = 1.0 / (r * r);
+				for (int x = Ceil(p[0] - r); x <= Floor(p[0] + r); ++x)
+				{
+					for (int y = Ceil(p[1] - r); y <= Floor(p[1] + r); ++y)
+					{
+						for (int z = Ceil(p[2] - r); z <= Floor(p[2] + r); ++z)
+						{
+							const double q = (Sqr(x - p[0]) + Sqr(y - p[1]) + Sqr(z - p[2])) * invR2;
+							if (q >= 1.0) continue;
+							const double k = (1.0 - q) * (1.0 - q) * (1.0 - q);
+							g->addValue(x, y, z, static_cast<T>(density * k));
+						}
+					}
+				}
+			}
+		}, numThreads);
+
+		for (auto &g : local)
+		{
+			if (g) grid.Merge(*g, VoxelGrid<T>::MERGE_ADD);
+		}
+		grid.UpdateStatistics();
+	}
+
+	//! Fill the interior of a closed triangle mesh with a constant density
+	/*!
+	 * @ingroup Helper
+	 * Voxels are classified by counting the crossings of a ray along +x through every voxel row.
+	 * Rows are processed in parallel in slabs of one leaf.
+	 * @param points World space positions of the mesh vertices
+	 * @param triangles Three vertex indices per triangle
+	 */
+	template <typename T>
+	void VoxelizeMesh(VoxelGrid<T> &grid, const std::vector<Point3d> &points, const std::vector<unsigned int> &triangles, T density, unsigned int numThreads = 0)
+	{
+		if (points.empty() || (triangles.size() < 3)) return;
+		if (numThreads == 0) numThreads = ParallelThreadCount();
+
+		// index space positions
+		std::vector<Point3d> ip(points.size());
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			double p[3];
+			grid.WorldToIndex(points[i], p);
+			ip[i] = Point3d(p[0], p[1], p[2]);
+		}
+
+		// offset the rows slightly to avoid hitting shared edges and vertices exactly
+		const double eps_y = 1.234567e-5, eps_z = 2.345678e-5;
+
+		// sort triangles into slabs along z, by the rows at k + eps_z they cross
+		const int slab = VoxelLeaf<T>::Dim;
+		double zmin = ip[0].z, zmax = ip[0].z;
+		for (auto &p : ip)
+		{
+			zmin = Min(zmin, p.z);
+			zmax = Max(zmax, p.z);
+		}
+		const int kBase = Floor(zmin / slab) * slab;
+		const size_t numSlabs = static_cast<size_t>((Ceil(zmax) - kBase) / slab + 1);
+		std::vector<std::vector<unsigned int>> slabTris(numSlabs);
+		const size_t numTris = triangles.size() / 3;
+		for (unsigned int t = 0; t < numTris; ++t)
+		{
+			const Point3d &a = ip[triangles[3 * t]], &b = ip[triangles[3 * t + 1]], &c = ip[triangles[3 * t + 2]];
+			const int k0 = Ceil(Min(a.z, Min(b.z, c.z)) - eps_z);
+			const int k1 = Floor(Max(a.z, Max(b.z, c.z)) - eps_z);
+			if (k0 > k1) continue;
+			for (int s = (k0 - kBase) / slab; s <= (k1 - kBase) / slab; ++s) slabTris[s].push_back(t);
+		}
+
+		std::vector<std::unique_ptr<VoxelGrid<T>>> local(numThreads);
+		const double vs = grid.getVoxelSize();
+
+		ParallelFor(0, numSlabs, 1, [&](size_t b, size_t e, unsigned int worker)
+		{
+			std::unique_ptr<VoxelGrid<T>> &g = local[worker];
+			if (!g)
+			{
+				g.reset(new VoxelGrid<T>(vs, grid.getBackground()));
+				g->SetTransform(grid.getOrigin(), vs);
+			}
+			std::vector<double> hits;
+			for (size_t s = b; s < e; ++s)
+			{
+				const std::vector<unsigned int> &tris = slabTris[s];
+				if (tris.empty()) continue;
+				double ymin = 1e300, ymax = -1e300;
+				for (auto t : tris)
+				{
+					for (int v = 0; v < 3; ++v)
+					{
+						ymin = Min(ymin, ip[triangles[3 * t + v]].y);
+						ymax = Max(ymax, ip[triangles[3 * t + v]].y);
+					}
+				}
+				const int kStart = kBase + static_cast<int>(s) * slab;
+				for (int k = kStart; k < kStart + slab; ++k)
+				{
+					const double z = k + eps_z;
+					for (int j = Ceil(ymin - eps_y); j <= Floor(ymax - eps_y); ++j)
+					{
+						const double y = j + eps_y;
+						hits.clear();
+						for (auto t : tris)
+						{
+							const Point3d &p0 = ip[triangles[3 * t]], &p1 = ip[triangles[3 * t + 1]], &p2 = ip[triangles[3 * t + 2]];
+							// edge functions in the yz plane
+							const double e0 = (p1.y - p0.y) * (z - p0.z) - (p1.z - p0.z) * (y - p0.y);
+							const double e1 = (p2.y - p1.y) * (z - p1.z) - (p2.z - p1.z) * (y - p1.y);
+							const double e2 = (p0.y - p2.y) * (z - p2.z) - (p0.z - p2.z) * (y - p2.y);
+							if (!(((e0 >= 0.0) && (e1 >= 0.0) && (e2 >= 0.0)) || ((e0 <= 0.0) && (e1 <= 0.0) && (e2 <= 0.0)))) continue;
+							const double sum = e0 + e1 + e2;
+							if (sum == 0.0) continue; // degenerate in projection
+							// barycentric interpolation of x
+							hits.push_back((e1 * p0.x + e2 * p1.x + e0 * p2.x) / sum);
+						}
+						if (hits.size() < 2) continue;
+						std::sort(hits.begin(), hits.end());
+						for (size_t h = 0; h + 1 < hits.size(); h += 2)
+						{
+							for (int x = Ceil(hits[h]); x <= Floor(hits[h + 1]); ++x)
+							{
+								g->setValue(x, j, k, density);
+							}
+						}
+					}
+				}
+			}
+		}, numThreads);
+
+		for (auto &g : local)
+		{
+			if (g) grid.Merge(*g, VoxelGrid<T>::MERGE_MAX);
+		}
+		grid.UpdateStatistics();
+	}
+} // end namespace lwpp
+
+#endif // LWPP_VOXEL_GRID_H
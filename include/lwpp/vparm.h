@@ -7,6 +7,7 @@
 #include <lwvparm.h>
 #include "lwpp/storeable.h"
 #include "lwpp/envelope.h"
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -169,6 +170,67 @@ namespace lwpp
 		}
 	};
   
+	//! Evaluates a VParm at a set of times once per frame
+	/*!
+	 * Renderers evaluate the same parameters at the same sub-frame times for every motion blur pass, so
+	 * sampling them once per frame is enough. A VParm without envelopes is read only once.
+	 *
+	 * Call Update() from NewTime() or another single threaded context, the sampled values may then be read from
+	 * any number of threads.
+	 * @code
+	 * // in NewTime()
+	 * scaleSampler.Update(time - blurLength, time, passes);
+	 * // while rendering
+	 * Vector3d scale;
+	 * scaleSampler.Evaluate(sa->time, scale);
+	 * @endcode
+	 */
+	class VParmSampler
+	{
+		VParm &m_vparm;
+		std::vector<LWTime> m_times;	//!< Sorted sample times
+		std::vector<Vector3d> m_values;
+		bool m_constant;
+	public:
+		VParmSampler(VParm &vparm) : m_vparm(vparm), m_constant(false) {}
+
+		//! Evaluate the VParm at a number of times
+		void Update(const LWTime *times, size_t count);
+		//! Evaluate the VParm at count times evenly spread over [start, end]
+		void Update(LWTime start, LWTime end, size_t count);
+		void Update(LWTime time) { Update(&time, 1); }
+
+		//! Check if the VParm had no envelopes during the last Update()
+		bool isConstant() const { return m_constant; }
+		size_t Count() const { return m_times.size(); }
+		LWTime Time(size_t i) const { return m_times[i]; }
+		//! Value at the i-th sample time
+		const Vector3d &Value(size_t i) const { return m_values[m_constant ? 0 : i]; }
+
+		//! Value at a time, sampled times and constant VParms don't call LightWave
+		void Evaluate(LWTime t, Vector3d &val)
+		{
+			if (m_constant && !m_values.empty())
+			{
+				val = m_values[0];
+				return;
+			}
+			std::vector<LWTime>::const_iterator i = std::lower_bound(m_times.begin(), m_times.end(), t - 1e-9);
+			if ((i != m_times.end()) && (*i <= t + 1e-9))
+			{
+				val = m_values[i - m_times.begin()];
+				return;
+			}
+			m_vparm.Evaluate(t, val);
+		}
+		double EvaluateScalar(LWTime t)
+		{
+			Vector3d val;
+			Evaluate(t, val);
+			return val.x;
+		}
+	};
+
   typedef std::unique_ptr<VParm> auto_VParm;
 	typedef std::shared_ptr<VParm> shared_VParm;   
   typedef std::unique_ptr<VParm> unique_VParm;
@@ -0,0 +1,330 @@
+/*!
+ * @file
+ * @brief Implementation of the CustomObjDrawList
+ */
+#include <lwpp/customobject_drawlist.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lwpp
+{
+	CustomObjDrawList::CustomObjDrawList()
+		: lodThreshold(0.0005), maxStripLength(256), m_version(0), m_drawn(0), m_recorded(false)
+	{
+		;
+	}
+
+	void CustomObjDrawList::Clear()
+	{
+		m_commands.clear();
+		m_vertices.clear();
+		m_indexedVertices.clear();
+		m_indices.clear();
+		m_floats.clear();
+		m_text.clear();
+		m_recorded = false;
+	}
+
+	void CustomObjDrawList::Begin(unsigned long long version)
+	{
+		Clear();
+		m_version = version;
+	}
+
+	void CustomObjDrawList::End()
+	{
+		m_recorded = true;
+	}
+
+	CustomObjDrawList::Command &CustomObjDrawList::add(CommandType type, int csys, unsigned int first, unsigned int count, int value)
+	{
+		Command cmd;
+		cmd.type = static_cast<unsigned char>(type);
+		cmd.csys = csys;
+		cmd.first = first;
+		cmd.count = count;
+		cmd.value = value;
+		for (int i = 0; i < 3; ++i)
+		{
+			cmd.min[i] = std::numeric_limits<float>::max();
+			cmd.max[i] = -std::numeric_limits<float>::max();
+		}
+		m_commands.push_back(cmd);
+		return m_commands.back();
+	}
+
+	unsigned int CustomObjDrawList::addVertices(unsigned int numv, const double p[][3])
+	{
+		const unsigned int first = static_cast<unsigned int>(m_vertices.size() / 3);
+		for (unsigned int i = 0; i < numv; ++i)
+		{
+			m_vertices.insert(m_vertices.end(), p[i], p[i] + 3);
+		}
+		return first;
+	}
+
+	void CustomObjDrawList::grow(Command &cmd, const double p[3], double radius)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			cmd.min[i] = std::min(cmd.min[i], static_cast<float>(p[i] - radius));
+			cmd.max[i] = std::max(cmd.max[i], static_cast<float>(p[i] + radius));
+		}
+	}
+
+	void CustomObjDrawList::SetColor(const float rgba[4])
+	{
+		add(CMD_COLOR, 0, static_cast<unsigned int>(m_floats.size()), 4);
+		m_floats.insert(m_floats.end(), rgba, rgba + 4);
+	}
+
+	void CustomObjDrawList::SetColor(float r, float g, float b, float a)
+	{
+		const float rgba[4] = { r, g, b, a };
+		SetColor(rgba);
+	}
+
+	void CustomObjDrawList::SetColorCC(const float rgba[4])
+	{
+		add(CMD_COLOR_CC, 0, static_cast<unsigned int>(m_floats.size()), 4);
+		m_floats.insert(m_floats.end(), rgba, rgba + 4);
+	}
+
+	void CustomObjDrawList::SetPattern(int lpat)
+	{
+		add(CMD_PATTERN, 0, 0, 0, lpat);
+	}
+
+	void CustomObjDrawList::SetThickness(float pointSize, float lineWidth)
+	{
+		add(CMD_THICKNESS, 0, static_cast<unsigned int>(m_floats.size()), 2);
+		m_floats.push_back(pointSize);
+		m_floats.push_back(lineWidth);
+	}
+
+	void CustomObjDrawList::SetPart(unsigned int part)
+	{
+		add(CMD_PART, 0, 0, 0, static_cast<int>(part));
+	}
+
+	void CustomObjDrawList::SetDrawMode(unsigned int mode)
+	{
+		add(CMD_DRAWMODE, 0, 0, 0, static_cast<int>(mode));
+	}
+
+	void CustomObjDrawList::DrawPoint(const double pos[3], int csys)
+	{
+		const double p[1][3] = { { pos[0], pos[1], pos[2] } };
+		Command &cmd = add(CMD_POINT, csys, addVertices(1, p), 1);
+		grow(cmd, pos);
+	}
+
+	void CustomObjDrawList::DrawLine(const double from[3], const double to[3], int csys)
+	{
+		if (!m_commands.empty())
+		{
+			Command &last = m_commands.back();
+			if ((last.type == CMD_LINES) && (last.csys == csys) && (last.count < maxStripLength) &&
+					(last.first + last.count == m_vertices.size() / 3))
+			{
+				const double *end = &m_vertices[m_vertices.size() - 3];
+				if ((end[0] == from[0]) && (end[1] == from[1]) && (end[2] == from[2]))
+				{
+					m_vertices.insert(m_vertices.end(), to, to + 3);
+					++last.count;
+					grow(last, to);
+					return;
+				}
+			}
+		}
+		const double p[2][3] = { { from[0], from[1], from[2] }, { to[0], to[1], to[2] } };
+		Command &cmd = add(CMD_LINES, csys, addVertices(2, p), 2);
+		grow(cmd, from);
+		grow(cmd, to);
+	}
+
+	void CustomObjDrawList::LineStrip(unsigned int numv, const double p[][3], int csys)
+	{
+		if (numv < 2) return;
+		Command &cmd = add(CMD_STRIP, csys, addVertices(numv, p), numv);
+		for (unsigned int i = 0; i < numv; ++i) grow(cmd, p[i]);
+	}
+
+	void CustomObjDrawList::LineLoop(unsigned int numv, const double p[][3], int csys)
+	{
+		if (numv < 2) return;
+		Command &cmd = add(CMD_LOOP, csys, addVertices(numv, p), numv);
+		for (unsigned int i = 0; i < numv; ++i) grow(cmd, p[i]);
+	}
+
+	void CustomObjDrawList::DrawTriangle(const double v1[3], const double v2[3], const double v3[3], int csys)
+	{
+		const double p[3][3] = { { v1[0], v1[1], v1[2] }, { v2[0], v2[1], v2[2] }, { v3[0], v3[1], v3[2] } };
+		Command &cmd = add(CMD_TRIANGLE, csys, addVertices(3, p), 3);
+		for (int i = 0; i < 3; ++i) grow(cmd, p[i]);
+	}
+
+	void CustomObjDrawList::DrawQuad(const double v1[3], const double v2[3], const double v3[3], const double v4[3], int csys)
+	{
+		const double p[4][3] = { { v1[0], v1[1], v1[2] }, { v2[0], v2[1], v2[2] }, { v3[0], v3[1], v3[2] }, { v4[0], v4[1], v4[2] } };
+		Command &cmd = add(CMD_QUAD, csys, addVertices(4, p), 4);
+		for (int i = 0; i < 4; ++i) grow(cmd, p[i]);
+	}
+
+	void CustomObjDrawList::DrawPolygon(unsigned int numv, const double v[][3], int csys)
+	{
+		if (numv < 3) return;
+		// stored as an indexed polygon over its own vertices
+		const unsigned int base = static_cast<unsigned int>(m_indexedVertices.size() / 3);
+		Command &cmd = add(CMD_POLYGON, csys, static_cast<unsigned int>(m_indices.size()), numv);
+		for (unsigned int i = 0; i < numv; ++i)
+		{
+			m_indexedVertices.insert(m_indexedVertices.end(), v[i], v[i] + 3);
+			m_indices.push_back(base + i);
+			grow(cmd, v[i]);
+		}
+	}
+
+	unsigned int CustomObjDrawList::AddVertex(const double pos[3])
+	{
+		m_indexedVertices.insert(m_indexedVertices.end(), pos, pos + 3);
+		return static_cast<unsigned int>(m_indexedVertices.size() / 3 - 1);
+	}
+
+	void CustomObjDrawList::DrawPolygonIndexed(unsigned int numv, const unsigned int indices[], int csys)
+	{
+		if (numv < 3) return;
+		Command &cmd = add(CMD_POLYGON, csys, static_cast<unsigned int>(m_indices.size()), numv);
+		for (unsigned int i = 0; i < numv; ++i)
+		{
+			m_indices.push_back(indices[i]);
+			grow(cmd, &m_indexedVertices[3 * indices[i]]);
+		}
+	}
+
+	void CustomObjDrawList::DrawCircle(const double centre[3], double radius, int csys)
+	{
+		const double p[1][3] = { { centre[0], centre[1], centre[2] } };
+		Command &cmd = add(CMD_CIRCLE, csys, addVertices(1, p), static_cast<unsigned int>(m_floats.size()));
+		m_floats.push_back(static_cast<float>(radius));
+		grow(cmd, centre, radius);
+	}
+
+	void CustomObjDrawList::DrawDisk(const double centre[3], double radius, int csys)
+	{
+		const double p[1][3] = { { centre[0], centre[1], centre[2] } };
+		Command &cmd = add(CMD_DISK, csys, addVertices(1, p), static_cast<unsigned int>(m_floats.size()));
+		m_floats.push_back(static_cast<float>(radius));
+		grow(cmd, centre, radius);
+	}
+
+	void CustomObjDrawList::DrawText(const double pos[3], const std::string &text, int just, int csys)
+	{
+		const double p[1][3] = { { pos[0], pos[1], pos[2] } };
+		Command &cmd = add(CMD_TEXT, csys, addVertices(1, p), static_cast<unsigned int>(m_text.size()), just);
+		m_text.push_back(text);
+		grow(cmd, pos);
+	}
+
+	void CustomObjDrawList::Draw(CustomObjAccess &access)
+	{
+		const Point3d viewPos = access.GetViewPos();
+		const Vector3d viewDir = access.GetViewDir();
+		draw(access, &viewPos, &viewDir, false);
+	}
+
+	void CustomObjDrawList::Draw(CustomObjAccess &access, const Point3d &viewPos, const Vector3d &viewDir)
+	{
+		draw(access, &viewPos, &viewDir, true);
+	}
+
+	void CustomObjDrawList::draw(CustomObjAccess &access, const Point3d *viewPos, const Vector3d *viewDir, bool cullObject)
+	{
+		m_drawn = 0;
+		const int view = access.View();
+		const bool perspective = (view == LWVIEW_PERSP) || (view == LWVIEW_LIGHT) || (view == LWVIEW_CAMERA);
+		const bool cull = perspective && viewPos && viewDir;
+		// small elements stay pickable
+		const double lod = access.isPicking() ? 0.0 : lodThreshold;
+		double (*vertices)[3] = m_vertices.empty() ? nullptr : reinterpret_cast<double (*)[3]>(&m_vertices[0]);
+		double (*indexed)[3] = m_indexedVertices.empty() ? nullptr : reinterpret_cast<double (*)[3]>(&m_indexedVertices[0]);
+
+		for (auto &cmd : m_commands)
+		{
+			if (cull && (cmd.type >= CMD_POINT) && ((cmd.csys == LWCSYS_WORLD) || (cullObject && (cmd.csys == LWCSYS_OBJECT))))
+			{
+				const Point3d centre(0.5 * (cmd.min[0] + cmd.max[0]), 0.5 * (cmd.min[1] + cmd.max[1]), 0.5 * (cmd.min[2] + cmd.max[2]));
+				const Vector3d half(0.5 * (cmd.max[0] - cmd.min[0]), 0.5 * (cmd.max[1] - cmd.min[1]), 0.5 * (cmd.max[2] - cmd.min[2]));
+				const double radius = half.Magnitude();
+				const Vector3d d = centre - *viewPos;
+				if (Dot(d, *viewDir) < -radius) continue;
+				const double distance = d.Magnitude();
+				if ((lod > 0.0) && (distance > radius) && (radius < lod * distance) && (cmd.type != CMD_TEXT)) continue;
+			}
+			switch (cmd.type)
+			{
+				case CMD_COLOR:
+					access.SetColor(&m_floats[cmd.first]);
+					break;
+				case CMD_COLOR_CC:
+					access.SetColorCC(&m_floats[cmd.first]);
+					break;
+				case CMD_PATTERN:
+					access.SetPattern(cmd.value);
+					break;
+				case CMD_THICKNESS:
+					access.SetThickness(m_floats[cmd.first], m_floats[cmd.first + 1]);
+					break;
+				case CMD_PART:
+					access.SetPart(static_cast<unsigned int>(cmd.value));
+					break;
+				case CMD_DRAWMODE:
+					access.SetDrawMode(static_cast<unsigned int>(cmd.value));
+					break;
+				case CMD_POINT:
+					access.DrawPoint(vertices[cmd.first], cmd.csys);
+					break;
+				case CMD_LINES:
+				case CMD_STRIP:
+					if (cmd.count == 2) access.DrawLine(vertices[cmd.first], vertices[cmd.first + 1], cmd.csys);
+					else access.LineStrip(cmd.count, vertices + cmd.first, cmd.csys);
+					break;
+				case CMD_LOOP:
+					access.LineLoop(cmd.count, vertices + cmd.first, cmd.csys);
+					break;
+				case CMD_TRIANGLE:
+					access.DrawTriangle(vertices[cmd.first], vertices[cmd.first + 1], vertices[cmd.first + 2], cmd.csys);
+					break;
+				case CMD_QUAD:
+					access.DrawQuad(vertices[cmd.first], vertices[cmd.first + 1], vertices[cmd.first + 2], vertices[cmd.first + 3], cmd.csys);
+					break;
+				case CMD_POLYGON:
+					access.DrawPolygon(cmd.count, &m_indices[cmd.first], indexed, cmd.csys);
+					break;
+				case CMD_CIRCLE:
+					access.DrawCircle(vertices[cmd.first], m_floats[cmd.count], cmd.csys);
+					break;
+				case CMD_DISK:
+					access.DrawDisk(vertices[cmd.first], m_floats[cmd.count], cmd.csys);
+					break;
+				case CMD_TEXT:
+					access.DrawText(vertices[cmd.first], m_text[cmd.count].c_str(), cmd.value, cmd.csys);
+					break;
+			}
+			if (cmd.type >= CMD_POINT) ++m_drawn;
+		}
+	}
+
+	size_t CustomObjDrawList::MemorySize() const
+	{
+		size_t size = sizeof(*this) +
+			m_commands.capacity() * sizeof(Command) +
+			(m_vertices.capacity() + m_indexedVertices.capacity()) * sizeof(double) +
+			m_indices.capacity() * sizeof(unsigned int) +
+			m_floats.capacity() * sizeof(float) +
+			m_text.capacity() * sizeof(std::string);
+		for (auto &text : m_text) size += text.capacity();
+		return size;
+	}
+} // end namespace lwpp
@@ -13,8 +13,6 @@
 // #include <sys/misc.h>
 #include <lwpp/platform.h>
 
-static dirent staticDirent;
-
 int closedir(DIR *toClose){
 
         if(!toClose || !toClose->isOpen)
@@ -63,13 +61,15 @@ struct dirent *readdir(DIR *toRead){
 
         dirent *temp;
 
-        memset(&staticDirent, 0, sizeof(dirent));
-        readdir_r(toRead, &staticDirent, &temp);
+        if(!toRead)
+                return NULL;
+
+        readdir_r(toRead, &toRead->entry, &temp);
 
-        if(temp != &staticDirent)
+        if(temp != &toRead->entry)
                 return NULL;
 
-        return &staticDirent;
+        return &toRead->entry;
 }
 
 int readdir_r(DIR *toRead, struct dirent *entry, struct dirent **result){
@@ -89,6 +89,12 @@ int readdir_r(DIR *toRead, struct dirent *entry, struct dirent **result){
         entry->d_off = toRead->position;
         entry->d_reclen = 1;
         strcpy(entry->d_name, toRead->findData.cFileName);
+        entry->d_type = (toRead->findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? DT_DIR : DT_REG;
+        entry->d_size = (static_cast<unsigned long long>(toRead->findData.nFileSizeHigh) << 32) | toRead->findData.nFileSizeLow;
+        // FILETIME counts 100ns intervals since 1601
+        const unsigned long long writeTime = (static_cast<unsigned long long>(toRead->findData.ftLastWriteTime.dwHighDateTime) << 32) |
+                toRead->findData.ftLastWriteTime.dwLowDateTime;
+        entry->d_mtime = static_cast<time_t>((writeTime - 116444736000000000ULL) / 10000000ULL);
 
         (!FindNextFile(toRead->findHandle, &toRead->findData)) ? 
                 (toRead->findDataValid = false) : (toRead->position++);
@@ -0,0 +1,267 @@
+/*!
+ * @file
+ * @brief Implementation of the EnvironmentMap
+ */
+#include <lwpp/environment_map.h>
+#include <lwpp/image_sampler.h>
+#include <lwpp/math.h>
+#include <algorithm>
+#include <cmath>
+
+namespace lwpp
+{
+	EnvironmentMap::EnvironmentMap()
+		: m_width(0), m_height(0), m_integral(0.0), m_power(0.0)
+	{
+		;
+	}
+
+	void EnvironmentMap::Clear()
+	{
+		m_width = m_height = 0;
+		m_levels.clear();
+		m_conditional.clear();
+		m_rowIntegral.clear();
+		m_marginal.clear();
+		m_integral = 0.0;
+		m_power = 0.0;
+	}
+
+	void EnvironmentMap::allocate(int width, int height)
+	{
+		Clear();
+		m_width = Max(width, 2);
+		m_height = Max(height, 1);
+		m_levels.resize(1);
+		m_levels[0].width = m_width;
+		m_levels[0].height = m_height;
+		m_levels[0].rgb.assign(3 * static_cast<size_t>(m_width) * m_height, 0.0f);
+	}
+
+	bool EnvironmentMap::Build(LWImageID image, int width)
+	{
+		ImageSampler sampler;
+		if (!sampler.Build(image))
+		{
+			Clear();
+			return false;
+		}
+		if (width <= 0) width = sampler.getWidth();
+		const int height = Max(width / 2, 1);
+		const double du = 1.0 / width, dv = 1.0 / height;
+		Build(width, height, [&](const Vector3d &dir, double rgb[3])
+		{
+			double u, v, rgba[4];
+			DirectionToUV(dir, u, v);
+			// image v runs from the bottom to the top
+			sampler.Sample(u, 1.0 - v, du, 0.0, 0.0, dv, SAMPLE_TRILINEAR, TWRAP_REPEAT, TWRAP_EDGE, rgba);
+			rgb[0] = rgba[0];
+			rgb[1] = rgba[1];
+			rgb[2] = rgba[2];
+		});
+		return true;
+	}
+
+	void EnvironmentMap::finalise()
+	{
+		// mip pyramid
+		while ((m_levels.back().width > 1) || (m_levels.back().height > 1))
+		{
+			const Level &fine = m_levels.back();
+			Level coarse;
+			coarse.width = Max(fine.width / 2, 1);
+			coarse.height = Max(fine.height / 2, 1);
+			coarse.rgb.resize(3 * static_cast<size_t>(coarse.width) * coarse.height);
+			for (int y = 0; y < coarse.height; ++y)
+			{
+				const int y0 = Min(2 * y, fine.height - 1), y1 = Min(2 * y + 1, fine.height - 1);
+				for (int x = 0; x < coarse.width; ++x)
+				{
+					const int x0 = Min(2 * x, fine.width - 1), x1 = Min(2 * x + 1, fine.width - 1);
+					for (int c = 0; c < 3; ++c)
+					{
+						coarse.rgb[3 * (static_cast<size_t>(y) * coarse.width + x) + c] = 0.25f *
+							(fine.rgb[3 * (static_cast<size_t>(y0) * fine.width + x0) + c] + fine.rgb[3 * (static_cast<size_t>(y0) * fine.width + x1) + c] +
+							 fine.rgb[3 * (static_cast<size_t>(y1) * fine.width + x0) + c] + fine.rgb[3 * (static_cast<size_t>(y1) * fine.width + x1) + c]);
+					}
+				}
+			}
+			m_levels.push_back(coarse);
+		}
+
+		// sampling tables, the luminance is weighted by the solid angle of each row
+		const Level &base = m_levels[0];
+		const size_t w = m_width;
+		m_conditional.resize((w + 1) * m_height);
+		m_rowIntegral.resize(m_height);
+		ParallelFor(0, m_height, 16, [&](size_t b, size_t e, unsigned int)
+		{
+			for (size_t y = b; y < e; ++y)
+			{
+				const double sinTheta = std::sin(PI * (y + 0.5) / m_height);
+				float *cdf = &m_conditional[y * (w + 1)];
+				const float *rgb = &base.rgb[3 * y * w];
+				double sum = 0.0;
+				cdf[0] = 0.0f;
+				for (size_t x = 0; x < w; ++x)
+				{
+					sum += Max(Colour2Luma(rgb + 3 * x), 0.0f) * sinTheta;
+					cdf[x + 1] = static_cast<float>(sum);
+				}
+				m_rowIntegral[y] = static_cast<float>(sum);
+				for (size_t x = 1; x <= w; ++x)
+				{
+					cdf[x] = (sum > 0.0) ? static_cast<float>(cdf[x] / sum) : static_cast<float>(x) / w;
+				}
+				cdf[w] = 1.0f;
+			}
+		});
+
+		m_marginal.resize(m_height + 1);
+		double sum = 0.0;
+		m_marginal[0] = 0.0f;
+		for (int y = 0; y < m_height; ++y)
+		{
+			sum += m_rowIntegral[y];
+			m_marginal[y + 1] = static_cast<float>(sum);
+		}
+		m_integral = sum;
+		for (int y = 1; y <= m_height; ++y)
+		{
+			m_marginal[y] = (sum > 0.0) ? static_cast<float>(m_marginal[y] / sum) : static_cast<float>(y) / m_height;
+		}
+		m_marginal[m_height] = 1.0f;
+		// each texel covers 2PI/w * PI/h of the (phi, theta) domain
+		m_power = m_integral * (2.0 * PI * PI / (static_cast<double>(m_width) * m_height)) / (4.0 * PI);
+	}
+
+	Vector3d EnvironmentMap::TexelDirection(int x, int y) const
+	{
+		return UVToDirection((x + 0.5) / m_width, (y + 0.5) / m_height);
+	}
+
+	void EnvironmentMap::DirectionToUV(const Vector3d &dir, double &u, double &v)
+	{
+		const double len = std::sqrt(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+		const double y = (len > 0.0) ? dir.y / len : 1.0;
+		u = 0.5 + std::atan2(dir.x, dir.z) / TWOPI;
+		v = std::acos(Clamp(y, -1.0, 1.0)) / PI;
+	}
+
+	Vector3d EnvironmentMap::UVToDirection(double u, double v)
+	{
+		const double phi = (u - 0.5) * TWOPI;
+		const double theta = v * PI;
+		const double sinTheta = std::sin(theta);
+		return Vector3d(sinTheta * std::sin(phi), std::cos(theta), sinTheta * std::cos(phi));
+	}
+
+	void EnvironmentMap::bilinear(const Level &level, double u, double v, double rgb[3]) const
+	{
+		const double fx = u * level.width - 0.5;
+		const double fy = Clamp(v * level.height - 0.5, 0.0, static_cast<double>(level.height - 1));
+		const int x0 = static_cast<int>(std::floor(fx));
+		const int y0 = static_cast<int>(fy);
+		const double tx = fx - x0, ty = fy - y0;
+		const int xa = ((x0 % level.width) + level.width) % level.width;
+		const int xb = (xa + 1) % level.width;
+		const int yb = Min(y0 + 1, level.height - 1);
+		const float *t00 = &level.rgb[3 * (static_cast<size_t>(y0) * level.width + xa)];
+		const float *t10 = &level.rgb[3 * (static_cast<size_t>(y0) * level.width + xb)];
+		const float *t01 = &level.rgb[3 * (static_cast<size_t>(yb) * level.width + xa)];
+		const float *t11 = &level.rgb[3 * (static_cast<size_t>(yb) * level.width + xb)];
+		for (int c = 0; c < 3; ++c)
+		{
+			rgb[c] = (1.0 - ty) * ((1.0 - tx) * t00[c] + tx * t10[c]) + ty * ((1.0 - tx) * t01[c] + tx * t11[c]);
+		}
+	}
+
+	void EnvironmentMap::Lookup(const Vector3d &dir, double rgb[3]) const
+	{
+		if (!isValid())
+		{
+			rgb[0] = rgb[1] = rgb[2] = 0.0;
+			return;
+		}
+		double u, v;
+		DirectionToUV(dir, u, v);
+		bilinear(m_levels[0], u, v, rgb);
+	}
+
+	void EnvironmentMap::Lookup(const Vector3d &dir, double solidAngle, double rgb[3]) const
+	{
+		if (!isValid())
+		{
+			rgb[0] = rgb[1] = rgb[2] = 0.0;
+			return;
+		}
+		const double texelAngle = 4.0 * PI / (static_cast<double>(m_width) * m_height);
+		const double level = (solidAngle > texelAngle) ? 0.5 * std::log(solidAngle / texelAngle) / std::log(2.0) : 0.0;
+		const int maxLevel = static_cast<int>(m_levels.size()) - 1;
+		double u, v;
+		DirectionToUV(dir, u, v);
+		if (level <= 0.0)
+		{
+			bilinear(m_levels[0], u, v, rgb);
+			return;
+		}
+		if (level >= maxLevel)
+		{
+			bilinear(m_levels[maxLevel], u, v, rgb);
+			return;
+		}
+		const int l0 = static_cast<int>(level);
+		const double t = level - l0;
+		double a[3], b[3];
+		bilinear(m_levels[l0], u, v, a);
+		bilinear(m_levels[l0 + 1], u, v, b);
+		for (int c = 0; c < 3; ++c) rgb[c] = Lerp(t, a[c], b[c]);
+	}
+
+	size_t EnvironmentMap::sampleCdf(const float *cdf, size_t n, double u, double &offset)
+	{
+		const float *found = std::upper_bound(cdf, cdf + n + 1, static_cast<float>(u));
+		size_t i = (found == cdf) ? 0 : static_cast<size_t>(found - cdf) - 1;
+		if (i >= n) i = n - 1;
+		// skip empty cells at the upper end
+		while ((i > 0) && (cdf[i + 1] <= cdf[i]) && (cdf[i] >= u)) --i;
+		const double width = cdf[i + 1] - cdf[i];
+		offset = (width > 0.0) ? Clamp((u - cdf[i]) / width, 0.0, 1.0) : 0.5;
+		return i;
+	}
+
+	bool EnvironmentMap::Sample(double u1, double u2, Vector3d &dir, double rgb[3], double &pdf) const
+	{
+		pdf = 0.0;
+		if (!isValid() || (m_integral <= 0.0)) return false;
+		double dy, dx;
+		const size_t y = sampleCdf(&m_marginal[0], m_height, u2, dy);
+		const size_t x = sampleCdf(&m_conditional[y * (m_width + 1)], m_width, u1, dx);
+		const double u = (x + dx) / m_width;
+		const double v = (y + dy) / m_height;
+		const double sinTheta = std::sin(PI * v);
+		if (sinTheta <= 0.0) return false;
+
+		const float *cdf = &m_conditional[y * (m_width + 1)];
+		const double f = (cdf[x + 1] - cdf[x]) * m_rowIntegral[y];
+		const double pdfUV = f * m_width * m_height / m_integral;
+		pdf = pdfUV / (2.0 * PI * PI * sinTheta);
+		dir = UVToDirection(u, v);
+		Lookup(dir, rgb);
+		return pdf > 0.0;
+	}
+
+	double EnvironmentMap::Pdf(const Vector3d &dir) const
+	{
+		if (!isValid() || (m_integral <= 0.0)) return 0.0;
+		double u, v;
+		DirectionToUV(dir, u, v);
+		const int x = Clamp(static_cast<int>(u * m_width), 0, m_width - 1);
+		const int y = Clamp(static_cast<int>(v * m_height), 0, m_height - 1);
+		const double sinTheta = std::sin(PI * v);
+		if (sinTheta <= 0.0) return 0.0;
+		const float *cdf = &m_conditional[static_cast<size_t>(y) * (m_width + 1)];
+		const double f = (cdf[x + 1] - cdf[x]) * m_rowIntegral[y];
+		return f * m_width * m_height / (m_integral * 2.0 * PI * PI * sinTheta);
+	}
+} // end namespace lwpp
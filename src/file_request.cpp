@@ -1,6 +1,8 @@
 #include <lwpp/file_request.h>
 #include <fstream>
 #include <lwpp/message.h>
+#include <lwpp/threads.h>
+#include <algorithm>
 
 #if !defined(S_ISDIR)
 //#define S_ISDIR(m) (((m) & 0170000) == 0040000)
@@ -392,7 +394,8 @@ namespace lwpp
 	}
 	Directory::Directory(const std::string name)
 		: directory (0),
-			entry(0)
+			entry(0),
+			path(name)
 	{
 		directory = opendir(name.c_str());
 #ifdef _DEBUG_LWPP
@@ -425,7 +428,279 @@ namespace lwpp
 		}
 		return 0;
 	}
-		
+
+	bool Directory::getEntry(DirectoryEntry &info, bool withStat)
+	{
+		const char *name = getEntry();
+		if (!name) return false;
+		info.name = name;
+		info.path = path;
+		if (!path.empty() && (path[path.size() - 1] != fSep)) info.path += fSep;
+		info.path += name;
+		info.directory = false;
+		info.size = 0;
+		info.mtime = 0;
+#ifdef LWPP_PLATFORM_WIN
+		// the find data already holds everything
+		(void)withStat;
+		info.directory = (entry->d_type == DT_DIR);
+		info.size = static_cast<size_t>(entry->d_size);
+		info.mtime = entry->d_mtime;
+#else
+		int type = 0;
+#ifdef DT_DIR
+		type = entry->d_type;
+		if ((type == DT_LNK) || (type == DT_UNKNOWN)) type = 0; // links need to be resolved
+#endif
+		if (withStat || (type == 0))
+		{
+			struct _stat buf;
+			if (_stat(info.path.c_str(), &buf) == 0)
+			{
+				info.directory = (S_ISDIR(buf.st_mode) != 0);
+				if (withStat)
+				{
+					info.size = static_cast<size_t>(buf.st_size);
+					info.mtime = buf.st_mtime;
+				}
+			}
+		}
+#ifdef DT_DIR
+		else
+		{
+			info.directory = (type == DT_DIR);
+		}
+#endif
+#endif
+		return true;
+	}
+
+	static bool entryLess(const DirectoryEntry &a, const DirectoryEntry &b)
+	{
+		return a.name < b.name;
+	}
+
+	bool ListDirectory(const std::string &path, DirectoryListing &entries, bool hidden)
+	{
+		entries.clear();
+		Directory dir(path);
+		if (!dir.exists()) return false;
+		DirectoryEntry info;
+		while (dir.getEntry(info))
+		{
+			if (!hidden && (info.name[0] == '.')) continue;
+			entries.push_back(info);
+		}
+		std::sort(entries.begin(), entries.end(), entryLess);
+		return true;
+	}
+
+	static inline int globChar(char c)
+	{
+#ifdef LWPP_PLATFORM_WIN
+		return tolower(static_cast<unsigned char>(c));
+#else
+		return static_cast<unsigned char>(c);
+#endif
+	}
+
+	//! Match a single pattern in [p, pEnd)
+	static bool matchGlob(const char *p, const char *pEnd, const char *name)
+	{
+		const char *starP = 0, *starName = 0;
+		while (*name)
+		{
+			if (p < pEnd)
+			{
+				if (*p == '*')
+				{
+					starP = ++p;
+					starName = name;
+					continue;
+				}
+				if (*p == '[')
+				{
+					const char *q = p + 1;
+					const bool negate = (q < pEnd) && ((*q == '!') || (*q == '^'));
+					if (negate) ++q;
+					bool found = false;
+					const int c = globChar(*name);
+					while ((q < pEnd) && (*q != ']'))
+					{
+						if ((q + 2 < pEnd) && (q[1] == '-') && (q[2] != ']'))
+						{
+							found |= (c >= globChar(q[0])) && (c <= globChar(q[2]));
+							q += 3;
+						}
+						else
+						{
+							found |= (c == globChar(*q));
+							++q;
+						}
+					}
+					if ((q < pEnd) && (found != negate))
+					{
+						p = q + 1;
+						++name;
+						continue;
+					}
+				}
+				else if ((*p == '?') || (globChar(*p) == globChar(*name)))
+				{
+					++p;
+					++name;
+					continue;
+				}
+			}
+			// mismatch, let the last * consume one more character
+			if (!starP) return false;
+			p = starP;
+			name = ++starName;
+		}
+		while ((p < pEnd) && (*p == '*')) ++p;
+		return p == pEnd;
+	}
+
+	bool MatchGlob(const char *pattern, const char *name)
+	{
+		if (!pattern || !*pattern) return true;
+		const char *p = pattern;
+		for (;;)
+		{
+			const char *end = strchr(p, ';');
+			if (!end) end = p + strlen(p);
+			if ((end > p) && matchGlob(p, end, name)) return true;
+			if (!*end) return false;
+			p = end + 1;
+		}
+	}
+
+	typedef std::shared_ptr<const DirectoryListing> SharedListing;
+
+	//! Breadth first walk, reading all directories of a level in parallel
+	template <typename ListFunc>
+	static void walkDirectory(const std::string &path, DirectoryListing &files, const std::string &pattern, bool recursive, unsigned int numThreads, ListFunc list)
+	{
+		struct Node
+		{
+			std::string path;
+			SharedListing listing;
+			size_t firstChild;
+			size_t childCount;
+		};
+		const int maxDepth = 64; // guards against cycles of linked directories
+		files.clear();
+		std::vector<Node> nodes(1);
+		nodes[0].path = path;
+		size_t levelBegin = 0;
+		for (int depth = 0; levelBegin < nodes.size(); ++depth)
+		{
+			const size_t levelEnd = nodes.size();
+			ParallelFor(levelBegin, levelEnd, 1, [&](size_t b, size_t e, unsigned int)
+			{
+				for (size_t i = b; i < e; ++i) nodes[i].listing = list(nodes[i].path);
+			}, numThreads);
+			for (size_t i = levelBegin; i < levelEnd; ++i)
+			{
+				nodes[i].firstChild = nodes.size();
+				nodes[i].childCount = 0;
+				if (!recursive || (depth >= maxDepth) || !nodes[i].listing) continue;
+				const DirectoryListing &listing = *nodes[i].listing;
+				for (size_t j = 0; j < listing.size(); ++j)
+				{
+					if (!listing[j].directory) continue;
+					Node child;
+					child.path = listing[j].path;
+					nodes.push_back(child);
+					++nodes[i].childCount;
+				}
+			}
+			levelBegin = levelEnd;
+		}
+
+		// files of each directory followed by its sub directories
+		std::vector<size_t> stack(1, 0);
+		while (!stack.empty())
+		{
+			const Node &node = nodes[stack.back()];
+			stack.pop_back();
+			if (node.listing)
+			{
+				const DirectoryListing &listing = *node.listing;
+				for (size_t j = 0; j < listing.size(); ++j)
+				{
+					if (!listing[j].directory && MatchGlob(pattern.c_str(), listing[j].name.c_str())) files.push_back(listing[j]);
+				}
+			}
+			for (size_t c = node.childCount; c > 0; --c) stack.push_back(node.firstChild + c - 1);
+		}
+	}
+
+	void WalkDirectory(const std::string &path, DirectoryListing &files, const std::string &pattern, bool recursive, unsigned int numThreads)
+	{
+		walkDirectory(path, files, pattern, recursive, numThreads, [](const std::string &dir) -> SharedListing
+		{
+			std::shared_ptr<DirectoryListing> listing = std::make_shared<DirectoryListing>();
+			if (!ListDirectory(dir, *listing)) return SharedListing();
+			return listing;
+		});
+	}
+
+	DirectoryCache::Listing DirectoryCache::Get(const std::string &path)
+	{
+		// stat fails for directories with a trailing separator on Windows
+		std::string statPath(path);
+		while ((statPath.size() > 1) && (statPath[statPath.size() - 1] == fSep) && (statPath[statPath.size() - 2] != ':'))
+		{
+			statPath.erase(statPath.size() - 1);
+		}
+		Stat dirStat(statPath);
+		if (!dirStat.isDirectory())
+		{
+			Invalidate(path);
+			return Listing();
+		}
+		const time_t mtime = dirStat.getModifyTimeStamp();
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			std::map<std::string, Cached>::iterator i = m_cache.find(path);
+			if ((i != m_cache.end()) && (i->second.mtime == mtime) && (mtime < i->second.read)) return i->second.listing;
+		}
+		// read without holding the lock, so other directories can be read meanwhile
+		Cached cached;
+		cached.mtime = mtime;
+		cached.read = time(0);
+		std::shared_ptr<DirectoryListing> listing = std::make_shared<DirectoryListing>();
+		if (!ListDirectory(path, *listing)) return Listing();
+		cached.listing = listing;
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_cache[path] = cached;
+		return cached.listing;
+	}
+
+	void DirectoryCache::Walk(const std::string &path, DirectoryListing &files, const std::string &pattern, bool recursive, unsigned int numThreads)
+	{
+		walkDirectory(path, files, pattern, recursive, numThreads, [this](const std::string &dir) { return Get(dir); });
+	}
+
+	void DirectoryCache::Invalidate(const std::string &path)
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_cache.erase(path);
+	}
+
+	void DirectoryCache::Clear()
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_cache.clear();
+	}
+
+	size_t DirectoryCache::size()
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		return m_cache.size();
+	}
+
 #if defined(LWPP_PLATFORM_OSX_CFM)
 	void makeAllDirectories(const char *path)	
 	{
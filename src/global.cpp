@@ -69,6 +69,9 @@
 #include <lwbufferset.h>
 #include <lwdopetrack.h>
 
+#include <mutex>
+#include <vector>
+
 #ifdef _DEBUG
   lwpp::dostream dout;
 #endif
@@ -108,6 +111,49 @@ namespace lwpp
 		productInfo = ( unsigned int ) (unsigned long) SuperGlobal( LWPRODUCTINFO_GLOBAL, GFUSE_TRANSIENT );
 	}
 
+	namespace
+	{
+		struct GlobalRegistryState
+		{
+			std::mutex lock;
+			std::vector<GlobalRegistry::ReleaseFunc *> acquired;
+		};
+		//! Never destroyed, globals may still be released during static destruction
+		GlobalRegistryState &registryState()
+		{
+			static GlobalRegistryState *s = new GlobalRegistryState();
+			return *s;
+		}
+
+		void releaseGlobals()
+		{
+			GlobalRegistry::ReleaseAll();
+		}
+		ShutdownHandler globalShutdown(releaseGlobals);
+	}
+
+	std::mutex &GlobalRegistry::Lock()
+	{
+		return registryState().lock;
+	}
+
+	void GlobalRegistry::Register(ReleaseFunc *release)
+	{
+		registryState().acquired.push_back(release);
+	}
+
+	void GlobalRegistry::ReleaseAll()
+	{
+		GlobalRegistryState &s = registryState();
+		std::lock_guard<std::mutex> guard(s.lock);
+		// release in reverse order of acquisition
+		for (auto i = s.acquired.rbegin(); i != s.acquired.rend(); ++i)
+		{
+			(*i)();
+		}
+		s.acquired.clear();
+	}
+
 	int LightWave::GetNumCores()
 	{
 #ifdef _MSWIN
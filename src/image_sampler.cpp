@@ -0,0 +1,388 @@
+/*!
+ * @file
+ * @brief Implementation of the ImageSampler mip-map and tile cache
+ */
+#include <lwpp/image_sampler.h>
+#include <lwpp/math.h>
+#include <cmath>
+
+namespace lwpp
+{
+	namespace
+	{
+		const int TileTexels = ImageSampler::TileSize * ImageSampler::TileSize;
+		const int TileMask = ImageSampler::TileSize - 1;
+		//! Limits the number of texels touched by the EWA filter
+		const double MaxAnisotropy = 16.0;
+		const double EWASharpness = 2.0;
+
+		//! Apply a wrap mode to an integer texel coordinate
+		inline bool wrapCoord(int &i, const int n, const LWTextureWrap wrap)
+		{
+			if ((i >= 0) && (i < n)) return true;
+			switch (wrap)
+			{
+				case TWRAP_REPEAT:
+					i %= n;
+					if (i < 0) i += n;
+					return true;
+				case TWRAP_MIRROR:
+				{
+					const int period = 2 * n;
+					i %= period;
+					if (i < 0) i += period;
+					if (i >= n) i = period - 1 - i;
+					return true;
+				}
+				case TWRAP_EDGE:
+					i = (i < 0) ? 0 : n - 1;
+					return true;
+				case TWRAP_RESET:
+				default:
+					return false;
+			}
+		}
+	}
+
+	ImageSampler::ImageSampler()
+		: m_hasAlpha(false), m_width(0), m_height(0), m_memory(0)
+	{
+		;
+	}
+
+	ImageSampler::~ImageSampler()
+	{
+		Clear();
+	}
+
+	void ImageSampler::Clear()
+	{
+		for (auto &l : m_levels)
+		{
+			const int numTiles = l.tilesX * l.tilesY;
+			for (int i = 0; i < numTiles; ++i)
+			{
+				delete[] l.tiles[i].load(std::memory_order_relaxed);
+			}
+		}
+		m_levels.clear();
+		m_memory.store(0, std::memory_order_relaxed);
+	}
+
+	bool ImageSampler::Build(LWImageID id)
+	{
+		Clear();
+		m_image.SetID(id);
+		if (!m_image.isValid()) return false;
+
+		m_image.size(m_width, m_height);
+		if ((m_width <= 0) || (m_height <= 0)) return false;
+		m_hasAlpha = m_image.hasAlpha();
+
+		int w = m_width, h = m_height;
+		for (;;)
+		{
+			Level l;
+			l.width = w;
+			l.height = h;
+			l.tilesX = (w + TileSize - 1) >> TileShift;
+			l.tilesY = (h + TileSize - 1) >> TileShift;
+			const int numTiles = l.tilesX * l.tilesY;
+			l.tiles.reset(new std::atomic<float *>[numTiles]);
+			for (int i = 0; i < numTiles; ++i) l.tiles[i].store(nullptr, std::memory_order_relaxed);
+			m_levels.push_back(std::move(l));
+			if ((w == 1) && (h == 1)) break;
+			w = Max(1, w / 2);
+			h = Max(1, h / 2);
+		}
+		return true;
+	}
+
+	void ImageSampler::fillTile(int level, int tx, int ty, float *data) const
+	{
+		const Level &l = m_levels[level];
+		const int x0 = tx << TileShift;
+		const int y0 = ty << TileShift;
+		const int x1 = Min(x0 + TileSize, l.width);
+		const int y1 = Min(y0 + TileSize, l.height);
+
+		for (int y = y0; y < y1; ++y)
+		{
+			float *row = data + ((y - y0) << TileShift) * 4;
+			for (int x = x0; x < x1; ++x)
+			{
+				float *texel = row + (x - x0) * 4;
+				if (level == 0)
+				{
+					LWBufferValue rgb[3];
+					m_image.RGB(x, y, rgb);
+					texel[0] = rgb[0];
+					texel[1] = rgb[1];
+					texel[2] = rgb[2];
+					texel[3] = m_hasAlpha ? m_image.alpha(x, y) : 1.0f;
+				}
+				else
+				{
+					// box filter of the finer level
+					float a[4], b[4], c[4], d[4];
+					Texel(level - 1, 2 * x, 2 * y, TWRAP_EDGE, TWRAP_EDGE, a);
+					Texel(level - 1, 2 * x + 1, 2 * y, TWRAP_EDGE, TWRAP_EDGE, b);
+					Texel(level - 1, 2 * x, 2 * y + 1, TWRAP_EDGE, TWRAP_EDGE, c);
+					Texel(level - 1, 2 * x + 1, 2 * y + 1, TWRAP_EDGE, TWRAP_EDGE, d);
+					for (int i = 0; i < 4; ++i) texel[i] = 0.25f * (a[i] + b[i] + c[i] + d[i]);
+				}
+			}
+		}
+	}
+
+	const float *ImageSampler::tile(int level, int tx, int ty) const
+	{
+		const Level &l = m_levels[level];
+		std::atomic<float *> &slot = l.tiles[ty * l.tilesX + tx];
+		float *data = slot.load(std::memory_order_acquire);
+		if (data) return data;
+
+		// build the tile without holding a lock, if another thread was faster its tile wins
+		float *fresh = new float[TileTexels * 4];
+		fillTile(level, tx, ty, fresh);
+		if (slot.compare_exchange_strong(data, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			m_memory.fetch_add(TileTexels * 4 * sizeof(float), std::memory_order_relaxed);
+			return fresh;
+		}
+		delete[] fresh;
+		return data;
+	}
+
+	void ImageSampler::Texel(int level, int x, int y, LWTextureWrap uWrap, LWTextureWrap vWrap, float rgba[4]) const
+	{
+		const Level &l = m_levels[level];
+		if (!wrapCoord(x, l.width, uWrap) || !wrapCoord(y, l.height, vWrap))
+		{
+			rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+			return;
+		}
+		const float *t = tile(level, x >> TileShift, y >> TileShift) + (((y & TileMask) << TileShift) + (x & TileMask)) * 4;
+		rgba[0] = t[0];
+		rgba[1] = t[1];
+		rgba[2] = t[2];
+		rgba[3] = t[3];
+	}
+
+	void ImageSampler::bilinear(int level, double x, double y, LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const
+	{
+		const int ix = Floor(x);
+		const int iy = Floor(y);
+		const double fx = x - ix;
+		const double fy = y - iy;
+		const Level &l = m_levels[level];
+
+		// fast path, all four texels in the same tile
+		if ((ix >= 0) && (iy >= 0) && (ix + 1 < l.width) && (iy + 1 < l.height) &&
+				((ix & TileMask) != TileMask) && ((iy & TileMask) != TileMask))
+		{
+			const float *t00 = tile(level, ix >> TileShift, iy >> TileShift) + (((iy & TileMask) << TileShift) + (ix & TileMask)) * 4;
+			const float *t10 = t00 + 4;
+			const float *t01 = t00 + TileSize * 4;
+			const float *t11 = t01 + 4;
+			for (int i = 0; i < 4; ++i)
+			{
+				rgba[i] = (t00[i] * (1.0 - fx) + t10[i] * fx) * (1.0 - fy) + (t01[i] * (1.0 - fx) + t11[i] * fx) * fy;
+			}
+			return;
+		}
+
+		float t00[4], t10[4], t01[4], t11[4];
+		Texel(level, ix, iy, uWrap, vWrap, t00);
+		Texel(level, ix + 1, iy, uWrap, vWrap, t10);
+		Texel(level, ix, iy + 1, uWrap, vWrap, t01);
+		Texel(level, ix + 1, iy + 1, uWrap, vWrap, t11);
+		for (int i = 0; i < 4; ++i)
+		{
+			rgba[i] = (t00[i] * (1.0 - fx) + t10[i] * fx) * (1.0 - fy) + (t01[i] * (1.0 - fx) + t11[i] * fx) * fy;
+		}
+	}
+
+	//! Elliptical weighted average with a gaussian filter, see Heckbert 1989
+	void ImageSampler::ewa(int level, double x, double y, double ax, double ay, double bx, double by,
+												 LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const
+	{
+		double A = ay * ay + by * by + 1.0;
+		double B = -2.0 * (ax * ay + bx * by);
+		double C = ax * ax + bx * bx + 1.0;
+		const double invF = 1.0 / (A * C - B * B * 0.25);
+		A *= invF;
+		B *= invF;
+		C *= invF;
+
+		const double det = -B * B + 4.0 * A * C;
+		const double invDet = 1.0 / det;
+		const double uSqrt = std::sqrt(det * C);
+		const double vSqrt = std::sqrt(A * det);
+		const int x0 = Ceil(x - 2.0 * invDet * uSqrt);
+		const int x1 = Floor(x + 2.0 * invDet * uSqrt);
+		const int y0 = Ceil(y - 2.0 * invDet * vSqrt);
+		const int y1 = Floor(y + 2.0 * invDet * vSqrt);
+
+		double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+		double weights = 0.0;
+		for (int iy = y0; iy <= y1; ++iy)
+		{
+			const double dy = iy - y;
+			for (int ix = x0; ix <= x1; ++ix)
+			{
+				const double dx = ix - x;
+				const double r2 = A * dx * dx + B * dx * dy + C * dy * dy;
+				if (r2 < 1.0)
+				{
+					const double w = std::exp(-EWASharpness * r2);
+					float t[4];
+					Texel(level, ix, iy, uWrap, vWrap, t);
+					for (int i = 0; i < 4; ++i) sum[i] += w * t[i];
+					weights += w;
+				}
+			}
+		}
+		if (weights > 0.0)
+		{
+			for (int i = 0; i < 4; ++i) rgba[i] = sum[i] / weights;
+		}
+		else
+		{
+			bilinear(level, x, y, uWrap, vWrap, rgba);
+		}
+	}
+
+	double ImageSampler::Sample(double u, double v,
+															double dudx, double dvdx, double dudy, double dvdy,
+															SamplerFilter filter, LWTextureWrap uWrap, LWTextureWrap vWrap, double rgba[4]) const
+	{
+		rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0;
+		if (m_levels.empty()) return 0.0;
+		if (!std::isfinite(u) || !std::isfinite(v)) return 0.0;
+
+		// texel space of the finest level, image rows run top to bottom
+		const double s = u * m_width;
+		const double t = (1.0 - v) * m_height;
+		const int maxLevel = static_cast<int>(m_levels.size()) - 1;
+
+		if ((filter == SAMPLE_TRILINEAR) || (filter == SAMPLE_EWA))
+		{
+			// an unbounded footprint covers the whole image
+			if (!std::isfinite(dudx) || !std::isfinite(dvdx) || !std::isfinite(dudy) || !std::isfinite(dvdy))
+			{
+				const Level &l = m_levels[maxLevel];
+				bilinear(maxLevel, u * l.width - 0.5, (1.0 - v) * l.height - 0.5, uWrap, vWrap, rgba);
+				return rgba[3];
+			}
+		}
+
+		switch (filter)
+		{
+			case SAMPLE_NEAREST:
+			{
+				float texel[4];
+				Texel(0, Floor(s), Floor(t), uWrap, vWrap, texel);
+				for (int i = 0; i < 4; ++i) rgba[i] = texel[i];
+				break;
+			}
+
+			case SAMPLE_BILINEAR:
+				bilinear(0, s - 0.5, t - 0.5, uWrap, vWrap, rgba);
+				break;
+
+			case SAMPLE_TRILINEAR:
+			{
+				const double lx = std::sqrt(Sqr(dudx * m_width) + Sqr(dvdx * m_height));
+				const double ly = std::sqrt(Sqr(dudy * m_width) + Sqr(dvdy * m_height));
+				const double width = Max(lx, ly);
+				const double lod = (width > 1.0) ? Min(std::log(width) / std::log(2.0), static_cast<double>(maxLevel)) : 0.0;
+				const int l0 = Floor(lod);
+				const double f = lod - l0;
+				const Level &level0 = m_levels[l0];
+				bilinear(l0, u * level0.width - 0.5, (1.0 - v) * level0.height - 0.5, uWrap, vWrap, rgba);
+				if ((f > 0.0) && (l0 < maxLevel))
+				{
+					double coarse[4];
+					const Level &level1 = m_levels[l0 + 1];
+					bilinear(l0 + 1, u * level1.width - 0.5, (1.0 - v) * level1.height - 0.5, uWrap, vWrap, coarse);
+					for (int i = 0; i < 4; ++i) rgba[i] = Lerp(f, rgba[i], coarse[i]);
+				}
+				break;
+			}
+
+			case SAMPLE_EWA:
+			{
+				// ellipse axes in texels of the finest level
+				double ax = dudx * m_width, ay = -dvdx * m_height;
+				double bx = dudy * m_width, by = -dvdy * m_height;
+				double la = std::sqrt(ax * ax + ay * ay);
+				double lb = std::sqrt(bx * bx + by * by);
+				if (la < lb)
+				{
+					Swap(ax, bx);
+					Swap(ay, by);
+					Swap(la, lb);
+				}
+				if (lb * MaxAnisotropy < la)
+				{
+					// widen the minor axis to bound the number of texels
+					const double scale = la / (lb * MaxAnisotropy);
+					if (lb > 0.0)
+					{
+						bx *= scale;
+						by *= scale;
+					}
+					else
+					{
+						bx = -ay / MaxAnisotropy;
+						by = ax / MaxAnisotropy;
+					}
+					lb = la / MaxAnisotropy;
+				}
+				const double lod = (lb > 1.0) ? std::log(lb) / std::log(2.0) : 0.0;
+				if (lod >= maxLevel + 1)
+				{
+					// the footprint is larger than the coarsest level, which would make the filter loop unbounded
+					const Level &l = m_levels[maxLevel];
+					bilinear(maxLevel, u * l.width - 0.5, (1.0 - v) * l.height - 0.5, uWrap, vWrap, rgba);
+					break;
+				}
+				const int level = Floor(lod);
+				const double scale = 1.0 / Pow2(level);
+				const Level &l = m_levels[level];
+				ewa(level, u * l.width - 0.5, (1.0 - v) * l.height - 0.5,
+						ax * scale, ay * scale, bx * scale, by * scale, uWrap, vWrap, rgba);
+				break;
+			}
+		}
+		return rgba[3];
+	}
+
+	Vector3d ImageSampler::evaluateBumpGradient(LWNodalProjection proj, SamplerFilter filter, double bumpStrength,
+																							LWTextureWrap uWrap, LWTextureWrap vWrap) const
+	{
+		double baseTex[4], uTex[4], vTex[4];
+
+		auto du = std::abs(proj.dudx) + std::abs(proj.dudy);
+		du *= 2.0;
+		if (du == 0) du = .0005f;
+
+		auto dv = std::abs(proj.dvdx) + std::abs(proj.dvdy);
+		dv *= 2.0;
+		if (dv == 0) dv = .0005f;
+
+		Sample(proj.u, proj.v, proj.dudx, proj.dvdx, proj.dudy, proj.dvdy, filter, uWrap, vWrap, baseTex);
+		Sample(proj.u + du, proj.v, proj.dudx, proj.dvdx, proj.dudy, proj.dvdy, filter, uWrap, vWrap, uTex);
+		Sample(proj.u, proj.v + dv, proj.dudx, proj.dvdx, proj.dudy, proj.dvdy, filter, uWrap, vWrap, vTex);
+
+		auto displace = Colour2Luma(baseTex) * baseTex[3];
+		auto udisplace = Colour2Luma(uTex) * uTex[3];
+		auto vdisplace = Colour2Luma(vTex) * vTex[3];
+
+		auto dtu = ((displace - udisplace) / du);
+		auto dtv = ((displace - vdisplace) / dv);
+
+		return ComputeBump(proj, dtu, dtv, displace, bumpStrength);
+	}
+} // end namespace lwpp
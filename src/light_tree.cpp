@@ -0,0 +1,427 @@
+/*!
+ * @file
+ * @brief Implementation of the LightTree
+ */
+#include <lwpp/light_tree.h>
+#include <lwpp/light.h>
+#include <lwpp/lightinfo.h>
+#include <lwpp/math.h>
+#include <algorithm>
+#include <cmath>
+
+namespace lwpp
+{
+	namespace
+	{
+		const int SplitBins = 12;
+
+		inline double safeAcos(double x)
+		{
+			return std::acos(Clamp(x, -1.0, 1.0));
+		}
+
+		double surfaceArea(const LightBounds &b)
+		{
+			if (b.isEmpty()) return 0.0;
+			const Vector3d d = b.max - b.min;
+			return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+
+		//! Measure of the solid angle covered by the emission cone
+		double orientationMeasure(const LightBounds &b)
+		{
+			const double thetaW = Min(b.thetaO + b.thetaE, PI);
+			const double sinO = std::sin(b.thetaO), cosO = std::cos(b.thetaO);
+			return TWOPI * (1.0 - cosO) +
+				HALFPI * (2.0 * thetaW * sinO - std::cos(b.thetaO - 2.0 * thetaW) - 2.0 * b.thetaO * sinO + cosO);
+		}
+
+		double axisComponent(const Point3d &p, int axis)
+		{
+			return (axis == 0) ? p.x : ((axis == 1) ? p.y : p.z);
+		}
+	}
+
+	LightBounds::LightBounds()
+		: min(1e300, 1e300, 1e300), max(-1e300, -1e300, -1e300), axis(0.0, 0.0, 1.0), thetaO(0.0), thetaE(0.0), energy(0.0)
+	{
+		;
+	}
+
+	void LightBounds::Merge(const LightBounds &b)
+	{
+		if (b.isEmpty()) return;
+		if (isEmpty())
+		{
+			*this = b;
+			return;
+		}
+		min = Point3d(Min(min.x, b.min.x), Min(min.y, b.min.y), Min(min.z, b.min.z));
+		max = Point3d(Max(max.x, b.max.x), Max(max.y, b.max.y), Max(max.z, b.max.z));
+		energy += b.energy;
+
+		// merge the bounding cones, a is the wider one
+		const bool wider = (thetaO >= b.thetaO);
+		const Vector3d axisA = wider ? axis : b.axis;
+		const Vector3d axisB = wider ? b.axis : axis;
+		const double oA = wider ? thetaO : b.thetaO;
+		const double oB = wider ? b.thetaO : thetaO;
+		thetaE = Max(thetaE, b.thetaE);
+
+		const double thetaD = safeAcos(axisA.Dot(axisB));
+		if (Min(thetaD + oB, PI) <= oA)
+		{
+			axis = axisA;
+			thetaO = oA;
+			return;
+		}
+		const double o = (oA + thetaD + oB) * 0.5;
+		if (o >= PI)
+		{
+			axis = axisA;
+			thetaO = PI;
+			return;
+		}
+		// rotate axisA towards axisB
+		const double thetaR = o - oA;
+		const double sinD = std::sin(thetaD);
+		if (sinD < 1e-9)
+		{
+			axis = axisA;
+		}
+		else
+		{
+			const Vector3d ortho = (axisB - axisA * std::cos(thetaD)) * (1.0 / sinD);
+			axis = axisA * std::cos(thetaR) + ortho * std::sin(thetaR);
+			axis.Normalize();
+		}
+		thetaO = o;
+	}
+
+	double LightBounds::Importance(const Point3d &p, const Vector3d *n) const
+	{
+		if (isEmpty() || (energy <= 0.0)) return 0.0;
+		const Point3d c = Centre();
+		Vector3d d = p - c; // from the lights to the point
+		const double dist2 = d.Dot(d);
+		const Vector3d diag = max - min;
+		const double radius2 = diag.Dot(diag) * 0.25;
+
+		const bool inside = (p.x >= min.x) && (p.x <= max.x) && (p.y >= min.y) && (p.y <= max.y) && (p.z >= min.z) && (p.z <= max.z);
+		if (inside || (dist2 <= radius2))
+		{
+			// too close to bound any angle
+			return energy / Max(dist2, radius2 * 0.25 + 1e-12);
+		}
+
+		const double dist = std::sqrt(dist2);
+		d = d * (1.0 / dist);
+		const double thetaU = std::asin(Min(std::sqrt(radius2) / dist, 1.0));
+
+		// angle between the emission axis and the point
+		const double theta = safeAcos(axis.Dot(d));
+		const double thetaP = Max(theta - thetaO - thetaU, 0.0);
+		if (thetaP >= thetaE) return 0.0;
+		double importance = energy * std::cos(thetaP) / Max(dist2, radius2);
+
+		if (n)
+		{
+			// angle between the normal and the direction to the lights
+			const double thetaI = safeAcos(std::fabs(n->Dot(d)));
+			const double thetaIP = Max(thetaI - thetaU, 0.0);
+			importance *= std::cos(Min(thetaIP, HALFPI));
+		}
+		return Max(importance, 0.0);
+	}
+
+	LightTree::LightTree()
+		: m_infiniteEnergy(0.0)
+	{
+		;
+	}
+
+	void LightTree::Clear()
+	{
+		m_lights.clear();
+		m_nodes.clear();
+		m_leaf.clear();
+		m_infinite.clear();
+		m_infiniteCdf.clear();
+		m_infiniteEnergy = 0.0;
+	}
+
+	bool LightTree::Build(LWFrame frame, LWTime time)
+	{
+		std::vector<LightTreeEntry> lights;
+		ItemInfo items;
+		if (!items.isValid())
+		{
+			Clear();
+			return false;
+		}
+		for (LWItemID id = items.first(LWI_LIGHT, LWITEM_NULL); id != LWITEM_NULL; id = items.next(id))
+		{
+			LWLight light(id);
+			LightTreeEntry entry;
+			entry.light = id;
+			LightBounds &b = entry.bounds;
+
+			double power[3] = { 0.0, 0.0, 0.0 };
+			LWDVector bmin, bmax;
+			bool bounded = false;
+			LightEvaluation eval;
+			if (eval.create(id))
+			{
+				eval.init(LWINIT_RENDER);
+				eval.newTime(frame, time);
+				if (!eval.power(power))
+				{
+					light.getColour(time, power);
+				}
+				bounded = eval.worldBounds(bmin, bmax);
+				eval.cleanUp();
+			}
+			else
+			{
+				light.getColour(time, power);
+				const Point3d pos = light.getWorldPosition(time);
+				bmin[0] = bmax[0] = pos.x;
+				bmin[1] = bmax[1] = pos.y;
+				bmin[2] = bmax[2] = pos.z;
+				bounded = (light.getType() != LWLIGHT_DISTANT);
+			}
+			b.energy = Max(Colour2Luma(power), 0.0);
+			if (bounded)
+			{
+				b.min = Point3d(bmin[0], bmin[1], bmin[2]);
+				b.max = Point3d(bmax[0], bmax[1], bmax[2]);
+			}
+
+			// emission cone
+			Vector3d forward(0.0, 0.0, 1.0);
+			light.Param(LWIP_FORWARD, time, forward);
+			if (forward.Magnitude() > 0.0) forward.Normalize();
+			b.axis = forward;
+			if (light.getType() == LWLIGHT_SPOT)
+			{
+				double radius = 0.0, edge = 0.0;
+				light.getConeAngles(time, radius, edge);
+				b.thetaO = 0.0;
+				b.thetaE = Min(radius, PI);
+			}
+			else
+			{
+				b.thetaO = PI;
+				b.thetaE = HALFPI;
+			}
+			lights.push_back(entry);
+		}
+		Build(lights);
+		return !m_lights.empty();
+	}
+
+	void LightTree::Build(const std::vector<LightTreeEntry> &lights)
+	{
+		Clear();
+		m_lights = lights;
+		m_leaf.assign(m_lights.size(), -1);
+
+		std::vector<unsigned int> order;
+		for (unsigned int i = 0; i < m_lights.size(); ++i)
+		{
+			if (m_lights[i].bounds.isEmpty())
+			{
+				m_infinite.push_back(i);
+				m_infiniteEnergy += m_lights[i].bounds.energy;
+				m_infiniteCdf.push_back(m_infiniteEnergy);
+			}
+			else
+			{
+				order.push_back(i);
+			}
+		}
+		if (!order.empty())
+		{
+			m_nodes.reserve(2 * order.size());
+			build(order, 0, order.size(), -1);
+		}
+	}
+
+	int LightTree::build(std::vector<unsigned int> &order, size_t begin, size_t end, int parent)
+	{
+		const int index = static_cast<int>(m_nodes.size());
+		m_nodes.push_back(Node());
+		Node node;
+		node.parent = parent;
+		node.left = node.right = -1;
+		node.light = -1;
+		for (size_t i = begin; i < end; ++i) node.bounds.Merge(m_lights[order[i]].bounds);
+
+		if (end - begin == 1)
+		{
+			node.light = static_cast<int>(order[begin]);
+			m_leaf[order[begin]] = index;
+			m_nodes[index] = node;
+			return index;
+		}
+
+		// bounds of the light centres
+		Point3d cmin(1e300, 1e300, 1e300), cmax(-1e300, -1e300, -1e300);
+		for (size_t i = begin; i < end; ++i)
+		{
+			const Point3d c = m_lights[order[i]].bounds.Centre();
+			cmin = Point3d(Min(cmin.x, c.x), Min(cmin.y, c.y), Min(cmin.z, c.z));
+			cmax = Point3d(Max(cmax.x, c.x), Max(cmax.y, c.y), Max(cmax.z, c.z));
+		}
+		const Vector3d extent = node.bounds.max - node.bounds.min;
+		const double maxExtent = Max(extent.x, Max(extent.y, extent.z));
+
+		// binned surface area orientation heuristic
+		int bestAxis = -1;
+		int bestBin = 0;
+		double bestCost = 1e300;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const double lo = axisComponent(cmin, axis);
+			const double hi = axisComponent(cmax, axis);
+			if (hi <= lo) continue;
+			LightBounds bins[SplitBins];
+			for (size_t i = begin; i < end; ++i)
+			{
+				const LightBounds &b = m_lights[order[i]].bounds;
+				const int bin = Min(static_cast<int>((axisComponent(b.Centre(), axis) - lo) / (hi - lo) * SplitBins), SplitBins - 1);
+				bins[bin].Merge(b);
+			}
+			const double axisExtent = (axis == 0) ? extent.x : ((axis == 1) ? extent.y : extent.z);
+			const double regularise = (axisExtent > 0.0) ? maxExtent / axisExtent : 1.0;
+			for (int split = 1; split < SplitBins; ++split)
+			{
+				LightBounds left, right;
+				for (int i = 0; i < split; ++i) left.Merge(bins[i]);
+				for (int i = split; i < SplitBins; ++i) right.Merge(bins[i]);
+				if (left.isEmpty() || right.isEmpty()) continue;
+				const double cost = regularise *
+					(left.energy * surfaceArea(left) * orientationMeasure(left) + right.energy * surfaceArea(right) * orientationMeasure(right));
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = split;
+				}
+			}
+		}
+
+		size_t mid = (begin + end) / 2;
+		if (bestAxis >= 0)
+		{
+			const double lo = axisComponent(cmin, bestAxis);
+			const double hi = axisComponent(cmax, bestAxis);
+			unsigned int *split = std::partition(&order[begin], &order[0] + end, [&](unsigned int l)
+			{
+				const int bin = Min(static_cast<int>((axisComponent(m_lights[l].bounds.Centre(), bestAxis) - lo) / (hi - lo) * SplitBins), SplitBins - 1);
+				return bin < bestBin;
+			});
+			mid = static_cast<size_t>(split - &order[0]);
+			if ((mid == begin) || (mid == end)) mid = (begin + end) / 2;
+		}
+		// else all centres coincide, split by count
+
+		node.left = build(order, begin, mid, index);
+		node.right = build(order, mid, end, index);
+		m_nodes[index] = node;
+		return index;
+	}
+
+	double LightTree::infiniteProbability() const
+	{
+		if (m_infinite.empty()) return 0.0;
+		if (m_nodes.empty()) return 1.0;
+		const double total = m_infiniteEnergy + m_nodes[0].bounds.energy;
+		return (total > 0.0) ? m_infiniteEnergy / total : 0.5;
+	}
+
+	bool LightTree::Sample(const Point3d &p, const Vector3d *n, double u, Selection &sel) const
+	{
+		sel.light = LWITEM_NULL;
+		sel.pdf = 0.0;
+		double pdf = 1.0;
+
+		const double pInfinite = infiniteProbability();
+		if (pInfinite > 0.0)
+		{
+			if (u < pInfinite)
+			{
+				u /= pInfinite;
+				size_t i;
+				if (m_infiniteEnergy > 0.0)
+				{
+					const double target = u * m_infiniteEnergy;
+					i = std::upper_bound(m_infiniteCdf.begin(), m_infiniteCdf.end(), target) - m_infiniteCdf.begin();
+				}
+				else
+				{
+					// no energy to weight by, pick uniformly to match Pdf()
+					i = static_cast<size_t>(u * m_infinite.size());
+				}
+				i = Min(i, m_infinite.size() - 1);
+				const double weight = (m_infiniteEnergy > 0.0) ? m_lights[m_infinite[i]].bounds.energy / m_infiniteEnergy : 1.0 / m_infinite.size();
+				sel.index = m_infinite[i];
+				sel.light = m_lights[sel.index].light;
+				sel.pdf = pInfinite * weight;
+				return sel.pdf > 0.0;
+			}
+			u = (u - pInfinite) / (1.0 - pInfinite);
+			pdf = 1.0 - pInfinite;
+		}
+		if (m_nodes.empty()) return false;
+
+		int node = 0;
+		while (m_nodes[node].left >= 0)
+		{
+			const Node &current = m_nodes[node];
+			const double iL = m_nodes[current.left].bounds.Importance(p, n);
+			const double iR = m_nodes[current.right].bounds.Importance(p, n);
+			if (iL + iR <= 0.0) return false;
+			const double pL = iL / (iL + iR);
+			if (u < pL)
+			{
+				u = Min(u / pL, 0.99999999);
+				pdf *= pL;
+				node = current.left;
+			}
+			else
+			{
+				u = Min((u - pL) / (1.0 - pL), 0.99999999);
+				pdf *= 1.0 - pL;
+				node = current.right;
+			}
+		}
+		sel.index = static_cast<unsigned int>(m_nodes[node].light);
+		sel.light = m_lights[sel.index].light;
+		sel.pdf = pdf;
+		return pdf > 0.0;
+	}
+
+	double LightTree::Pdf(unsigned int index, const Point3d &p, const Vector3d *n) const
+	{
+		if (index >= m_lights.size()) return 0.0;
+		const double pInfinite = infiniteProbability();
+		const int leaf = m_leaf[index];
+		if (leaf < 0)
+		{
+			if (m_infiniteEnergy > 0.0) return pInfinite * m_lights[index].bounds.energy / m_infiniteEnergy;
+			return pInfinite / m_infinite.size();
+		}
+
+		double pdf = 1.0 - pInfinite;
+		for (int node = leaf; m_nodes[node].parent >= 0; node = m_nodes[node].parent)
+		{
+			const Node &parent = m_nodes[m_nodes[node].parent];
+			const double iL = m_nodes[parent.left].bounds.Importance(p, n);
+			const double iR = m_nodes[parent.right].bounds.Importance(p, n);
+			if (iL + iR <= 0.0) return 0.0;
+			pdf *= ((parent.left == node) ? iL : iR) / (iL + iR);
+		}
+		return pdf;
+	}
+} // end namespace lwpp
@@ -0,0 +1,435 @@
+/*!
+ * @file
+ * @brief Implementation of the asynchronous lwpp logger
+ */
+#include <lwpp/logger.h>
+#include <lwpp/lw_server.h>
+#include <lwpp/platform.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lwpp
+{
+	namespace
+	{
+		struct LogSlot
+		{
+			double time; //!< seconds since the logger was started
+			const char *category;
+			unsigned int suppressed;
+			unsigned short length;
+			unsigned char level;
+			unsigned char more; //!< the message continues in the next slot
+			char text[Logger::SlotSize];
+		};
+
+		//! Single producer, single consumer ring buffer of one thread
+		struct LogRing
+		{
+			unsigned int index;
+			std::atomic<bool> inUse;
+			std::atomic<std::uint64_t> head; //!< written by the producer
+			std::atomic<std::uint64_t> tail; //!< written by the consumer
+			std::atomic<std::uint64_t> dropped;
+			std::uint64_t reportedDropped; //!< only used by the consumer
+			LogSlot slots[Logger::SlotsPerThread];
+
+			explicit LogRing(unsigned int idx)
+				: index(idx), inUse(true), head(0), tail(0), dropped(0), reportedDropped(0)
+			{
+				;
+			}
+		};
+
+		struct LoggerState
+		{
+			std::mutex ringLock; //!< protects rings
+			std::vector<std::unique_ptr<LogRing>> rings;
+
+			std::mutex drainLock; //!< protects the sink and serialises draining
+			Logger::Sink sink;
+			std::string fileName;
+			std::ofstream file;
+
+			std::mutex categoryLock;
+			std::set<std::string> disabled;
+			std::atomic<unsigned int> categoryGeneration;
+
+			std::atomic<int> level;
+			std::atomic<unsigned int> rateLimit;
+
+			std::mutex writerLock; //!< protects the writer thread
+			std::condition_variable wakeup;
+			std::thread writer;
+			bool stop;
+			std::atomic<bool> running;
+			std::atomic<bool> shutdown;
+
+			std::chrono::steady_clock::time_point start;
+
+			LoggerState()
+				: fileName("lwpp.log"), categoryGeneration(0), level(LOG_TRACE), rateLimit(0), stop(false), running(false), shutdown(false),
+				start(std::chrono::steady_clock::now())
+			{
+#if defined(_DEBUGTOFILE)
+				sink = Logger::SINK_FILE;
+#elif defined(LWPP_PLATFORM_WIN)
+				sink = Logger::SINK_DEBUGGER;
+#else
+				sink = Logger::SINK_STDERR;
+#endif
+			}
+		};
+
+		//! Never destroyed, so logging remains possible during static destruction
+		LoggerState &state()
+		{
+			static LoggerState *s = new LoggerState();
+			return *s;
+		}
+
+		//! Releases the ring of a thread when the thread ends, so it can be reused
+		struct RingHandle
+		{
+			LogRing *ring;
+			RingHandle() : ring(nullptr) {}
+			~RingHandle()
+			{
+				if (ring) ring->inUse.store(false, std::memory_order_release);
+			}
+		};
+
+		LogRing *threadRing()
+		{
+			static thread_local RingHandle handle;
+			if (!handle.ring)
+			{
+				LoggerState &s = state();
+				std::lock_guard<std::mutex> guard(s.ringLock);
+				for (auto &r : s.rings)
+				{
+					if (!r->inUse.load(std::memory_order_acquire))
+					{
+						r->inUse.store(true, std::memory_order_relaxed);
+						handle.ring = r.get();
+						break;
+					}
+				}
+				if (!handle.ring)
+				{
+					s.rings.emplace_back(new LogRing(static_cast<unsigned int>(s.rings.size())));
+					handle.ring = s.rings.back().get();
+				}
+			}
+			return handle.ring;
+		}
+
+		const char *levelName(unsigned int level)
+		{
+			static const char *names[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+			return (level < LOG_NONE) ? names[level] : "";
+		}
+
+		void emit(LoggerState &s, const std::string &batch)
+		{
+			switch (s.sink)
+			{
+				case Logger::SINK_FILE:
+					if (!s.file.is_open()) s.file.open(s.fileName.c_str(), std::ios::out | std::ios::app);
+					s.file << batch;
+					s.file.flush();
+					break;
+#ifdef LWPP_PLATFORM_WIN
+				case Logger::SINK_DEBUGGER:
+					::OutputDebugStringA(batch.c_str());
+					break;
+#endif
+				default:
+					std::cerr << batch;
+					std::cerr.flush();
+					break;
+			}
+		}
+
+		//! Write all queued messages, returns true if anything was written
+		bool drain()
+		{
+			LoggerState &s = state();
+			std::lock_guard<std::mutex> drainGuard(s.drainLock);
+
+			std::vector<LogRing *> rings;
+			{
+				std::lock_guard<std::mutex> guard(s.ringLock);
+				for (auto &r : s.rings) rings.push_back(r.get());
+			}
+
+			std::ostringstream batch;
+			batch << std::fixed << std::setprecision(3);
+			bool any = false;
+			for (auto ring : rings)
+			{
+				const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+				std::uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+				while (tail < head)
+				{
+					const LogSlot &first = ring->slots[tail % Logger::SlotsPerThread];
+					batch << "[" << std::setw(10) << first.time << "] [T" << ring->index << "] " << levelName(first.level) << " " << first.category << ": ";
+					if (first.suppressed) batch << "(" << first.suppressed << " messages suppressed) ";
+					const LogSlot *slot = &first;
+					for (;;)
+					{
+						batch.write(slot->text, slot->length);
+						++tail;
+						if (!slot->more) break;
+						slot = &ring->slots[tail % Logger::SlotsPerThread];
+					}
+					batch << "\n";
+					any = true;
+				}
+				ring->tail.store(tail, std::memory_order_release);
+
+				const std::uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+				if (dropped != ring->reportedDropped)
+				{
+					batch << "[T" << ring->index << "] " << (dropped - ring->reportedDropped) << " log messages dropped\n";
+					ring->reportedDropped = dropped;
+					any = true;
+				}
+			}
+			if (any) emit(s, batch.str());
+			return any;
+		}
+
+		void writerThread()
+		{
+			LoggerState &s = state();
+			for (;;)
+			{
+				const bool wrote = drain();
+				std::unique_lock<std::mutex> lock(s.writerLock);
+				if (s.stop) break;
+				if (!wrote) s.wakeup.wait_for(lock, std::chrono::milliseconds(10));
+			}
+			drain();
+		}
+
+		void startWriter()
+		{
+			LoggerState &s = state();
+			std::lock_guard<std::mutex> guard(s.writerLock);
+			if (!s.running.load(std::memory_order_relaxed) && !s.shutdown.load(std::memory_order_relaxed))
+			{
+				s.writer = std::thread(writerThread);
+				s.running.store(true, std::memory_order_release);
+			}
+		}
+
+		void shutdownLogger()
+		{
+			Logger::Shutdown();
+		}
+		ShutdownHandler loggerShutdown(shutdownLogger);
+	}
+
+	//! Set once the pending lines of the current thread are destroyed
+	static thread_local bool pendingLinesGone = false;
+
+	//! Pending partial lines of the current thread, by stream
+	struct PendingLines
+	{
+		std::unordered_map<std::uint64_t, std::string> lines;
+		~PendingLines()
+		{
+			pendingLinesGone = true;
+		}
+	};
+
+	//! Streams may outlive the thread local storage, for example global streams used by the main thread
+	static std::unordered_map<std::uint64_t, std::string> *pendingLines()
+	{
+		if (pendingLinesGone) return nullptr;
+		static thread_local PendingLines pending;
+		return &pending.lines;
+	}
+
+	std::uint64_t LogStreamBuf::nextID()
+	{
+		static std::atomic<std::uint64_t> id(0);
+		return ++id;
+	}
+
+	std::string *LogStreamBuf::lineBuffer()
+	{
+		std::unordered_map<std::uint64_t, std::string> *lines = pendingLines();
+		return lines ? &(*lines)[m_id] : nullptr;
+	}
+
+	void LogStreamBuf::releaseLineBuffer()
+	{
+		std::unordered_map<std::uint64_t, std::string> *lines = pendingLines();
+		if (lines) lines->erase(m_id);
+	}
+
+	bool LogSite::Accept(LogLevel level)
+	{
+		if (level < Logger::GetLevel()) return false;
+
+		const unsigned int generation = Logger::CategoryGeneration();
+		if (m_generation.load(std::memory_order_relaxed) != generation)
+		{
+			m_enabled.store(Logger::isCategoryEnabled(m_category), std::memory_order_relaxed);
+			m_generation.store(generation, std::memory_order_relaxed);
+		}
+		if (!m_enabled.load(std::memory_order_relaxed)) return false;
+
+		const unsigned int limit = Logger::GetRateLimit();
+		if (!limit) return true;
+
+		const std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		std::int64_t window = m_window.load(std::memory_order_relaxed);
+		if ((window != now) && m_window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+		{
+			m_count.store(0, std::memory_order_relaxed);
+		}
+		if (m_count.fetch_add(1, std::memory_order_relaxed) < limit) return true;
+		m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	void Logger::SetLevel(LogLevel level)
+	{
+		state().level.store(level, std::memory_order_relaxed);
+	}
+
+	LogLevel Logger::GetLevel()
+	{
+		return static_cast<LogLevel>(state().level.load(std::memory_order_relaxed));
+	}
+
+	void Logger::SetCategoryEnabled(const std::string &category, bool enabled)
+	{
+		LoggerState &s = state();
+		std::lock_guard<std::mutex> guard(s.categoryLock);
+		if (enabled)
+			s.disabled.erase(category);
+		else
+			s.disabled.insert(category);
+		s.categoryGeneration.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool Logger::isCategoryEnabled(const std::string &category)
+	{
+		LoggerState &s = state();
+		std::lock_guard<std::mutex> guard(s.categoryLock);
+		return (s.disabled.find(category) == s.disabled.end());
+	}
+
+	unsigned int Logger::CategoryGeneration()
+	{
+		return state().categoryGeneration.load(std::memory_order_relaxed);
+	}
+
+	void Logger::SetRateLimit(unsigned int messagesPerSecond)
+	{
+		state().rateLimit.store(messagesPerSecond, std::memory_order_relaxed);
+	}
+
+	unsigned int Logger::GetRateLimit()
+	{
+		return state().rateLimit.load(std::memory_order_relaxed);
+	}
+
+	void Logger::SetSink(Sink sink)
+	{
+		LoggerState &s = state();
+		std::lock_guard<std::mutex> guard(s.drainLock);
+		s.sink = sink;
+	}
+
+	void Logger::SetLogFile(const std::string &fileName)
+	{
+		LoggerState &s = state();
+		std::lock_guard<std::mutex> guard(s.drainLock);
+		if (s.file.is_open()) s.file.close();
+		s.fileName = fileName;
+	}
+
+	bool Logger::Write(LogLevel level, const char *category, const char *text, size_t length, unsigned int suppressed)
+	{
+		LoggerState &s = state();
+		if (level < GetLevel()) return false;
+
+		LogRing *ring = threadRing();
+		const size_t numSlots = (length == 0) ? 1 : (length + SlotSize - 1) / SlotSize;
+		const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+		const std::uint64_t tail = ring->tail.load(std::memory_order_acquire);
+		if (head + numSlots - tail > SlotsPerThread)
+		{
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - s.start).count();
+		for (size_t i = 0; i < numSlots; ++i)
+		{
+			LogSlot &slot = ring->slots[(head + i) % SlotsPerThread];
+			const size_t len = (length > SlotSize) ? SlotSize : length;
+			slot.time = time;
+			slot.category = category ? category : "";
+			slot.suppressed = suppressed;
+			slot.level = static_cast<unsigned char>(level);
+			slot.length = static_cast<unsigned short>(len);
+			slot.more = (i + 1 < numSlots);
+			memcpy(slot.text, text, len);
+			text += len;
+			length -= len;
+		}
+		ring->head.store(head + numSlots, std::memory_order_release);
+
+		if (s.shutdown.load(std::memory_order_acquire))
+			drain(); // no writer running anymore
+		else if (!s.running.load(std::memory_order_acquire))
+			startWriter();
+		return true;
+	}
+
+	void Logger::Flush()
+	{
+		drain();
+	}
+
+	std::uint64_t Logger::Dropped()
+	{
+		LoggerState &s = state();
+		std::lock_guard<std::mutex> guard(s.ringLock);
+		std::uint64_t dropped = 0;
+		for (auto &r : s.rings) dropped += r->dropped.load(std::memory_order_relaxed);
+		return dropped;
+	}
+
+	void Logger::Shutdown()
+	{
+		LoggerState &s = state();
+		std::thread writer;
+		{
+			std::lock_guard<std::mutex> guard(s.writerLock);
+			s.stop = true;
+			s.shutdown.store(true, std::memory_order_release);
+			s.running.store(false, std::memory_order_relaxed);
+			writer.swap(s.writer);
+		}
+		s.wakeup.notify_all();
+		if (writer.joinable()) writer.join();
+		drain();
+	}
+} // end namespace lwpp
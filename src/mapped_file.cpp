@@ -0,0 +1,119 @@
+/*!
+ * @file
+ * @brief Implementation of the MappedOutputFile
+ */
+#include <lwpp/platform.h>
+#include <lwpp/mapped_file.h>
+
+#ifdef _MSWIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace lwpp
+{
+#ifdef _MSWIN
+	MappedOutputFile::MappedOutputFile()
+		: m_data(nullptr), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+	{
+		;
+	}
+
+	bool MappedOutputFile::Open(const char *filename, size_t size)
+	{
+		Close();
+		if (size == 0) return false;
+		m_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) return false;
+		const unsigned long long s = size;
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(s >> 32), static_cast<DWORD>(s & 0xffffffff), nullptr);
+		if (m_mapping)
+		{
+			m_data = static_cast<unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+		}
+		if (!m_data)
+		{
+			Close();
+			return false;
+		}
+		m_size = size;
+		return true;
+	}
+
+	bool MappedOutputFile::Close()
+	{
+		bool ok = true;
+		if (m_data)
+		{
+			ok = (FlushViewOfFile(m_data, 0) != 0);
+			UnmapViewOfFile(m_data);
+			m_data = nullptr;
+		}
+		if (m_mapping)
+		{
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+		}
+		m_size = 0;
+		return ok;
+	}
+#else
+	MappedOutputFile::MappedOutputFile()
+		: m_data(nullptr), m_size(0), m_file(-1)
+	{
+		;
+	}
+
+	bool MappedOutputFile::Open(const char *filename, size_t size)
+	{
+		Close();
+		if (size == 0) return false;
+		m_file = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_file < 0) return false;
+		if (ftruncate(m_file, static_cast<off_t>(size)) == 0)
+		{
+			void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+			if (p != MAP_FAILED) m_data = static_cast<unsigned char *>(p);
+		}
+		if (!m_data)
+		{
+			Close();
+			return false;
+		}
+		m_size = size;
+		return true;
+	}
+
+	bool MappedOutputFile::Close()
+	{
+		bool ok = true;
+		if (m_data)
+		{
+			ok = (msync(m_data, m_size, MS_SYNC) == 0);
+			munmap(m_data, m_size);
+			m_data = nullptr;
+		}
+		if (m_file >= 0)
+		{
+			ok = (close(m_file) == 0) && ok;
+			m_file = -1;
+		}
+		m_size = 0;
+		return ok;
+	}
+#endif
+
+	MappedOutputFile::~MappedOutputFile()
+	{
+		Close();
+	}
+} // end namespace lwpp
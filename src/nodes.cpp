@@ -1,6 +1,8 @@
 #include <lwpp/nodes.h>
 #include <lwpp/global.h>
 #include <lwpp/node_handler.h>
+#include <map>
+#include <mutex>
 
 namespace lwpp
 {
@@ -89,5 +91,45 @@ namespace lwpp
     return (lwni->isConnected()) ? 0 : vp->ID();
   }
 
+	void FusedInput::Resolve()
+	{
+		m_source = 0;
+		if (!m_input || !m_input->isConnected()) return;
+		LWNodeOutput out(m_input->connectedOutput());
+		const ConnectionType type = out.type();
+		// LightWave converts between other types
+		if ((type != m_input->type()) || ((type != NOT_SCALAR) && (type != NOT_RGB) && (type != NOT_VECTOR))) return;
+		m_output = out.getID();
+		m_source = FusedNodeHandler::Find(out.node());
+	}
+
+	bool FusedInput::evaluate(LWShadingGeometry *sg, double *value)
+	{
+		if (m_source) return m_source->Kernel(sg, m_output, value);
+		return m_input && (m_input->evaluate(sg, value) != 0);
+	}
+
+	static std::mutex fusedNodesLock;
+	static std::map<NodeID, FusedNodeHandler *> fusedNodes;
+
+	void FusedNodeHandler::Register(NodeID node, FusedNodeHandler *handler)
+	{
+		std::lock_guard<std::mutex> guard(fusedNodesLock);
+		fusedNodes[node] = handler;
+	}
+
+	void FusedNodeHandler::Unregister(NodeID node)
+	{
+		std::lock_guard<std::mutex> guard(fusedNodesLock);
+		fusedNodes.erase(node);
+	}
+
+	FusedNodeHandler *FusedNodeHandler::Find(NodeID node)
+	{
+		std::lock_guard<std::mutex> guard(fusedNodesLock);
+		std::map<NodeID, FusedNodeHandler *>::const_iterator i = fusedNodes.find(node);
+		return (i != fusedNodes.end()) ? i->second : 0;
+	}
+
 }
 
@@ -6,6 +6,9 @@
 #include <algorithm>
 #include <map>
 #include <fstream>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
 
 namespace lwpp
 {
@@ -88,6 +91,147 @@ namespace lwpp
 
 	static PathMap pathMap;
 
+#define PRESETINDEX_CFG "SimplePresetIndex.cfg"
+
+	//! Persistent index of the scanned preset directories
+	/*!
+	 * A directory is only listed again if its modification time changed, and a file in it is only opened again if
+	 * its modification time or size changed. Time stamps only have a resolution of a second, so a directory that
+	 * was modified during the second it was scanned in is always scanned again.
+	 * The index is shared by all presets and kept in the settings directory between sessions.
+	 */
+	class PresetIndex
+	{
+	public:
+		struct IndexedFile
+		{
+			std::string name;	//!< File name without the path
+			time_t mtime;
+			size_t size;
+			bool preset;
+			std::string presetName;
+			bool operator<(const IndexedFile &other) const { return name < other.name; }
+		};
+		struct IndexedDirectory
+		{
+			time_t mtime;
+			time_t scanned;
+			std::vector<IndexedFile> files;
+		};
+
+	private:
+		std::map<std::string, IndexedDirectory> m_dirs;
+		bool m_loaded;
+		bool m_dirty;
+		std::string indexFile()
+		{
+			lwpp::DirInfo di;
+			return di.GetDirectoryStr(LWFTYPE_SETTING) + PRESETINDEX_CFG;
+		}
+
+	public:
+		PresetIndex() : m_loaded(false), m_dirty(false) {}
+
+		//! Return the indexed directory if it is up to date, 0 otherwise
+		IndexedDirectory *Find(const std::string &path, time_t mtime)
+		{
+			std::map<std::string, IndexedDirectory>::iterator i = m_dirs.find(path);
+			if (i == m_dirs.end()) return 0;
+			IndexedDirectory &dir = i->second;
+			if ((dir.mtime != mtime) || (dir.mtime >= dir.scanned)) return 0;
+			return &dir;
+		}
+
+		//! Start indexing a directory again, the previous files are kept
+		IndexedDirectory &Update(const std::string &path, time_t mtime)
+		{
+			IndexedDirectory &dir = m_dirs[path];
+			dir.mtime = mtime;
+			dir.scanned = time(0);
+			m_dirty = true;
+			return dir;
+		}
+
+		//! Force a directory to be scanned again, after saving or deleting a preset in it
+		void Invalidate(const std::string &path)
+		{
+			std::map<std::string, IndexedDirectory>::iterator i = m_dirs.find(path);
+			if (i != m_dirs.end()) i->second.scanned = 0;
+		}
+
+		void Load()
+		{
+			if (m_loaded) return;
+			m_loaded = true;
+			std::ifstream in(indexFile().c_str());
+			if (!in.good()) return;
+			std::string line;
+			IndexedDirectory *dir = 0;
+			while (std::getline(in, line))
+			{
+				std::vector<std::string> fields;
+				std::string::size_type start = 0, tab;
+				while ((tab = line.find('\t', start)) != std::string::npos)
+				{
+					fields.push_back(line.substr(start, tab - start));
+					start = tab + 1;
+				}
+				fields.push_back(line.substr(start));
+				if ((fields[0] == "D") && (fields.size() == 4))
+				{
+					dir = &m_dirs[fields[3]];
+					dir->mtime = static_cast<time_t>(atoll(fields[1].c_str()));
+					dir->scanned = static_cast<time_t>(atoll(fields[2].c_str()));
+					dir->files.clear();
+				}
+				else if ((fields[0] == "F") && (fields.size() == 6) && dir)
+				{
+					IndexedFile file;
+					file.mtime = static_cast<time_t>(atoll(fields[1].c_str()));
+					file.size = static_cast<size_t>(atoll(fields[2].c_str()));
+					file.preset = (fields[3] == "1");
+					file.name = fields[4];
+					file.presetName = fields[5];
+					dir->files.push_back(file);
+				}
+			}
+		}
+
+		void Save()
+		{
+			if (!m_dirty) return;
+			m_dirty = false;
+			std::ofstream out(indexFile().c_str());
+			if (!out.good()) return;
+			out << "# SimplePreset index 1\n";
+			for (std::map<std::string, IndexedDirectory>::iterator i = m_dirs.begin(); i != m_dirs.end(); ++i)
+			{
+				const IndexedDirectory &dir = i->second;
+				bool storable = (i->first.find_first_of("\t\r\n") == std::string::npos);
+				for (std::vector<IndexedFile>::const_iterator f = dir.files.begin(); storable && (f != dir.files.end()); ++f)
+				{
+					storable = (f->name.find_first_of("\t\r\n") == std::string::npos) && (f->presetName.find_first_of("\t\r\n") == std::string::npos);
+				}
+				// directories with names that can't be stored are scanned again in the next session
+				if (!storable) continue;
+				out << "D\t" << static_cast<long long>(dir.mtime) << "\t" << static_cast<long long>(dir.scanned) << "\t" << i->first << "\n";
+				for (std::vector<IndexedFile>::const_iterator f = dir.files.begin(); f != dir.files.end(); ++f)
+				{
+					out << "F\t" << static_cast<long long>(f->mtime) << "\t" << static_cast<unsigned long long>(f->size) << "\t"
+							<< (f->preset ? 1 : 0) << "\t" << f->name << "\t" << f->presetName << "\n";
+				}
+			}
+		}
+	};
+
+	static PresetIndex presetIndex;
+
+	static std::string directoryOf(const std::string &filename)
+	{
+		std::string::size_type idx = filename.find_last_of(fSep);
+		return (idx == std::string::npos) ? std::string() : filename.substr(0, idx);
+	}
+
 	#define IO_VERS LWID_('V','E','R','S')  //!< Version
 	#define IO_PRES LWID_('P','R','E','S')  //!< Preset
 	#define IO_NAME LWID_('N','A','M','E')  //!< Preset
@@ -149,6 +293,7 @@ namespace lwpp
 		{
 			ScanPresets(i->first);
 		}
+		presetIndex.Save();
 		const std::string def("default");
 		for (PresetCollection::iterator i = Presets.begin(); i != Presets.end(); ++i)
 		{
@@ -207,22 +352,50 @@ namespace lwpp
 	void SimplePreset::ScanPresets(std::string type)
 	{
 		std::string path = makeFilePath(type);
-		Directory dir(path.c_str());
-		if (dir.exists())
+		Stat dirStat(path);
+		if (!dirStat.isDirectory()) return;
+		presetIndex.Load();
+		const time_t mtime = dirStat.getModifyTimeStamp();
+		PresetIndex::IndexedDirectory *indexed = presetIndex.Find(path, mtime);
+		if (!indexed)
 		{
-			while (const char *entry = dir.getEntry())
+			// list the directory again, only files that changed since the last scan are opened
+			indexed = &presetIndex.Update(path, mtime);
+			std::vector<PresetIndex::IndexedFile> previous;
+			previous.swap(indexed->files);
+			std::sort(previous.begin(), previous.end());
+			Directory dir(path.c_str());
+			DirectoryEntry entry;
+			while (dir.getEntry(entry))
 			{
-				std::string fullname(path);
-				fullname += fSep;
-				fullname += entry;
-				if (entry && entry[0] == '.') continue; // skip all files starting with a dot
-				if (lwpp::isDirectory(fullname)) continue;
-				if (isPreset(fullname))
+				if (entry.name[0] == '.') continue; // skip all files starting with a dot
+				if (entry.directory) continue;
+				PresetIndex::IndexedFile file;
+				file.name = entry.name;
+				file.mtime = entry.mtime;
+				file.size = entry.size;
+				std::vector<PresetIndex::IndexedFile>::iterator old = std::lower_bound(previous.begin(), previous.end(), file);
+				if ((old != previous.end()) && (old->name == file.name) && (old->mtime == file.mtime) && (old->size == file.size))
+				{
+					file.preset = old->preset;
+					file.presetName = old->presetName;
+				}
+				else
 				{
-					std::string name = grabPresetName(fullname, stripExtension(entry));
-					Presets.AddEntry(fullname.c_str(), name.c_str(), type);
+					file.preset = isPreset(entry.path);
+					if (file.preset) file.presetName = grabPresetName(entry.path, stripExtension(entry.name.c_str()));
 				}
+				indexed->files.push_back(file);
 			}
+			std::sort(indexed->files.begin(), indexed->files.end());
+		}
+		for (std::vector<PresetIndex::IndexedFile>::const_iterator f = indexed->files.begin(); f != indexed->files.end(); ++f)
+		{
+			if (!f->preset) continue;
+			std::string fullname(path);
+			fullname += fSep;
+			fullname += f->name;
+			Presets.AddEntry(fullname.c_str(), f->presetName.c_str(), type);
 		}
 	}
 
@@ -235,6 +408,7 @@ namespace lwpp
 		{
 			ScanPresets(i->first);
 		}
+		presetIndex.Save();
 		return Presets.size() + 5; // bar, save, delete, save as, load from
 	}
 
@@ -420,6 +594,7 @@ namespace lwpp
 						_unlink(saveReq.getFullPath());
 						return;
 					}
+					presetIndex.Invalidate(directoryOf(saveReq.getFullPath()));
 					LWMessage::Info(std::string("Saved Preset As: ") + saveReq.getFullPath());
 				}
 			}
@@ -510,6 +685,7 @@ namespace lwpp
 						}
 					}
 					makeAllDirectories(pres_file.c_str());
+					presetIndex.Invalidate(directoryOf(pres_file));
 					LWError err = 0;
 					{
 						File out(pres_file.c_str(), File::FILE_SAVE);
@@ -595,6 +771,7 @@ namespace lwpp
 						fclose(outfile);
 					}
 				}
+				presetIndex.Invalidate(directoryOf(pres_file));
 				if (_unlink( pres_file.c_str())  == -1 )
 				{
 					LWMessage::Error("Error Deleting file:", pres_file.c_str());
@@ -0,0 +1,868 @@
+/*!
+ * @file
+ * @brief Implementation of the PrimitiveBVH
+ */
+#include <lwpp/primitive_bvh.h>
+#include <lwpp/math.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lwpp
+{
+	namespace
+	{
+		const size_t MAX_LEAF = 4;
+		const int SAH_BINS = 16;
+		//! Traversal stack entries, the tree is never deeper
+		const int STACK_SIZE = 64;
+
+		// number of floats per key
+		const size_t KEY_SIZE[3] = { 4, 9, 7 };
+
+		//! Depth of a tree below a node with count primitives built with median splits only
+		inline int medianLevels(size_t count)
+		{
+			int levels = 0;
+			for (; count > MAX_LEAF; count = (count + 1) / 2) ++levels;
+			return levels;
+		}
+
+		inline Point3d point(const float *f) { return Point3d(f[0], f[1], f[2]); }
+
+		inline float roundDown(double v) { return std::nextafter(static_cast<float>(v), -std::numeric_limits<float>::infinity()); }
+		inline float roundUp(double v) { return std::nextafter(static_cast<float>(v), std::numeric_limits<float>::infinity()); }
+
+		inline double boxArea(const float min[3], const float max[3])
+		{
+			const double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+			return (dx < 0.0) ? 0.0 : 2.0 * (dx * dy + dy * dz + dz * dx);
+		}
+
+		inline void emptyBox(float min[3], float max[3])
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				min[i] = std::numeric_limits<float>::max();
+				max[i] = -std::numeric_limits<float>::max();
+			}
+		}
+
+		inline void growBox(float min[3], float max[3], const float bmin[3], const float bmax[3])
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				min[i] = std::min(min[i], bmin[i]);
+				max[i] = std::max(max[i], bmax[i]);
+			}
+		}
+
+		//! Smallest root of a quadratic within (tMin, tMax)
+		inline bool solveQuadratic(double a, double halfB, double c, double tMin, double tMax, double &t0, double &t1)
+		{
+			if (a == 0.0) return false;
+			const double disc = halfB * halfB - a * c;
+			if (disc < 0.0) return false;
+			const double s = std::sqrt(disc);
+			// numerically stable form
+			const double q = (halfB > 0.0) ? -(halfB + s) : -(halfB - s);
+			t0 = q / a;
+			t1 = (q != 0.0) ? c / q : t0;
+			if (t0 > t1) std::swap(t0, t1);
+			return (t1 > tMin) && (t0 < tMax);
+		}
+
+		inline void sphereSurface(const Point3d &c, double r, const Point3d &p, PrimitiveBVH::Hit &hit)
+		{
+			Vector3d n = p - c;
+			const double len = n.Magnitude();
+			n = (len > 0.0) ? n / len : Vector3d(0.0, 1.0, 0.0);
+			const double theta = std::acos(Clamp(n.y, -1.0, 1.0));
+			const double phi = std::atan2(n.x, n.z);
+			const double sinTheta = std::sin(theta);
+			hit.u = 0.5 + phi / TWOPI;
+			hit.v = theta / PI;
+			hit.n = n;
+			hit.dPdu = Vector3d(TWOPI * r * sinTheta * std::cos(phi), 0.0, -TWOPI * r * sinTheta * std::sin(phi));
+			hit.dPdv = Vector3d(PI * r * std::cos(theta) * std::sin(phi), -PI * r * sinTheta, PI * r * std::cos(theta) * std::cos(phi));
+		}
+
+		inline void curveSurface(const Point3d &a, const Point3d &b, double r, const Point3d &p, PrimitiveBVH::Hit &hit)
+		{
+			const Vector3d ba = b - a;
+			const double baba = Dot(ba, ba);
+			const double h = (baba > 0.0) ? Clamp(Dot(p - a, ba) / baba, 0.0, 1.0) : 0.0;
+			Vector3d n = p - (a + ba * h);
+			const double len = n.Magnitude();
+			if (len > 0.0)
+			{
+				n /= len;
+			}
+			else
+			{
+				Vector3d t;
+				CoordinateSystem(baba > 0.0 ? ba / std::sqrt(baba) : Vector3d(0.0, 1.0, 0.0), &n, &t);
+			}
+			hit.n = n;
+			hit.u = h;
+			hit.v = 0.0;
+			hit.dPdu = ba;
+			hit.dPdv = Cross(n, ba) * (TWOPI * r / std::max(std::sqrt(baba), 1e-30));
+		}
+
+		inline void triangleSurface(const Point3d &p0, const Point3d &p1, const Point3d &p2, double b1, double b2, PrimitiveBVH::Hit &hit)
+		{
+			hit.dPdu = p1 - p0;
+			hit.dPdv = p2 - p0;
+			hit.n = Cross(hit.dPdu, hit.dPdv);
+			const double len = hit.n.Magnitude();
+			if (len > 0.0) hit.n /= len;
+			hit.u = b1;
+			hit.v = b2;
+		}
+
+		//! Closest point on a triangle, Ericson, Real-Time Collision Detection 5.1.5
+		Point3d closestOnTriangle(const Point3d &p, const Point3d &a, const Point3d &b, const Point3d &c, double &b1, double &b2)
+		{
+			const Vector3d ab = b - a, ac = c - a, ap = p - a;
+			const double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+			if ((d1 <= 0.0) && (d2 <= 0.0)) { b1 = b2 = 0.0; return a; }
+			const Vector3d bp = p - b;
+			const double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+			if ((d3 >= 0.0) && (d4 <= d3)) { b1 = 1.0; b2 = 0.0; return b; }
+			const double vc = d1 * d4 - d3 * d2;
+			if ((vc <= 0.0) && (d1 >= 0.0) && (d3 <= 0.0))
+			{
+				b1 = d1 / (d1 - d3);
+				b2 = 0.0;
+				return a + ab * b1;
+			}
+			const Vector3d cp = p - c;
+			const double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+			if ((d6 >= 0.0) && (d5 <= d6)) { b1 = 0.0; b2 = 1.0; return c; }
+			const double vb = d5 * d2 - d1 * d6;
+			if ((vb <= 0.0) && (d2 >= 0.0) && (d6 <= 0.0))
+			{
+				b1 = 0.0;
+				b2 = d2 / (d2 - d6);
+				return a + ac * b2;
+			}
+			const double va = d3 * d6 - d5 * d4;
+			if ((va <= 0.0) && ((d4 - d3) >= 0.0) && ((d5 - d6) >= 0.0))
+			{
+				b2 = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+				b1 = 1.0 - b2;
+				return b + (c - b) * b2;
+			}
+			const double denom = 1.0 / (va + vb + vc);
+			b1 = vb * denom;
+			b2 = vc * denom;
+			return a + ab * b1 + ac * b2;
+		}
+	}
+
+	PrimitiveBVH::PrimitiveBVH()
+		: m_area(0.0), m_depth(0), m_motion(false)
+	{
+		;
+	}
+
+	void PrimitiveBVH::Clear()
+	{
+		m_prims.clear();
+		m_data.clear();
+		m_nodes.clear();
+		m_order.clear();
+		m_areaCdf.clear();
+		m_area = 0.0;
+		m_depth = 0;
+		m_motion = false;
+	}
+
+	void PrimitiveBVH::Reserve(size_t count)
+	{
+		m_prims.reserve(count);
+		m_data.reserve(count * 9);
+	}
+
+	unsigned int PrimitiveBVH::add(PrimitiveType type, bool motion, unsigned int id, const double *key0, const double *key1, size_t floats)
+	{
+		Primitive prim;
+		prim.type = static_cast<unsigned char>(type);
+		prim.motion = motion ? 1 : 0;
+		prim.pad = 0;
+		prim.id = id;
+		prim.data = static_cast<unsigned int>(m_data.size());
+		prim.index = static_cast<unsigned int>(m_prims.size());
+		prim.open = 0.0f;
+		prim.close = 1.0f;
+		for (size_t i = 0; i < floats; ++i) m_data.push_back(static_cast<float>(key0[i]));
+		if (motion)
+		{
+			for (size_t i = 0; i < floats; ++i) m_data.push_back(static_cast<float>(key1[i]));
+			m_motion = true;
+		}
+		m_prims.push_back(prim);
+		m_nodes.clear();
+		return prim.index;
+	}
+
+	unsigned int PrimitiveBVH::AddSphere(const Point3d &centre, double radius, unsigned int id)
+	{
+		const double key[4] = { centre.x, centre.y, centre.z, std::fabs(radius) };
+		return add(PRIM_SPHERE, false, id, key, nullptr, 4);
+	}
+
+	unsigned int PrimitiveBVH::AddSphere(const Point3d &centre0, double radius0, const Point3d &centre1, double radius1, unsigned int id)
+	{
+		const double key0[4] = { centre0.x, centre0.y, centre0.z, std::fabs(radius0) };
+		const double key1[4] = { centre1.x, centre1.y, centre1.z, std::fabs(radius1) };
+		return add(PRIM_SPHERE, true, id, key0, key1, 4);
+	}
+
+	unsigned int PrimitiveBVH::AddTriangle(const Point3d &p0, const Point3d &p1, const Point3d &p2, unsigned int id)
+	{
+		const double key[9] = { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z };
+		return add(PRIM_TRIANGLE, false, id, key, nullptr, 9);
+	}
+
+	unsigned int PrimitiveBVH::AddTriangle(const Point3d key0[3], const Point3d key1[3], unsigned int id)
+	{
+		double k0[9], k1[9];
+		for (int i = 0; i < 3; ++i)
+		{
+			k0[3 * i] = key0[i].x; k0[3 * i + 1] = key0[i].y; k0[3 * i + 2] = key0[i].z;
+			k1[3 * i] = key1[i].x; k1[3 * i + 1] = key1[i].y; k1[3 * i + 2] = key1[i].z;
+		}
+		return add(PRIM_TRIANGLE, true, id, k0, k1, 9);
+	}
+
+	unsigned int PrimitiveBVH::AddCurve(const Point3d &p0, const Point3d &p1, double radius, unsigned int id)
+	{
+		const double key[7] = { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, std::fabs(radius) };
+		return add(PRIM_CURVE, false, id, key, nullptr, 7);
+	}
+
+	unsigned int PrimitiveBVH::AddCurve(const Point3d &p0, const Point3d &p1, const Point3d &q0, const Point3d &q1, double radius, unsigned int id)
+	{
+		const double key0[7] = { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, std::fabs(radius) };
+		const double key1[7] = { q0.x, q0.y, q0.z, q1.x, q1.y, q1.z, std::fabs(radius) };
+		return add(PRIM_CURVE, true, id, key0, key1, 7);
+	}
+
+	void PrimitiveBVH::SetTimeInterval(unsigned int primitive, double open, double close)
+	{
+		// primitives are only reordered by Build()
+		Primitive &prim = m_nodes.empty() ? m_prims[primitive] : m_prims[m_order[primitive]];
+		prim.open = static_cast<float>(open);
+		prim.close = static_cast<float>(close);
+	}
+
+	const float *PrimitiveBVH::key(const Primitive &prim, double time, float *scratch) const
+	{
+		const float *k0 = &m_data[prim.data];
+		if (!prim.motion) return k0;
+		const size_t n = KEY_SIZE[prim.type];
+		const float *k1 = k0 + n;
+		const float t = static_cast<float>(Clamp(time, 0.0, 1.0));
+		for (size_t i = 0; i < n; ++i) scratch[i] = k0[i] + (k1[i] - k0[i]) * t;
+		return scratch;
+	}
+
+	void PrimitiveBVH::primitiveBounds(const Primitive &prim, float min[3], float max[3]) const
+	{
+		emptyBox(min, max);
+		const size_t n = KEY_SIZE[prim.type];
+		for (int k = 0; k <= prim.motion; ++k)
+		{
+			const float *f = &m_data[prim.data + k * n];
+			double kmin[3], kmax[3];
+			switch (prim.type)
+			{
+				case PRIM_SPHERE:
+					for (int i = 0; i < 3; ++i)
+					{
+						kmin[i] = f[i] - f[3];
+						kmax[i] = f[i] + f[3];
+					}
+					break;
+				case PRIM_TRIANGLE:
+					for (int i = 0; i < 3; ++i)
+					{
+						kmin[i] = std::min(f[i], std::min(f[3 + i], f[6 + i]));
+						kmax[i] = std::max(f[i], std::max(f[3 + i], f[6 + i]));
+					}
+					break;
+				default:
+					for (int i = 0; i < 3; ++i)
+					{
+						kmin[i] = std::min(f[i], f[3 + i]) - static_cast<double>(f[6]);
+						kmax[i] = std::max(f[i], f[3 + i]) + static_cast<double>(f[6]);
+					}
+					break;
+			}
+			for (int i = 0; i < 3; ++i)
+			{
+				min[i] = std::min(min[i], roundDown(kmin[i]));
+				max[i] = std::max(max[i], roundUp(kmax[i]));
+			}
+		}
+	}
+
+	double PrimitiveBVH::primitiveArea(const Primitive &prim, double time) const
+	{
+		float scratch[9];
+		const float *f = key(prim, time, scratch);
+		switch (prim.type)
+		{
+			case PRIM_SPHERE:
+				return 4.0 * PI * Sqr(static_cast<double>(f[3]));
+			case PRIM_TRIANGLE:
+				return 0.5 * Cross(point(f + 3) - point(f), point(f + 6) - point(f)).Magnitude();
+			default:
+			{
+				const double r = f[6];
+				return TWOPI * r * (point(f + 3) - point(f)).Magnitude() + 4.0 * PI * r * r;
+			}
+		}
+	}
+
+	void PrimitiveBVH::Build()
+	{
+		m_nodes.clear();
+		m_order.clear();
+		m_areaCdf.clear();
+		m_area = 0.0;
+		m_depth = 0;
+		if (m_prims.empty()) return;
+
+		std::vector<BuildItem> items(m_prims.size());
+		for (size_t i = 0; i < m_prims.size(); ++i)
+		{
+			BuildItem &item = items[i];
+			primitiveBounds(m_prims[i], item.min, item.max);
+			for (int a = 0; a < 3; ++a) item.centre[a] = 0.5f * (item.min[a] + item.max[a]);
+			item.prim = static_cast<unsigned int>(i);
+		}
+
+		std::vector<Primitive> ordered;
+		ordered.reserve(m_prims.size());
+		m_nodes.reserve(2 * m_prims.size());
+		build(items, 0, items.size(), ordered, 0);
+		m_prims.swap(ordered);
+
+		m_order.resize(m_prims.size());
+		m_areaCdf.resize(m_prims.size());
+		double sum = 0.0;
+		for (size_t i = 0; i < m_prims.size(); ++i)
+		{
+			const Primitive &prim = m_prims[i];
+			m_order[prim.index] = static_cast<unsigned int>(i);
+			sum += prim.motion ? 0.5 * (primitiveArea(prim, 0.0) + primitiveArea(prim, 1.0)) : primitiveArea(prim, 0.0);
+			m_areaCdf[i] = sum;
+		}
+		m_area = sum;
+	}
+
+	unsigned int PrimitiveBVH::build(std::vector<BuildItem> &items, size_t begin, size_t end, std::vector<Primitive> &ordered, int depth)
+	{
+		const unsigned int nodeIndex = static_cast<unsigned int>(m_nodes.size());
+		m_nodes.push_back(Node());
+		m_depth = std::max(m_depth, depth);
+		float min[3], max[3], cmin[3], cmax[3];
+		emptyBox(min, max);
+		emptyBox(cmin, cmax);
+		for (size_t i = begin; i < end; ++i)
+		{
+			growBox(min, max, items[i].min, items[i].max);
+			growBox(cmin, cmax, items[i].centre, items[i].centre);
+		}
+		const size_t count = end - begin;
+		int axis = 0;
+		for (int a = 1; a < 3; ++a)
+		{
+			if ((cmax[a] - cmin[a]) > (cmax[axis] - cmin[axis])) axis = a;
+		}
+		const float extent = cmax[axis] - cmin[axis];
+
+		size_t mid = begin;
+		bool leaf = (count <= MAX_LEAF);
+		// an uneven split may leave a child with almost all primitives, only allow it while that child can still be
+		// finished with median splits without exceeding the traversal stack
+		if (!leaf && (extent > 0.0f) && (depth + 1 + medianLevels(count) < STACK_SIZE))
+		{
+			struct Bin
+			{
+				float min[3], max[3];
+				size_t count;
+			} bins[SAH_BINS];
+			for (int b = 0; b < SAH_BINS; ++b)
+			{
+				emptyBox(bins[b].min, bins[b].max);
+				bins[b].count = 0;
+			}
+			const float scale = SAH_BINS / extent;
+			auto binOf = [&](const BuildItem &item)
+			{
+				return std::min(static_cast<int>((item.centre[axis] - cmin[axis]) * scale), SAH_BINS - 1);
+			};
+			for (size_t i = begin; i < end; ++i)
+			{
+				Bin &bin = bins[binOf(items[i])];
+				growBox(bin.min, bin.max, items[i].min, items[i].max);
+				++bin.count;
+			}
+			// sweep from the right to get the cost of the right side of every split
+			double rightArea[SAH_BINS];
+			size_t rightCount[SAH_BINS];
+			float rmin[3], rmax[3];
+			emptyBox(rmin, rmax);
+			size_t n = 0;
+			for (int b = SAH_BINS - 1; b > 0; --b)
+			{
+				growBox(rmin, rmax, bins[b].min, bins[b].max);
+				n += bins[b].count;
+				rightArea[b] = boxArea(rmin, rmax);
+				rightCount[b] = n;
+			}
+			float lmin[3], lmax[3];
+			emptyBox(lmin, lmax);
+			n = 0;
+			double bestCost = std::numeric_limits<double>::max();
+			int bestSplit = -1;
+			for (int b = 1; b < SAH_BINS; ++b)
+			{
+				growBox(lmin, lmax, bins[b - 1].min, bins[b - 1].max);
+				n += bins[b - 1].count;
+				if ((n == 0) || (rightCount[b] == 0)) continue;
+				const double cost = boxArea(lmin, lmax) * n + rightArea[b] * rightCount[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = b;
+				}
+			}
+			const double area = boxArea(min, max);
+			// traversing a node costs about as much as intersecting a primitive
+			bestCost = 1.0 + ((area > 0.0) ? bestCost / area : 0.0);
+			if ((bestSplit < 0) || ((bestCost >= count) && (count <= 4 * MAX_LEAF)))
+			{
+				leaf = (bestSplit >= 0);
+			}
+			else
+			{
+				mid = std::partition(items.begin() + begin, items.begin() + end,
+														 [&](const BuildItem &item) { return binOf(item) < bestSplit; }) - items.begin();
+			}
+		}
+		if (!leaf && ((mid == begin) || (mid == end)))
+		{
+			// all centroids coincide or the tree would get too deep, split at the median
+			mid = begin + count / 2;
+			std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+											 [axis](const BuildItem &a, const BuildItem &b) { return a.centre[axis] < b.centre[axis]; });
+		}
+
+		Node &node = m_nodes[nodeIndex];
+		for (int a = 0; a < 3; ++a)
+		{
+			node.min[a] = min[a];
+			node.max[a] = max[a];
+		}
+		node.axis = static_cast<unsigned short>(axis);
+		if (leaf)
+		{
+			node.offset = static_cast<unsigned int>(ordered.size());
+			node.count = static_cast<unsigned short>(count);
+			for (size_t i = begin; i < end; ++i) ordered.push_back(m_prims[items[i].prim]);
+			return nodeIndex;
+		}
+		node.count = 0;
+		build(items, begin, mid, ordered, depth + 1);
+		const unsigned int right = build(items, mid, end, ordered, depth + 1);
+		m_nodes[nodeIndex].offset = right;
+		return nodeIndex;
+	}
+
+	bool PrimitiveBVH::Bounds(Point3d &min, Point3d &max) const
+	{
+		if (m_nodes.empty()) return false;
+		const Node &root = m_nodes[0];
+		min = Point3d(root.min[0], root.min[1], root.min[2]);
+		max = Point3d(root.max[0], root.max[1], root.max[2]);
+		return true;
+	}
+
+	size_t PrimitiveBVH::MemorySize() const
+	{
+		return sizeof(*this) +
+			m_prims.capacity() * sizeof(Primitive) +
+			m_data.capacity() * sizeof(float) +
+			m_nodes.capacity() * sizeof(Node) +
+			m_order.capacity() * sizeof(unsigned int) +
+			m_areaCdf.capacity() * sizeof(double);
+	}
+
+	bool PrimitiveBVH::intersect(const Primitive &prim, const Ray &ray, double tMax, Hit *hit) const
+	{
+		if (!exists(prim, ray.time)) return false;
+		float scratch[9];
+		const float *f = key(prim, ray.time, scratch);
+		const Vector3d &d = ray.dir;
+		double t = 0.0;
+		switch (prim.type)
+		{
+			case PRIM_SPHERE:
+			{
+				const Point3d c = point(f);
+				const Vector3d oc = ray.origin - c;
+				double t0, t1;
+				if (!solveQuadratic(Dot(d, d), Dot(oc, d), Dot(oc, oc) - Sqr(static_cast<double>(f[3])), ray.tMin, tMax, t0, t1)) return false;
+				t = (t0 > ray.tMin) ? t0 : t1;
+				if (t >= tMax) return false;
+				if (hit) sphereSurface(c, f[3], ray.origin + d * t, *hit);
+				break;
+			}
+			case PRIM_TRIANGLE:
+			{
+				// Moeller-Trumbore
+				const Point3d p0 = point(f);
+				const Vector3d e1 = point(f + 3) - p0, e2 = point(f + 6) - p0;
+				const Vector3d pv = Cross(d, e2);
+				const double det = Dot(e1, pv);
+				if (det == 0.0) return false;
+				const double inv = 1.0 / det;
+				const Vector3d tv = ray.origin - p0;
+				const double b1 = Dot(tv, pv) * inv;
+				if ((b1 < 0.0) || (b1 > 1.0)) return false;
+				const Vector3d qv = Cross(tv, e1);
+				const double b2 = Dot(d, qv) * inv;
+				if ((b2 < 0.0) || (b1 + b2 > 1.0)) return false;
+				t = Dot(e2, qv) * inv;
+				if ((t <= ray.tMin) || (t >= tMax)) return false;
+				if (hit) triangleSurface(p0, point(f + 3), point(f + 6), b1, b2, *hit);
+				break;
+			}
+			default:
+			{
+				// capsule: the closest of the cylinder and the two end spheres
+				const Point3d a = point(f), b = point(f + 3);
+				const double r2 = Sqr(static_cast<double>(f[6]));
+				const Vector3d ba = b - a;
+				const double baba = Dot(ba, ba);
+				const Vector3d oa = ray.origin - a;
+				double best = tMax;
+				double t0, t1;
+				if (baba > 0.0)
+				{
+					const Vector3d w = ba / std::sqrt(baba);
+					const Vector3d dp = d - w * Dot(d, w);
+					const Vector3d op = oa - w * Dot(oa, w);
+					if (solveQuadratic(Dot(dp, dp), Dot(op, dp), Dot(op, op) - r2, ray.tMin, best, t0, t1))
+					{
+						const double roots[2] = { t0, t1 };
+						for (int i = 0; i < 2; ++i)
+						{
+							const double y = Dot(oa + d * roots[i], ba);
+							if ((roots[i] > ray.tMin) && (roots[i] < best) && (y >= 0.0) && (y <= baba)) best = roots[i];
+						}
+					}
+				}
+				for (int end = 0; end < 2; ++end)
+				{
+					const Vector3d oc = end ? (ray.origin - b) : oa;
+					if (!solveQuadratic(Dot(d, d), Dot(oc, d), Dot(oc, oc) - r2, ray.tMin, best, t0, t1)) continue;
+					const double roots[2] = { t0, t1 };
+					for (int i = 0; i < 2; ++i)
+					{
+						// only the half of each sphere that caps the cylinder
+						const double y = Dot(oa + d * roots[i], ba);
+						const bool cap = end ? (y >= baba) : (y <= 0.0);
+						if (cap && (roots[i] > ray.tMin) && (roots[i] < best)) best = roots[i];
+					}
+				}
+				if (best >= tMax) return false;
+				t = best;
+				if (hit) curveSurface(a, b, f[6], ray.origin + d * t, *hit);
+				break;
+			}
+		}
+		if (hit)
+		{
+			hit->t = t;
+			hit->p = ray.origin + d * t;
+			hit->primitive = prim.index;
+			hit->id = prim.id;
+			hit->type = static_cast<PrimitiveType>(prim.type);
+		}
+		return true;
+	}
+
+	template <typename Visit>
+	void PrimitiveBVH::traverse(const Ray &ray, double &tMax, Visit visit) const
+	{
+		const double o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const double inv[3] = { 1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z };
+		const bool negative[3] = { inv[0] < 0.0, inv[1] < 0.0, inv[2] < 0.0 };
+		unsigned int stack[STACK_SIZE];
+		int top = 0;
+		unsigned int current = 0;
+		for (;;)
+		{
+			const Node &node = m_nodes[current];
+			double t0 = ray.tMin, t1 = tMax;
+			for (int a = 0; a < 3; ++a)
+			{
+				double tNear = (node.min[a] - o[a]) * inv[a];
+				double tFar = (node.max[a] - o[a]) * inv[a];
+				if (negative[a]) std::swap(tNear, tFar);
+				t0 = (tNear > t0) ? tNear : t0;
+				t1 = (tFar < t1) ? tFar : t1;
+			}
+			if (t0 <= t1)
+			{
+				if (node.count)
+				{
+					for (unsigned int i = 0; i < node.count; ++i)
+					{
+						if (visit(m_prims[node.offset + i])) return;
+					}
+				}
+				else
+				{
+					// visit the child on the side the ray comes from first
+					if (negative[node.axis])
+					{
+						stack[top++] = current + 1;
+						current = node.offset;
+					}
+					else
+					{
+						stack[top++] = node.offset;
+						current = current + 1;
+					}
+					continue;
+				}
+			}
+			if (top == 0) break;
+			current = stack[--top];
+		}
+	}
+
+	bool PrimitiveBVH::Intersect(const Ray &ray, Hit &hit) const
+	{
+		if (m_nodes.empty()) return false;
+		double tMax = ray.tMax;
+		bool found = false;
+		traverse(ray, tMax, [&](const Primitive &prim)
+		{
+			if (intersect(prim, ray, tMax, &hit))
+			{
+				tMax = hit.t;
+				found = true;
+			}
+			return false;
+		});
+		return found;
+	}
+
+	bool PrimitiveBVH::Occluded(const Ray &ray) const
+	{
+		if (m_nodes.empty()) return false;
+		double tMax = ray.tMax;
+		bool found = false;
+		traverse(ray, tMax, [&](const Primitive &prim)
+		{
+			found = intersect(prim, ray, tMax, nullptr);
+			return found;
+		});
+		return found;
+	}
+
+	bool PrimitiveBVH::NearestPoint(const Point3d &p, double time, double maxDistance, Hit &hit) const
+	{
+		if (m_nodes.empty()) return false;
+		const double q[3] = { p.x, p.y, p.z };
+		auto boxDistance = [&q](const Node &node)
+		{
+			double d = 0.0;
+			for (int a = 0; a < 3; ++a)
+			{
+				if (q[a] < node.min[a]) d += Sqr(node.min[a] - q[a]);
+				else if (q[a] > node.max[a]) d += Sqr(q[a] - node.max[a]);
+			}
+			return d;
+		};
+
+		double best = Sqr(maxDistance);
+		bool found = false;
+		unsigned int stack[STACK_SIZE];
+		int top = 0;
+		unsigned int current = 0;
+		for (;;)
+		{
+			const Node &node = m_nodes[current];
+			if (boxDistance(node) <= best)
+			{
+				if (node.count)
+				{
+					for (unsigned int i = 0; i < node.count; ++i)
+					{
+						const Primitive &prim = m_prims[node.offset + i];
+						if (!exists(prim, time)) continue;
+						float scratch[9];
+						const float *f = key(prim, time, scratch);
+						Hit h;
+						Point3d c;
+						switch (prim.type)
+						{
+							case PRIM_SPHERE:
+							{
+								sphereSurface(point(f), f[3], p, h);
+								c = point(f) + h.n * f[3];
+								break;
+							}
+							case PRIM_TRIANGLE:
+							{
+								double b1, b2;
+								c = closestOnTriangle(p, point(f), point(f + 3), point(f + 6), b1, b2);
+								triangleSurface(point(f), point(f + 3), point(f + 6), b1, b2, h);
+								break;
+							}
+							default:
+							{
+								curveSurface(point(f), point(f + 3), f[6], p, h);
+								const Vector3d ba = point(f + 3) - point(f);
+								c = point(f) + ba * h.u + h.n * f[6];
+								break;
+							}
+						}
+						const double d = Dot(c - p, c - p);
+						if (d < best)
+						{
+							best = d;
+							found = true;
+							hit = h;
+							hit.p = c;
+							hit.t = std::sqrt(d);
+							hit.primitive = prim.index;
+							hit.id = prim.id;
+							hit.type = static_cast<PrimitiveType>(prim.type);
+						}
+					}
+				}
+				else
+				{
+					const unsigned int left = current + 1, right = node.offset;
+					const double dl = boxDistance(m_nodes[left]), dr = boxDistance(m_nodes[right]);
+					if (dl <= dr)
+					{
+						stack[top++] = right;
+						current = left;
+					}
+					else
+					{
+						stack[top++] = left;
+						current = right;
+					}
+					continue;
+				}
+			}
+			if (top == 0) break;
+			current = stack[--top];
+		}
+		return found;
+	}
+
+	double PrimitiveBVH::Area(double time) const
+	{
+		double area = 0.0;
+		for (auto &prim : m_prims)
+		{
+			if (exists(prim, time)) area += primitiveArea(prim, time);
+		}
+		return area;
+	}
+
+	bool PrimitiveBVH::Sample(double time, const double u[3], Point3d &p, Vector3d &n) const
+	{
+		if (m_areaCdf.empty() || (m_area <= 0.0)) return false;
+		const double target = u[0] * m_area;
+		size_t i = std::upper_bound(m_areaCdf.begin(), m_areaCdf.end(), target) - m_areaCdf.begin();
+		if (i >= m_prims.size()) i = m_prims.size() - 1;
+		const Primitive &prim = m_prims[i];
+		if (!exists(prim, time)) return false;
+		// reuse the position within the cell of the chosen primitive
+		const double lower = i ? m_areaCdf[i - 1] : 0.0;
+		const double u0 = (m_areaCdf[i] > lower) ? Clamp((target - lower) / (m_areaCdf[i] - lower), 0.0, 1.0) : 0.5;
+
+		float scratch[9];
+		const float *f = key(prim, time, scratch);
+		auto sphereDirection = [](double u1, double u2)
+		{
+			const double z = 1.0 - 2.0 * u1;
+			const double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+			const double phi = TWOPI * u2;
+			return Vector3d(r * std::cos(phi), r * std::sin(phi), z);
+		};
+		switch (prim.type)
+		{
+			case PRIM_SPHERE:
+			{
+				n = sphereDirection(u[1], u[2]);
+				p = point(f) + n * f[3];
+				break;
+			}
+			case PRIM_TRIANGLE:
+			{
+				const double su = std::sqrt(u[1]);
+				const double b1 = u[2] * su, b2 = 1.0 - (1.0 - su) - b1;
+				const Point3d p0 = point(f);
+				const Vector3d e1 = point(f + 3) - p0, e2 = point(f + 6) - p0;
+				p = p0 + e1 * b1 + e2 * b2;
+				n = Cross(e1, e2);
+				const double len = n.Magnitude();
+				if (len <= 0.0) return false;
+				n /= len;
+				break;
+			}
+			default:
+			{
+				const Point3d a = point(f), b = point(f + 3);
+				const double r = f[6];
+				const Vector3d ba = b - a;
+				const double length = ba.Magnitude();
+				const double side = TWOPI * r * length;
+				if (u0 * (side + 4.0 * PI * r * r) < side)
+				{
+					const Vector3d w = ba / length;
+					Vector3d s, t;
+					CoordinateSystem(w, &s, &t);
+					const double phi = TWOPI * u[2];
+					n = s * std::cos(phi) + t * std::sin(phi);
+					p = a + ba * u[1] + n * r;
+				}
+				else
+				{
+					// a uniform point on a sphere, the half facing away from the segment caps the nearer end
+					n = sphereDirection(u[1], u[2]);
+					p = ((Dot(n, ba) < 0.0) ? a : b) + n * r;
+				}
+				break;
+			}
+		}
+		return true;
+	}
+
+	double PrimitiveBVH::Pdf(unsigned int primitive, double time) const
+	{
+		if (m_areaCdf.empty() || (m_area <= 0.0) || (primitive >= m_order.size())) return 0.0;
+		const unsigned int i = m_order[primitive];
+		const Primitive &prim = m_prims[i];
+		if (!exists(prim, time)) return 0.0;
+		const double area = primitiveArea(prim, time);
+		if (area <= 0.0) return 0.0;
+		const double weight = m_areaCdf[i] - (i ? m_areaCdf[i - 1] : 0.0);
+		return weight / (m_area * area);
+	}
+} // end namespace lwpp
@@ -0,0 +1,326 @@
+/*!
+ * @file
+ * @brief Implementation of the lwpp scoped profiler
+ */
+#include <lwpp/profiler.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lwpp
+{
+	std::atomic<bool> Profiler::s_enabled(false);
+
+	namespace
+	{
+		struct ProfileEvent
+		{
+			ProfileTicks start;
+			ProfileTicks end;
+			unsigned int zone;
+		};
+
+		//! Statistics of one zone for one thread, only ever written by the owning thread
+		struct ThreadZone
+		{
+			std::atomic<std::uint64_t> count;
+			std::atomic<std::uint64_t> total;
+			std::atomic<std::uint64_t> min;
+			std::atomic<std::uint64_t> max;
+			std::atomic<std::uint64_t> histogram[Profiler::HistogramBuckets];
+		};
+
+		struct ThreadBuffer
+		{
+			unsigned int index;
+			std::atomic<std::uint64_t> written;
+			std::vector<ProfileEvent> events;
+			ThreadZone zones[Profiler::MaxZones];
+
+			explicit ThreadBuffer(unsigned int idx)
+				: index(idx), written(0), events(Profiler::EventsPerThread)
+			{
+				clear();
+			}
+			void clear()
+			{
+				written.store(0, std::memory_order_relaxed);
+				for (auto &z : zones)
+				{
+					z.count.store(0, std::memory_order_relaxed);
+					z.total.store(0, std::memory_order_relaxed);
+					z.min.store(~std::uint64_t(0), std::memory_order_relaxed);
+					z.max.store(0, std::memory_order_relaxed);
+					for (auto &h : z.histogram) h.store(0, std::memory_order_relaxed);
+				}
+			}
+		};
+
+		struct Registry
+		{
+			std::mutex lock;
+			std::vector<std::string> zoneNames;
+			std::vector<std::unique_ptr<ThreadBuffer>> threads;
+			double ticksPerMicrosecond;
+			Registry() : ticksPerMicrosecond(1000.0)
+			{
+				zoneNames.reserve(Profiler::MaxZones);
+			}
+		};
+
+		Registry &registry()
+		{
+			static Registry r;
+			return r;
+		}
+
+		ThreadBuffer *threadBuffer()
+		{
+			static thread_local ThreadBuffer *buffer = nullptr;
+			if (!buffer)
+			{
+				Registry &r = registry();
+				std::lock_guard<std::mutex> guard(r.lock);
+				r.threads.emplace_back(new ThreadBuffer(static_cast<unsigned int>(r.threads.size())));
+				buffer = r.threads.back().get();
+			}
+			return buffer;
+		}
+
+		//! Determine the rate of the time stamp counter against the steady clock
+		void calibrate()
+		{
+#ifdef LWPP_PROFILER_TSC
+			static std::once_flag calibrated;
+			std::call_once(calibrated, []()
+			{
+				auto c0 = std::chrono::steady_clock::now();
+				ProfileTicks t0 = Profiler::Now();
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+				auto c1 = std::chrono::steady_clock::now();
+				ProfileTicks t1 = Profiler::Now();
+				double us = std::chrono::duration<double, std::micro>(c1 - c0).count();
+				registry().ticksPerMicrosecond = static_cast<double>(t1 - t0) / us;
+			});
+#endif
+		}
+
+		//! Update a value only written by this thread
+		inline void bump(std::atomic<std::uint64_t> &a, std::uint64_t v)
+		{
+			a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+		}
+
+		inline unsigned int bucket(std::uint64_t ticks)
+		{
+			unsigned int b = 0;
+			while (ticks && (b < Profiler::HistogramBuckets - 1))
+			{
+				ticks >>= 1;
+				++b;
+			}
+			return b;
+		}
+
+		void writeJsonString(std::ostream &os, const std::string &str)
+		{
+			os << '"';
+			for (char c : str)
+			{
+				if ((c == '"') || (c == '\\')) os << '\\';
+				if (static_cast<unsigned char>(c) >= 0x20) os << c;
+			}
+			os << '"';
+		}
+
+		//! Enables profiling if LWPP_PROFILE is set and writes the trace once the module is unloaded
+		class EnvironmentProfiler
+		{
+			std::string m_traceFile;
+		public:
+			EnvironmentProfiler()
+			{
+				registry(); // make sure the registry outlives this object
+				const char *file = std::getenv("LWPP_PROFILE");
+				if (file && *file)
+				{
+					m_traceFile = file;
+					Profiler::Enable();
+				}
+			}
+			~EnvironmentProfiler()
+			{
+				if (!m_traceFile.empty())
+				{
+					Profiler::Enable(false);
+					Profiler::WriteChromeTrace(m_traceFile);
+				}
+			}
+		};
+		EnvironmentProfiler environmentProfiler;
+	}
+
+	void Profiler::Enable(bool enable)
+	{
+		if (enable) calibrate();
+		s_enabled.store(enable, std::memory_order_relaxed);
+	}
+
+	double Profiler::TicksToMicroseconds(ProfileTicks ticks)
+	{
+		return static_cast<double>(ticks) / registry().ticksPerMicrosecond;
+	}
+
+	unsigned int Profiler::RegisterZone(const std::string &name)
+	{
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		auto it = std::find(r.zoneNames.begin(), r.zoneNames.end(), name);
+		if (it != r.zoneNames.end()) return static_cast<unsigned int>(it - r.zoneNames.begin());
+		if (r.zoneNames.size() >= MaxZones) return MaxZones;
+		r.zoneNames.push_back(name);
+		return static_cast<unsigned int>(r.zoneNames.size() - 1);
+	}
+
+	void Profiler::Record(unsigned int zone, ProfileTicks start, ProfileTicks end)
+	{
+		if (zone >= MaxZones) return;
+		ThreadBuffer *tb = threadBuffer();
+		const ProfileTicks duration = end - start;
+
+		ThreadZone &z = tb->zones[zone];
+		bump(z.count, 1);
+		bump(z.total, duration);
+		if (duration < z.min.load(std::memory_order_relaxed)) z.min.store(duration, std::memory_order_relaxed);
+		if (duration > z.max.load(std::memory_order_relaxed)) z.max.store(duration, std::memory_order_relaxed);
+		bump(z.histogram[bucket(duration)], 1);
+
+		// ring buffer, the oldest events get overwritten
+		const std::uint64_t w = tb->written.load(std::memory_order_relaxed);
+		ProfileEvent &e = tb->events[w % EventsPerThread];
+		e.start = start;
+		e.end = end;
+		e.zone = zone;
+		tb->written.store(w + 1, std::memory_order_release);
+	}
+
+	void Profiler::Reset()
+	{
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		for (auto &tb : r.threads) tb->clear();
+	}
+
+	unsigned int Profiler::ZoneCount()
+	{
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		return static_cast<unsigned int>(r.zoneNames.size());
+	}
+
+	bool Profiler::GetZoneStats(unsigned int zone, ProfileZoneStats &stats)
+	{
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		if (zone >= r.zoneNames.size()) return false;
+
+		std::uint64_t total = 0, min = ~std::uint64_t(0), max = 0;
+		stats.name = r.zoneNames[zone];
+		stats.count = 0;
+		std::fill(stats.histogram, stats.histogram + HistogramBuckets, 0);
+		for (auto &tb : r.threads)
+		{
+			const ThreadZone &z = tb->zones[zone];
+			stats.count += z.count.load(std::memory_order_relaxed);
+			total += z.total.load(std::memory_order_relaxed);
+			min = std::min(min, z.min.load(std::memory_order_relaxed));
+			max = std::max(max, z.max.load(std::memory_order_relaxed));
+			for (unsigned int i = 0; i < HistogramBuckets; ++i)
+			{
+				stats.histogram[i] += z.histogram[i].load(std::memory_order_relaxed);
+			}
+		}
+		stats.total = TicksToMicroseconds(total);
+		stats.min = stats.count ? TicksToMicroseconds(min) : 0.0;
+		stats.max = TicksToMicroseconds(max);
+		return true;
+	}
+
+	void Profiler::WriteReport(std::ostream &os)
+	{
+		std::vector<ProfileZoneStats> zones;
+		const unsigned int numZones = ZoneCount();
+		for (unsigned int i = 0; i < numZones; ++i)
+		{
+			ProfileZoneStats stats;
+			if (GetZoneStats(i, stats) && stats.count) zones.push_back(stats);
+		}
+		std::sort(zones.begin(), zones.end(), [](const ProfileZoneStats &a, const ProfileZoneStats &b) { return a.total > b.total; });
+
+		os << std::fixed << std::setprecision(3);
+		os << "calls\ttotal [ms]\tmean [us]\tmin [us]\tmax [us]\tzone\n";
+		for (auto &z : zones)
+		{
+			os << z.count << "\t" << z.total / 1000.0 << "\t" << z.total / z.count << "\t" << z.min << "\t" << z.max << "\t" << z.name << "\n";
+			os << "\thistogram:";
+			for (unsigned int i = 0; i < HistogramBuckets; ++i)
+			{
+				if (z.histogram[i])
+					os << " <" << TicksToMicroseconds(ProfileTicks(1) << i) << "us:" << z.histogram[i];
+			}
+			os << "\n";
+		}
+	}
+
+	bool Profiler::WriteChromeTrace(const std::string &fileName)
+	{
+		std::ofstream out(fileName.c_str(), std::ios::out | std::ios::trunc);
+		if (!out) return false;
+
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+
+		// all time stamps are relative to the earliest recorded event
+		ProfileTicks base = ~ProfileTicks(0);
+		for (auto &tb : r.threads)
+		{
+			const std::uint64_t written = tb->written.load(std::memory_order_acquire);
+			const std::uint64_t n = std::min<std::uint64_t>(written, EventsPerThread);
+			for (std::uint64_t i = written - n; i < written; ++i)
+			{
+				base = std::min(base, tb->events[i % EventsPerThread].start);
+			}
+		}
+
+		out << std::fixed << std::setprecision(3);
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (auto &tb : r.threads)
+		{
+			if (!first) out << ",\n";
+			first = false;
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tb->index
+				<< ",\"args\":{\"name\":\"lwpp thread " << tb->index << "\"}}";
+
+			const std::uint64_t written = tb->written.load(std::memory_order_acquire);
+			const std::uint64_t n = std::min<std::uint64_t>(written, EventsPerThread);
+			for (std::uint64_t i = written - n; i < written; ++i)
+			{
+				const ProfileEvent &e = tb->events[i % EventsPerThread];
+				out << ",\n{\"name\":";
+				writeJsonString(out, r.zoneNames[e.zone]);
+				out << ",\"cat\":\"lwpp\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tb->index
+					<< ",\"ts\":" << TicksToMicroseconds(e.start - base)
+					<< ",\"dur\":" << TicksToMicroseconds(e.end - e.start) << "}";
+			}
+		}
+		out << "\n]}\n";
+		return out.good();
+	}
+} // end namespace lwpp
@@ -1,4 +1,6 @@
 #include <lwpp/texture.h>
+#include <algorithm>
+#include <string.h>
 
 namespace lwpp
 {
@@ -22,4 +24,108 @@ namespace lwpp
 		return TextureLayer(nextLayerID(layer.getID()));
 	}
 
+	void TextureCache::Setup(const Point3d &boxMin, const Point3d &boxMax, int resX, int resY, int resZ, bool world)
+	{
+		const int res[3] = {resX, resY, resZ};
+		for (int i = 0; i < 3; ++i)
+		{
+			m_min[i] = std::min(boxMin[i], boxMax[i]);
+			m_max[i] = std::max(boxMin[i], boxMax[i]);
+			m_res[i] = std::max(res[i], 1);
+			// a flat box can't be interpolated along
+			if (m_max[i] <= m_min[i]) m_res[i] = 1;
+			m_scale[i] = (m_res[i] > 1) ? (m_res[i] - 1) / (m_max[i] - m_min[i]) : 0.0;
+		}
+		m_world = world;
+		Clear();
+	}
+
+	void TextureCache::Bake(const LWMicropol &templ)
+	{
+		Clear();
+		if (!m_texture.getID() || (m_res[0] < 1) || (m_res[1] < 1) || (m_res[2] < 1)) return;
+
+		LWMicropol mp = templ;
+		// match the texture filtering to the grid spacing
+		double spot = 0.0;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (m_scale[i] > 0.0) spot = std::max(spot, 1.0 / m_scale[i]);
+		}
+		mp.spotSize = spot;
+
+		m_grid.resize(static_cast<size_t>(m_res[0]) * m_res[1] * m_res[2] * 4);
+		std::vector<float>::iterator node = m_grid.begin();
+		double pos[3];
+		for (int z = 0; z < m_res[2]; ++z)
+		{
+			pos[2] = (m_res[2] > 1) ? m_min[2] + z / m_scale[2] : 0.5 * (m_min[2] + m_max[2]);
+			for (int y = 0; y < m_res[1]; ++y)
+			{
+				pos[1] = (m_res[1] > 1) ? m_min[1] + y / m_scale[1] : 0.5 * (m_min[1] + m_max[1]);
+				for (int x = 0; x < m_res[0]; ++x)
+				{
+					pos[0] = (m_res[0] > 1) ? m_min[0] + x / m_scale[0] : 0.5 * (m_min[0] + m_max[0]);
+					memcpy(mp.oPos, pos, sizeof(pos));
+					memcpy(mp.wPos, pos, sizeof(pos));
+					double value[4] = {0.0, 0.0, 0.0, 0.0};
+					const double alpha = m_texture.evaluate(&mp, value);
+					*node++ = static_cast<float>(value[0]);
+					*node++ = static_cast<float>(value[1]);
+					*node++ = static_cast<float>(value[2]);
+					*node++ = static_cast<float>(alpha);
+				}
+			}
+		}
+	}
+
+	void TextureCache::lookup(const double pos[3], double value[3], double &alpha) const
+	{
+		// grid cell and the weight of its upper corner per axis
+		int cell[3];
+		double w[3];
+		size_t stride[3] = {4, 4 * static_cast<size_t>(m_res[0]), 4 * static_cast<size_t>(m_res[0]) * m_res[1]};
+		for (int i = 0; i < 3; ++i)
+		{
+			if (m_res[i] > 1)
+			{
+				const double g = (pos[i] - m_min[i]) * m_scale[i];
+				cell[i] = std::min(static_cast<int>(g), m_res[i] - 2);
+				w[i] = g - cell[i];
+			}
+			else
+			{
+				cell[i] = 0;
+				w[i] = 0.0;
+				stride[i] = 0;
+			}
+		}
+		const float *base = &m_grid[cell[0] * stride[0] + cell[1] * stride[1] + cell[2] * stride[2]];
+		double result[4] = {0.0, 0.0, 0.0, 0.0};
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			double weight = 1.0;
+			size_t offset = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				if (corner & (1 << i))
+				{
+					weight *= w[i];
+					offset += stride[i];
+				}
+				else
+				{
+					weight *= 1.0 - w[i];
+				}
+			}
+			if (weight == 0.0) continue;
+			const float *n = base + offset;
+			for (int c = 0; c < 4; ++c) result[c] += weight * n[c];
+		}
+		value[0] = result[0];
+		value[1] = result[1];
+		value[2] = result[2];
+		alpha = result[3];
+	}
+
 } // lwpp
\ No newline at end of file
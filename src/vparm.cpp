@@ -120,4 +120,33 @@ namespace lwpp
 		}
 		return *this;
 	}
+
+	void VParmSampler::Update(const LWTime *times, size_t count)
+	{
+		m_times.assign(times, times + count);
+		std::sort(m_times.begin(), m_times.end());
+		m_times.erase(std::unique(m_times.begin(), m_times.end()), m_times.end());
+		m_constant = !m_vparm.isEnveloped();
+		if (m_times.empty())
+		{
+			m_values.clear();
+			return;
+		}
+		// without envelopes the value is the same at any time
+		m_values.resize(m_constant ? 1 : m_times.size());
+		for (size_t i = 0; i < m_values.size(); ++i)
+		{
+			m_vparm.Evaluate(m_times[i], m_values[i]);
+		}
+	}
+
+	void VParmSampler::Update(LWTime start, LWTime end, size_t count)
+	{
+		std::vector<LWTime> times(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			times[i] = (count > 1) ? start + (end - start) * i / (count - 1) : end;
+		}
+		Update(times.empty() ? 0 : &times[0], count);
+	}
 } // end namespace lwpp
\ No newline at end of file